@@ -0,0 +1,242 @@
+/*****************************************************
+ *  Garbage-collectable Data Structure: BitSet.
+ *
+ *  NOTE: it is a dense set of small non-negative integers
+ *        (e.g. TempObject::id inside a function).
+ *        the set operations work word by word and modify
+ *        the set in place, so that no memory is allocated
+ *        in the loops of dataflow analysis.
+ *
+ *  PUBLIC INTERFACES:
+ *    iterator
+ *      - iterator type (yields the elements in ascending order)
+ *
+ *    BitSet(size_t n)
+ *      - constructs an empty set whose elements are in [0, n)
+ *
+ *    BitSet(const BitSet& s)
+ *      - constructs a set as same as the given set
+ *
+ *    size_t universe(void) const
+ *      - returns n (the upper bound of the elements)
+ *
+ *    size_t size(void) const
+ *      - returns the size of this set
+ *
+ *    void add(size_t e)
+ *      - adds an element to this set
+ *
+ *    void remove(size_t e)
+ *      - removes an element from this set
+ *
+ *    bool contains(size_t e) const
+ *      - tests whether this set contains the specified element
+ *
+ *    bool empty(void) const
+ *      - whether it is an empty set
+ *
+ *    void clear(void)
+ *      - erases all the elements in this set
+ *
+ *    bool unite(const BitSet* s)
+ *      - this = this \cup s, returns whether this set has changed
+ *
+ *    void intersect(const BitSet* s)
+ *      - this = this \cap s
+ *
+ *    void subtract(const BitSet* s)
+ *      - this = this - s
+ *
+ *    void copyFrom(const BitSet* s)
+ *      - this = s
+ *
+ *    BitSet* clone(void) const
+ *      - clones this set
+ *
+ *    bool equal(const BitSet* s) const
+ *      - tests whether this set is equal to the given set
+ *
+ *    iterator begin(void) const
+ *      - gets the begin iterator
+ *
+ *    iterator end(void) const
+ *      - gets the end iterator
+ *
+ *  NOTE: the sets taking part in a binary operation should
+ *        have the same universe.
+ */
+
+#ifndef __MIND_BITSET__
+#define __MIND_BITSET__
+
+#include "boehmgc.hpp"
+
+#include <cstddef>
+#include <iterator>
+
+namespace mind {
+
+  namespace util {
+
+	class BitSet {
+	private:
+	  typedef unsigned long _Word;
+	  enum { _BITS = 8 * sizeof(_Word) };
+
+	  size_t _n;      // upper bound of the elements
+	  size_t _words;  // length of the underlying container
+	  _Word* _bits;   // the bit-vector
+
+	  static size_t _wordsFor(size_t n) {
+		return (n + _BITS - 1) / _BITS;
+	  }
+
+	  // smallest element >= e (or _n if there is none)
+	  size_t _next(size_t e) const {
+		size_t w = e / _BITS;
+		if (w >= _words)
+		  return _n;
+
+		_Word cur = _bits[w] & (~(_Word)0 << (e % _BITS));
+		while (0 == cur) {
+		  if (++w >= _words)
+			return _n;
+		  cur = _bits[w];
+		}
+
+		return w * _BITS + __builtin_ctzl(cur);
+	  }
+
+	public:
+	  class iterator {
+	  private:
+		const BitSet* _s;
+		size_t _e;
+
+	  public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef size_t value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const size_t* pointer;
+		typedef const size_t& reference;
+
+		iterator(const BitSet* s, size_t e) : _s(s), _e(e) {}
+
+		size_t operator*(void) const { return _e; }
+
+		iterator& operator++(void) {
+		  _e = _s->_next(_e + 1);
+		  return *this;
+		}
+
+		bool operator==(const iterator& i) const { return _e == i._e; }
+		bool operator!=(const iterator& i) const { return _e != i._e; }
+	  };
+
+	  BitSet(size_t n) {
+		_n = n;
+		_words = _wordsFor(n);
+		_bits = new _Word[_words + 1];
+		clear();
+	  }
+
+	  BitSet(const BitSet& s) {
+		_n = s._n;
+		_words = s._words;
+		_bits = new _Word[_words + 1];
+		copyFrom(&s);
+	  }
+
+	  ~BitSet() {
+		delete[] _bits;
+	  }
+
+	  size_t universe(void) const {
+		return _n;
+	  }
+
+	  size_t size(void) const {
+		size_t c = 0;
+		for (size_t i = 0; i < _words; ++i)
+		  c += __builtin_popcountl(_bits[i]);
+
+		return c;
+	  }
+
+	  void add(size_t e) {
+		_bits[e / _BITS] |= (_Word)1 << (e % _BITS);
+	  }
+
+	  void remove(size_t e) {
+		_bits[e / _BITS] &= ~((_Word)1 << (e % _BITS));
+	  }
+
+	  bool contains(size_t e) const {
+		return (e < _n) && (0 != (_bits[e / _BITS] & ((_Word)1 << (e % _BITS))));
+	  }
+
+	  bool empty(void) const {
+		for (size_t i = 0; i < _words; ++i)
+		  if (0 != _bits[i])
+			return false;
+
+		return true;
+	  }
+
+	  void clear(void) {
+		for (size_t i = 0; i < _words; ++i)
+		  _bits[i] = 0;
+	  }
+
+	  // the following loops are simple enough to be vectorized by the compiler
+	  bool unite(const BitSet* s) {
+		_Word changed = 0;
+		for (size_t i = 0; i < _words; ++i) {
+		  _Word w = _bits[i] | s->_bits[i];
+		  changed |= w ^ _bits[i];
+		  _bits[i] = w;
+		}
+
+		return (0 != changed);
+	  }
+
+	  void intersect(const BitSet* s) {
+		for (size_t i = 0; i < _words; ++i)
+		  _bits[i] &= s->_bits[i];
+	  }
+
+	  void subtract(const BitSet* s) {
+		for (size_t i = 0; i < _words; ++i)
+		  _bits[i] &= ~s->_bits[i];
+	  }
+
+	  void copyFrom(const BitSet* s) {
+		for (size_t i = 0; i < _words; ++i)
+		  _bits[i] = s->_bits[i];
+	  }
+
+	  BitSet* clone(void) const {
+		return new BitSet(*this);
+	  }
+
+	  bool equal(const BitSet* s) const {
+		for (size_t i = 0; i < _words; ++i)
+		  if (_bits[i] != s->_bits[i])
+			return false;
+
+		return true;
+	  }
+
+	  iterator begin(void) const {
+		return iterator(this, _next(0));
+	  }
+
+	  iterator end(void) const {
+		return iterator(this, _n);
+	  }
+	};
+
+  }
+}
+
+#endif // __MIND_BITSET__
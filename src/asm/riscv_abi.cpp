@@ -0,0 +1,220 @@
+/*****************************************************
+ *  Standard Calling Convention of RiscvDesc.
+ *
+ *  When optimization is enabled (-O), functions follow the RISC-V psABI
+ *  (integer calling convention, ILP32):
+ *    - the first 8 arguments are passed in a0-a7, the others on the stack
+ *      (the 9th at 0(sp) on entry, the 10th at 4(sp), ...);
+ *    - the result is returned in a0;
+ *    - s0(fp) and s1-s11 are callee-saved, and a function saves only those
+ *      it uses (fp is never used, see asm/riscv_frame.cpp);
+ *    - the other registers are caller-saved, so a caller preserves only the
+ *      values that are alive across a call and kept in such registers;
+ *    - sp is kept 16-byte aligned.
+ *
+ *  A call whose result is returned at once (a tail call) reuses the frame:
+ *  the arguments are passed as usual, but then the epilogue is executed and
+ *  the callee is jumped to, so that it returns to our caller directly. Only
+ *  the calls with all arguments in registers are done so, since the stack
+ *  arguments would have to go into the frame of our caller.
+ *
+ *  Without -O, the simple convention of emitCallTac is used (all arguments
+ *  on the stack, all alive variables saved around a call).
+ */
+
+#include "asm/riscv_md.hpp"
+#include "3rdparty/vector.hpp"
+#include "config.hpp"
+#include "options.hpp"
+#include "tac/flow_graph.hpp"
+#include "tac/tac.hpp"
+
+using namespace mind::assembly;
+using namespace mind::tac;
+using namespace mind::util;
+using namespace mind;
+
+#define WORD_SIZE 4
+#define NUM_ARG_REGS 8
+
+/* Rounds a size up to the stack alignment.
+ *
+ * PARAMETERS:
+ *   size  - the size in bytes
+ * RETURNS:
+ *   the smallest multiple of 16 not less than size
+ */
+int RiscvDesc::alignStack(int size) { return (size + 15) & ~15; }
+
+/* Translates a Call TAC (and its Param TACs) into Riscv instructions.
+ *
+ * PARAMETERS:
+ *   t     - the Call TAC
+ * NOTE:
+ *   the outgoing area at the top of the stack holds the stack arguments
+ *   first, then the saved caller-saved registers. a tail call (see
+ *   findTailCall) stops once the arguments are passed, and the jump to the
+ *   callee is added after the epilogue by layoutFrame.
+ */
+void RiscvDesc::emitStdCallTac(Tac *t) {
+    Vector<Temp> args;  // the arguments in order
+    Vector<Temp> saved; // the values to preserve across the call
+    Tac *first = t;
+
+    while (NULL != first->prev && Tac::PARAM == first->prev->op_code)
+        first = first->prev;
+    for (Tac *p = first; p != t; p = p->next)
+        args.push_back(p->op0.var);
+
+    for (LiveSet::iterator it = _live->begin(); it != _live->end(); ++it) {
+        Temp v = _graph->getTemp(*it);
+        // variables without a register are spilled before the call
+        if (v != t->op0.var && 0 != v->reg && !_reg[v->reg]->callee_saved)
+            saved.push_back(v);
+    }
+
+    int num_stack_args =
+        (int)args.size() > NUM_ARG_REGS ? (int)args.size() - NUM_ARG_REGS : 0;
+    int save_base = num_stack_args * WORD_SIZE;
+    int area = alignStack(save_base + saved.size() * WORD_SIZE);
+
+    // the arguments must survive until all of them have been passed (they
+    // are pinned in the live set for a while)
+    Vector<int> pinned;
+    for (size_t k = 0; k < args.size(); ++k)
+        if (!_live->contains(args[k]->id)) {
+            _live->add(args[k]->id);
+            pinned.push_back(args[k]->id);
+        }
+
+    if (area > 0)
+        addInstr(RiscvInstr::ADDI, _reg[RiscvReg::SP], _reg[RiscvReg::SP],
+                 NULL, -area, std::string(), NULL);
+    for (size_t k = 0; k < saved.size(); ++k)
+        addInstr(RiscvInstr::SW, _reg[saved[k]->reg], _reg[RiscvReg::SP], NULL,
+                 save_base + k * WORD_SIZE, std::string(), NULL);
+
+    for (size_t k = 0; k < args.size(); ++k) {
+        int r = getRegForRead(args[k], 0, _live);
+        if ((int)k < NUM_ARG_REGS)
+            addInstr(RiscvInstr::MOVE, _reg[RiscvReg::A0 + k], _reg[r], NULL,
+                     0, std::string(), NULL);
+        else
+            addInstr(RiscvInstr::SW, _reg[r], _reg[RiscvReg::SP], NULL,
+                     (k - NUM_ARG_REGS) * WORD_SIZE, std::string(), NULL);
+    }
+    for (size_t k = 0; k < pinned.size(); ++k)
+        _live->remove(pinned[k]);
+    spillDirtyRegs(_live);
+    if (t == _tail_call)
+        return;
+
+    addInstr(RiscvInstr::CALL, NULL, NULL, NULL, 0,
+             std::string("_") + t->op1.label->str_form, NULL);
+
+    for (size_t k = 0; k < saved.size(); ++k)
+        addInstr(RiscvInstr::LW, _reg[saved[k]->reg], _reg[RiscvReg::SP], NULL,
+                 save_base + k * WORD_SIZE, std::string(), NULL);
+    if (area > 0)
+        addInstr(RiscvInstr::ADDI, _reg[RiscvReg::SP], _reg[RiscvReg::SP],
+                 NULL, area, std::string(), NULL);
+
+    int r0 = getRegForWrite(t->op0.var, 0, 0, _live);
+    addInstr(RiscvInstr::MOVE, _reg[r0], _reg[RiscvReg::A0], NULL, 0,
+             std::string(), NULL);
+}
+
+/* Finds the tail call ending a basic block.
+ *
+ * PARAMETERS:
+ *   b     - the basic block
+ * RETURNS:
+ *   the Call TAC whose result b returns right after it (NULL if there is no
+ *   such call, or if some of its arguments would be passed on the stack)
+ * NOTE:
+ *   only with -O, since the simple convention of emitCallTac has no
+ *   epilogue of its own to jump after.
+ */
+Tac *RiscvDesc::findTailCall(BasicBlock *b) {
+    if (!Option::doOptimize() || BasicBlock::BY_RETURN != b->end_kind ||
+        NULL == b->tac_chain)
+        return NULL;
+
+    Tac *t = b->tac_chain;
+    while (NULL != t->next)
+        t = t->next;
+    if (Tac::CALL != t->op_code || t->op0.var != b->var)
+        return NULL;
+
+    int num_args = 0;
+    for (Tac *p = t->prev; NULL != p && Tac::PARAM == p->op_code; p = p->prev)
+        ++num_args;
+
+    return (num_args <= NUM_ARG_REGS) ? t : NULL;
+}
+
+/* Translates the entry code of a function.
+ *
+ * PARAMETERS:
+ *   g     - the control-flow graph
+ * RETURNS:
+ *   the instructions to execute before the first basic block
+ * NOTE:
+ *   it should be called before any variable is reserved in the stack-frame,
+ *   when the only variables with a fixed offset are the parameters (whose
+ *   offset is 4 * the position of the parameter).
+ *
+ *   parameters passed in registers are moved into their own registers, or
+ *   into a slot of the stack-frame; parameters passed on the stack stay
+ *   there. the other variables alive at the entry and kept in registers are
+ *   set to 0, since the first basic block may also be the head of a loop.
+ */
+RiscvInstr *RiscvDesc::prepareEntry(FlowGraph *g) {
+    RiscvInstr leading;
+    LiveSet *live = g->getBlock(0)->LiveIn;
+    LiveSet params(g->numTemps());
+
+    leading.next = NULL;
+    _tail = &leading;
+    for (size_t id = 0; id < g->numTemps(); ++id) {
+        Temp v = g->getTemp(id);
+
+        if (NULL == v || !v->is_offset_fixed)
+            continue;
+
+        int k = v->offset / WORD_SIZE; // the position of the parameter
+        params.add(id);
+        if (k >= NUM_ARG_REGS) {
+            v->offset -= NUM_ARG_REGS * WORD_SIZE;
+            if (0 != v->reg && live->contains(id))
+                addInstr(RiscvInstr::LW, _reg[v->reg], _reg[RiscvReg::FP],
+                         NULL, v->offset, std::string(), NULL);
+            continue;
+        }
+
+        // the slot above fp belongs to the caller now
+        v->is_offset_fixed = false;
+        if (!live->contains(id))
+            continue;
+
+        if (0 != v->reg) {
+            addInstr(RiscvInstr::MOVE, _reg[v->reg], _reg[RiscvReg::A0 + k],
+                     NULL, 0, std::string(), NULL);
+        } else {
+            _frame->reserve(v);
+            addInstr(RiscvInstr::SW, _reg[RiscvReg::A0 + k], _reg[RiscvReg::FP],
+                     NULL, v->offset, std::string(), NULL);
+        }
+    }
+
+    for (LiveSet::iterator it = live->begin(); it != live->end(); ++it) {
+        Temp v = g->getTemp(*it);
+
+        if (0 != v->reg && !params.contains(*it))
+            addInstr(RiscvInstr::MOVE, _reg[v->reg], _reg[RiscvReg::ZERO],
+                     NULL, 0, std::string(), NULL);
+    }
+    _tail = NULL;
+
+    return leading.next;
+}
@@ -0,0 +1,441 @@
+/*****************************************************
+ *  Compressed Instructions of RiscvDesc.
+ *
+ *  With the C extension (e.g. -march=rv32imc), an instruction is output in
+ *  its 16-bit form (c.li, c.mv, c.addi, c.lw, c.sw, c.j, c.beqz, ...) when
+ *  its operands fit in it. Most of those forms take the same register as
+ *  destination and first source, and many of them can only name x8-x15
+ *  (fp, s1 and a0-a5), which is why the global register allocator hands
+ *  out a2-a5 first when compressing (see asm/riscv_reg_alloc.cpp).
+ *
+ *  A compressed branch reaches only +-256 bytes (+-2 KiB for c.j), so every
+ *  branch starts compressed, and those which don't reach their targets are
+ *  output in 32 bits instead by the branch relaxation (see
+ *  asm/riscv_relax.cpp).
+ *
+ *  The code size of every function, with and without compression, can be
+ *  printed with the "-s" option. (The 16-bit codes are encoded here too,
+ *  for "-filetype=obj".)
+ */
+
+#include "asm/riscv_md.hpp"
+#include "3rdparty/vector.hpp"
+#include "config.hpp"
+#include "options.hpp"
+
+#include <iomanip>
+#include <sstream>
+
+using namespace mind::assembly;
+using namespace mind::util;
+using namespace mind;
+
+namespace {
+// the 16-bit forms
+enum RvcForm {
+    C_NONE = 0,
+    C_LI,
+    C_MV,
+    C_ADDI,
+    C_ADDI16SP,
+    C_ADDI4SPN,
+    C_ADD,
+    C_SUB,
+    C_AND,
+    C_OR,
+    C_XOR,
+    C_ANDI,
+    C_SLLI,
+    C_SRLI,
+    C_SRAI,
+    C_LW,
+    C_LWSP,
+    C_SW,
+    C_SWSP,
+    C_J,
+    C_BEQZ,
+    C_BNEZ,
+    C_JR
+};
+
+// the code size of a function (for the statistics)
+struct CodeSize {
+    std::string name; // the function
+    int full;         // the size in bytes without compression
+    int compressed;   // the size in bytes with compression
+};
+} // namespace
+
+// the mnemonics of the 16-bit forms
+static const char *rvc_names[] = {
+    NULL,     "c.li",    "c.mv",  "c.addi", "c.addi16sp", "c.addi4spn",
+    "c.add",  "c.sub",   "c.and", "c.or",   "c.xor",      "c.andi",
+    "c.slli", "c.srli",  "c.srai", "c.lw",  "c.lwsp",     "c.sw",
+    "c.swsp", "c.j",     "c.beqz", "c.bnez", "c.jr"};
+
+// the code sizes of the functions output so far
+static Vector<CodeSize> code_sizes;
+
+// whether an offset is a multiple of 4 in [0, max]
+static bool fitsScaled(int i, int max) {
+    return i >= 0 && i <= max && 0 == (i & 3);
+}
+
+/* Tests whether a register is one of x8-x15 (the registers named by the
+ * 3-bit fields of the 16-bit forms).
+ *
+ * PARAMETERS:
+ *   r     - the register
+ * RETURNS:
+ *   true if r is fp, s1 or a0-a5
+ */
+bool RiscvDesc::isRvcReg(RiscvReg *r) {
+    for (int k = RiscvReg::FP; k <= RiscvReg::A5; ++k)
+        if (_reg[k] == r)
+            return true;
+
+    return false;
+}
+
+/* Gets the 16-bit form of an instruction.
+ *
+ * PARAMETERS:
+ *   i     - the instruction
+ * RETURNS:
+ *   the form (see RvcForm), or C_NONE if there is none
+ * NOTE:
+ *   the distance to the target of a jump is checked by relaxBranches.
+ */
+int RiscvDesc::getRvcForm(RiscvInstr *i) {
+    RiscvReg *zero = _reg[RiscvReg::ZERO], *sp = _reg[RiscvReg::SP];
+
+    switch (i->op_code) {
+    case RiscvInstr::LI:
+        return (zero != i->r0 && fitsBits(i->i, 6)) ? C_LI : C_NONE;
+
+    case RiscvInstr::MOVE:
+        if (zero == i->r0)
+            return C_NONE;
+        return (zero == i->r1) ? C_LI : C_MV;
+
+    case RiscvInstr::ADDI:
+        if (sp == i->r0 && sp == i->r1 && 0 == (i->i & 15) && 0 != i->i &&
+            i->i >= -512 && i->i <= 496)
+            return C_ADDI16SP;
+        if (sp == i->r1 && isRvcReg(i->r0) && 0 != i->i &&
+            fitsScaled(i->i, 1020))
+            return C_ADDI4SPN;
+        return (zero != i->r0 && i->r0 == i->r1 && 0 != i->i &&
+                fitsBits(i->i, 6))
+                   ? C_ADDI
+                   : C_NONE;
+
+    case RiscvInstr::ADD:
+        if (zero == i->r0 || zero == i->r1 || zero == i->r2)
+            return C_NONE;
+        return (i->r0 == i->r1 || i->r0 == i->r2) ? C_ADD : C_NONE;
+
+    case RiscvInstr::SUB:
+        return (isRvcReg(i->r0) && i->r0 == i->r1 && isRvcReg(i->r2))
+                   ? C_SUB
+                   : C_NONE;
+
+    case RiscvInstr::AND:
+    case RiscvInstr::OR:
+    case RiscvInstr::XOR:
+        if (!isRvcReg(i->r1) || !isRvcReg(i->r2) ||
+            (i->r0 != i->r1 && i->r0 != i->r2))
+            return C_NONE;
+        return (RiscvInstr::AND == i->op_code)
+                   ? C_AND
+                   : (RiscvInstr::OR == i->op_code) ? C_OR : C_XOR;
+
+    case RiscvInstr::ANDI:
+        return (isRvcReg(i->r0) && i->r0 == i->r1 && fitsBits(i->i, 6))
+                   ? C_ANDI
+                   : C_NONE;
+
+    case RiscvInstr::SLLI:
+        return (zero != i->r0 && i->r0 == i->r1 && i->i > 0 && i->i < 32)
+                   ? C_SLLI
+                   : C_NONE;
+
+    case RiscvInstr::SRLI:
+    case RiscvInstr::SRAI:
+        if (!isRvcReg(i->r0) || i->r0 != i->r1 || i->i <= 0 || i->i >= 32)
+            return C_NONE;
+        return (RiscvInstr::SRLI == i->op_code) ? C_SRLI : C_SRAI;
+
+    case RiscvInstr::LW:
+        if (sp == i->r1 && zero != i->r0 && fitsScaled(i->i, 252))
+            return C_LWSP;
+        return (isRvcReg(i->r0) && isRvcReg(i->r1) && fitsScaled(i->i, 124))
+                   ? C_LW
+                   : C_NONE;
+
+    case RiscvInstr::SW:
+        if (sp == i->r1 && fitsScaled(i->i, 252))
+            return C_SWSP;
+        return (isRvcReg(i->r0) && isRvcReg(i->r1) && fitsScaled(i->i, 124))
+                   ? C_SW
+                   : C_NONE;
+
+    case RiscvInstr::J:
+        return C_J;
+
+    case RiscvInstr::BEQZ:
+    case RiscvInstr::BNEZ:
+        if (!isRvcReg(i->r0))
+            return C_NONE;
+        return (RiscvInstr::BEQZ == i->op_code) ? C_BEQZ : C_BNEZ;
+
+    case RiscvInstr::BEQ:
+    case RiscvInstr::BNE:
+        // (a comparison with zero)
+        if (!(zero == i->r1 && isRvcReg(i->r0)) &&
+            !(zero == i->r0 && isRvcReg(i->r1)))
+            return C_NONE;
+        return (RiscvInstr::BEQ == i->op_code) ? C_BEQZ : C_BNEZ;
+
+    case RiscvInstr::RET:
+        return C_JR;
+
+    default:
+        return C_NONE;
+    }
+}
+
+/* Chooses the instructions of a function to output in 16-bit forms.
+ *
+ * PARAMETERS:
+ *   i     - the instruction sequence of the function
+ *   name  - the name of the function (for the statistics)
+ * NOTE:
+ *   the branches are relaxed as well.
+ */
+void RiscvDesc::compressInstrs(RiscvInstr *i, std::string name) {
+    CodeSize size;
+    size.name = name;
+    size.full = 0;
+
+    // Step 1. every instruction with a 16-bit form is compressed
+    for (RiscvInstr *p = i; NULL != p; p = p->next) {
+        p->compressed = false;
+        size.full += getInstrSize(p);
+        p->compressed = !p->cancelled && C_NONE != getRvcForm(p);
+    }
+
+    // Step 2. the jumps which don't reach are expanded (see relaxBranches)
+    size.compressed = relaxBranches(i);
+    code_sizes.push_back(size);
+}
+
+/* Prints an instruction in its 16-bit form.
+ *
+ * PARAMETERS:
+ *   i     - the instruction (compressed by compressInstrs)
+ * RETURNS:
+ *   the text of the instruction
+ */
+std::string RiscvDesc::printRvcInstr(RiscvInstr *i) {
+    std::ostringstream oss;
+    int form = getRvcForm(i);
+    mind_assert(C_NONE != form);
+
+    // the source which is not the destination (of a commutative operation)
+    RiscvReg *other = (i->r0 == i->r1) ? i->r2 : i->r1;
+
+    oss << std::left << std::setw(6) << (std::string(rvc_names[form]) + " ");
+    switch (form) {
+    case C_LI:
+        oss << i->r0->name << ", "
+            << ((RiscvInstr::MOVE == i->op_code) ? 0 : i->i);
+        break;
+
+    case C_MV:
+        oss << i->r0->name << ", " << i->r1->name;
+        break;
+
+    case C_ADDI:
+    case C_ADDI16SP:
+    case C_ANDI:
+    case C_SLLI:
+    case C_SRLI:
+    case C_SRAI:
+        oss << i->r0->name << ", " << i->i;
+        break;
+
+    case C_ADDI4SPN:
+        oss << i->r0->name << ", " << i->r1->name << ", " << i->i;
+        break;
+
+    case C_ADD:
+    case C_AND:
+    case C_OR:
+    case C_XOR:
+        oss << i->r0->name << ", " << other->name;
+        break;
+
+    case C_SUB:
+        oss << i->r0->name << ", " << i->r2->name;
+        break;
+
+    case C_LW:
+    case C_LWSP:
+    case C_SW:
+    case C_SWSP:
+        oss << i->r0->name << ", " << i->i << "(" << i->r1->name << ")";
+        break;
+
+    case C_J:
+        oss << i->l;
+        break;
+
+    case C_BEQZ:
+    case C_BNEZ:
+        // (beq/bne with zero as either operand)
+        oss << ((_reg[RiscvReg::ZERO] == i->r0) ? i->r1 : i->r0)->name << ", "
+            << i->l;
+        break;
+
+    case C_JR:
+        oss << "ra";
+        break;
+
+    default:
+        mind_assert(false); // unreachable
+    }
+
+    return oss.str();
+}
+
+// gets the bits hi..lo of a value
+static unsigned bitsOf(int v, int hi, int lo) {
+    return ((unsigned)v >> lo) & ((1u << (hi - lo + 1)) - 1);
+}
+
+/* Encodes an instruction in its 16-bit form.
+ *
+ * PARAMETERS:
+ *   i     - the instruction (compressed by compressInstrs)
+ *   dist  - the distance to the target (of a jump)
+ * RETURNS:
+ *   the 16-bit code (see the RVC chapter of the RISC-V ISA manual)
+ */
+unsigned RiscvDesc::encodeRvcInstr(RiscvInstr *i, int dist) {
+    int form = getRvcForm(i);
+    mind_assert(C_NONE != form);
+
+    // the source which is not the destination (of a commutative operation)
+    RiscvReg *other = (i->r0 == i->r1) ? i->r2 : i->r1;
+    int imm = i->i;
+
+    switch (form) {
+    case C_LI:
+        imm = (RiscvInstr::MOVE == i->op_code) ? 0 : i->i;
+        return 0x4001 | (bitsOf(imm, 5, 5) << 12) | (getRegNum(i->r0) << 7) |
+               (bitsOf(imm, 4, 0) << 2);
+
+    case C_MV:
+        return 0x8002 | (getRegNum(i->r0) << 7) | (getRegNum(i->r1) << 2);
+
+    case C_ADDI:
+        return 0x0001 | (bitsOf(imm, 5, 5) << 12) | (getRegNum(i->r0) << 7) |
+               (bitsOf(imm, 4, 0) << 2);
+
+    case C_ADDI16SP:
+        return 0x6101 | (bitsOf(imm, 9, 9) << 12) | (bitsOf(imm, 4, 4) << 6) |
+               (bitsOf(imm, 6, 6) << 5) | (bitsOf(imm, 8, 7) << 3) |
+               (bitsOf(imm, 5, 5) << 2);
+
+    case C_ADDI4SPN:
+        return 0x0000 | (bitsOf(imm, 5, 4) << 11) | (bitsOf(imm, 9, 6) << 7) |
+               (bitsOf(imm, 2, 2) << 6) | (bitsOf(imm, 3, 3) << 5) |
+               ((getRegNum(i->r0) - 8) << 2);
+
+    case C_ADD:
+        return 0x9002 | (getRegNum(i->r0) << 7) | (getRegNum(other) << 2);
+
+    case C_SUB:
+        return 0x8c01 | ((getRegNum(i->r0) - 8) << 7) |
+               ((getRegNum(i->r2) - 8) << 2);
+
+    case C_XOR:
+    case C_OR:
+    case C_AND:
+        return ((C_XOR == form) ? 0x8c21 : (C_OR == form) ? 0x8c41 : 0x8c61) |
+               ((getRegNum(i->r0) - 8) << 7) | ((getRegNum(other) - 8) << 2);
+
+    case C_ANDI:
+        return 0x8801 | (bitsOf(imm, 5, 5) << 12) |
+               ((getRegNum(i->r0) - 8) << 7) | (bitsOf(imm, 4, 0) << 2);
+
+    case C_SLLI:
+        return 0x0002 | (getRegNum(i->r0) << 7) | (bitsOf(imm, 4, 0) << 2);
+
+    case C_SRLI:
+    case C_SRAI:
+        return ((C_SRLI == form) ? 0x8001 : 0x8401) |
+               ((getRegNum(i->r0) - 8) << 7) | (bitsOf(imm, 4, 0) << 2);
+
+    case C_LW:
+    case C_SW:
+        return ((C_LW == form) ? 0x4000 : 0xc000) | (bitsOf(imm, 5, 3) << 10) |
+               ((getRegNum(i->r1) - 8) << 7) | (bitsOf(imm, 2, 2) << 6) |
+               (bitsOf(imm, 6, 6) << 5) | ((getRegNum(i->r0) - 8) << 2);
+
+    case C_LWSP:
+        return 0x4002 | (bitsOf(imm, 5, 5) << 12) | (getRegNum(i->r0) << 7) |
+               (bitsOf(imm, 4, 2) << 4) | (bitsOf(imm, 7, 6) << 2);
+
+    case C_SWSP:
+        return 0xc002 | (bitsOf(imm, 5, 2) << 9) | (bitsOf(imm, 7, 6) << 7) |
+               (getRegNum(i->r0) << 2);
+
+    case C_J:
+        return 0xa001 | (bitsOf(dist, 11, 11) << 12) |
+               (bitsOf(dist, 4, 4) << 11) | (bitsOf(dist, 9, 8) << 9) |
+               (bitsOf(dist, 10, 10) << 8) | (bitsOf(dist, 6, 6) << 7) |
+               (bitsOf(dist, 7, 7) << 6) | (bitsOf(dist, 3, 1) << 3) |
+               (bitsOf(dist, 5, 5) << 2);
+
+    case C_BEQZ:
+    case C_BNEZ:
+        // (beq/bne with zero as either operand)
+        return ((C_BEQZ == form) ? 0xc001 : 0xe001) |
+               (bitsOf(dist, 8, 8) << 12) | (bitsOf(dist, 4, 3) << 10) |
+               ((getRegNum((_reg[RiscvReg::ZERO] == i->r0) ? i->r1 : i->r0) -
+                 8)
+                << 7) |
+               (bitsOf(dist, 7, 6) << 5) | (bitsOf(dist, 2, 1) << 3) |
+               (bitsOf(dist, 5, 5) << 2);
+
+    case C_JR:
+        return 0x8082; // (ra)
+
+    default:
+        mind_assert(false); // unreachable
+        return 0;
+    }
+}
+
+/* Prints the code size of every function (with and without compression).
+ *
+ * PARAMETERS:
+ *   os    - the output stream
+ */
+void RiscvDesc::dumpCompressStats(std::ostream &os) {
+    int full = 0, compressed = 0;
+
+    os << "* RVC:" << std::endl;
+    for (size_t k = 0; k < code_sizes.size(); ++k) {
+        CodeSize &s = code_sizes[k];
+        os << "    " << std::left << std::setw(16) << s.name << s.full << " -> "
+           << s.compressed << " bytes (-" << (s.full - s.compressed) << ")"
+           << std::endl;
+        full += s.full;
+        compressed += s.compressed;
+    }
+    os << "    " << std::left << std::setw(16) << "(total)" << full << " -> "
+       << compressed << " bytes (-" << (full - compressed) << ")" << std::endl;
+}
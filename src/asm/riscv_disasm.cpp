@@ -0,0 +1,445 @@
+/*****************************************************
+ *  Disassembler of RiscvDesc.
+ *
+ *  With "-filetype=dis", the object code (see asm/riscv_encode.cpp) is
+ *  decoded again and printed as assembly code, which tells whether the
+ *  encoding is right: the disassembly of a program should behave just like
+ *  the program itself, and it can be compared with the output of other
+ *  disassemblers (e.g. "objdump -d -M no-aliases") for the object file.
+ *
+ *  The instructions are printed in their base forms (e.g. "addi a0, zero,
+ *  5" for "li a0, 5"), with the address and the code of each in a comment.
+ *  The targets of the branches are given labels of their own (__D<address>)
+ *  unless they are functions, and the instructions with relocations are
+ *  printed as the pseudo instructions which produce them (call, la, j and
+ *  jal), as well as auipc and jalr through a7 (jump).
+ */
+
+#include "asm/riscv_md.hpp"
+#include "config.hpp"
+#include "options.hpp"
+
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+using namespace mind::assembly;
+using namespace mind;
+
+namespace {
+// what the disassembler knows about the object code
+struct DisasmContext {
+    RiscvObject *obj;
+    RiscvReg **reg;                               // (for the names)
+    std::map<int, std::string> labels;            // address -> label
+    std::map<int, RiscvObject::Reloc *> relocs;   // offset -> relocation
+};
+} // namespace
+
+// the names of the register-register operations (funct7 = 0 and 1)
+static const char *op_names[] = {"add", "sll", "slt", "sltu",
+                                 "xor", "srl", "or",  "and"};
+static const char *m_names[] = {"mul", "mulh", "mulhsu", "mulhu",
+                                "div", "divu", "rem",    "remu"};
+
+// the names of the loads, the stores and the branches (by funct3)
+static const char *load_names[] = {"lb", "lh", "lw", NULL,
+                                   "lbu", "lhu", NULL, NULL};
+static const char *store_names[] = {"sb", "sh", "sw", NULL,
+                                    NULL, NULL, NULL, NULL};
+static const char *branch_names[] = {"beq", "bne",  NULL,  NULL,
+                                     "blt", "bge", "bltu", "bgeu"};
+
+// gets the bits hi..lo of a code
+static int bitsOf(unsigned c, int hi, int lo) {
+    return (c >> lo) & ((1u << (hi - lo + 1)) - 1);
+}
+
+// sign-extends the lowest n bits of a value
+static int signExtend(int v, int n) {
+    return (v & (1 << (n - 1))) ? v - (1 << n) : v;
+}
+
+// reads a 16-bit or a 32-bit code (little-endian)
+static unsigned read16(RiscvObject *obj, int pc) {
+    return obj->text[pc] | (obj->text[pc + 1] << 8);
+}
+
+static unsigned read32(RiscvObject *obj, int pc) {
+    return read16(obj, pc) | (read16(obj, pc + 2) << 16);
+}
+
+// gets the label of an address (a new one if there is none yet)
+static std::string labelAt(DisasmContext &ctx, int addr) {
+    std::map<int, std::string>::iterator it = ctx.labels.find(addr);
+
+    if (it != ctx.labels.end())
+        return it->second;
+
+    std::string l = "__D" + std::to_string(addr);
+    ctx.labels[addr] = l;
+    return l;
+}
+
+// prints a mnemonic along with the operands
+static std::string format(const char *op, std::string args) {
+    std::ostringstream oss;
+
+    oss << std::left << std::setw(6) << (std::string(op) + " ") << args;
+    return oss.str();
+}
+
+// prints the operands "r0, r1, r2" / "r0, r1, imm" / "r0, imm(r1)"
+static std::string regs3(DisasmContext &ctx, int r0, int r1, int r2) {
+    return std::string(ctx.reg[r0]->name) + ", " + ctx.reg[r1]->name + ", " +
+           ctx.reg[r2]->name;
+}
+
+static std::string regsImm(DisasmContext &ctx, int r0, int r1, int imm) {
+    return std::string(ctx.reg[r0]->name) + ", " + ctx.reg[r1]->name + ", " +
+           std::to_string(imm);
+}
+
+static std::string memory(DisasmContext &ctx, int r0, int imm, int r1) {
+    return std::string(ctx.reg[r0]->name) + ", " + std::to_string(imm) + "(" +
+           ctx.reg[r1]->name + ")";
+}
+
+/* Decodes a 16-bit instruction.
+ *
+ * PARAMETERS:
+ *   ctx   - the context
+ *   pc    - the address
+ *   c     - the code
+ * RETURNS:
+ *   the text of the instruction
+ */
+static std::string decodeRvc(DisasmContext &ctx, int pc, unsigned c) {
+    int f3 = bitsOf(c, 15, 13);
+    int rd = bitsOf(c, 11, 7), rs2 = bitsOf(c, 6, 2);
+    int rd_ = 8 + bitsOf(c, 4, 2), rs1_ = 8 + bitsOf(c, 9, 7); // (x8-x15)
+    int imm6 = signExtend((bitsOf(c, 12, 12) << 5) | bitsOf(c, 6, 2), 6);
+    const char *name = NULL;
+    int imm;
+
+    switch (bitsOf(c, 1, 0)) {
+    case 0:
+        if (0 == f3 && 0 != c) {
+            imm = (bitsOf(c, 12, 11) << 4) | (bitsOf(c, 10, 7) << 6) |
+                  (bitsOf(c, 6, 6) << 2) | (bitsOf(c, 5, 5) << 3);
+            return format("c.addi4spn", regsImm(ctx, rd_, RiscvReg::SP, imm));
+        } else if (2 == f3 || 6 == f3) {
+            imm = (bitsOf(c, 12, 10) << 3) | (bitsOf(c, 6, 6) << 2) |
+                  (bitsOf(c, 5, 5) << 6);
+            return format((2 == f3) ? "c.lw" : "c.sw",
+                          memory(ctx, rd_, imm, rs1_));
+        }
+        break;
+
+    case 1:
+        switch (f3) {
+        case 0:
+            if (0 == rd)
+                return "c.nop";
+            return format("c.addi", std::string(ctx.reg[rd]->name) + ", " +
+                                        std::to_string(imm6));
+
+        case 1:
+        case 5:
+            imm = signExtend(
+                (bitsOf(c, 12, 12) << 11) | (bitsOf(c, 11, 11) << 4) |
+                    (bitsOf(c, 10, 9) << 8) | (bitsOf(c, 8, 8) << 10) |
+                    (bitsOf(c, 7, 7) << 6) | (bitsOf(c, 6, 6) << 7) |
+                    (bitsOf(c, 5, 3) << 1) | (bitsOf(c, 2, 2) << 5),
+                12);
+            return format((1 == f3) ? "c.jal" : "c.j", labelAt(ctx, pc + imm));
+
+        case 2:
+            return format("c.li", std::string(ctx.reg[rd]->name) + ", " +
+                                      std::to_string(imm6));
+
+        case 3:
+            if (RiscvReg::SP == rd) {
+                imm = signExtend(
+                    (bitsOf(c, 12, 12) << 9) | (bitsOf(c, 6, 6) << 4) |
+                        (bitsOf(c, 5, 5) << 6) | (bitsOf(c, 4, 3) << 7) |
+                        (bitsOf(c, 2, 2) << 5),
+                    10);
+                return format("c.addi16sp", "sp, " + std::to_string(imm));
+            }
+            return format("c.lui", std::string(ctx.reg[rd]->name) + ", " +
+                                       std::to_string(imm6 & 0xfffff));
+
+        case 4:
+            switch (bitsOf(c, 11, 10)) {
+            case 0:
+            case 1:
+                return format((0 == bitsOf(c, 11, 10)) ? "c.srli" : "c.srai",
+                              std::string(ctx.reg[rs1_]->name) + ", " +
+                                  std::to_string(imm6 & 31));
+
+            case 2:
+                return format("c.andi", std::string(ctx.reg[rs1_]->name) +
+                                            ", " + std::to_string(imm6));
+
+            default:
+                if (0 != bitsOf(c, 12, 12))
+                    break;
+                name = (0 == bitsOf(c, 6, 5))
+                           ? "c.sub"
+                           : (1 == bitsOf(c, 6, 5))
+                                 ? "c.xor"
+                                 : (2 == bitsOf(c, 6, 5)) ? "c.or" : "c.and";
+                return format(name, std::string(ctx.reg[rs1_]->name) + ", " +
+                                        ctx.reg[rd_]->name);
+            }
+            break;
+
+        default: // (6 and 7)
+            imm = signExtend(
+                (bitsOf(c, 12, 12) << 8) | (bitsOf(c, 11, 10) << 3) |
+                    (bitsOf(c, 6, 5) << 6) | (bitsOf(c, 4, 3) << 1) |
+                    (bitsOf(c, 2, 2) << 5),
+                9);
+            return format((6 == f3) ? "c.beqz" : "c.bnez",
+                          std::string(ctx.reg[rs1_]->name) + ", " +
+                              labelAt(ctx, pc + imm));
+        }
+        break;
+
+    case 2:
+        if (0 == f3) {
+            return format("c.slli", std::string(ctx.reg[rd]->name) + ", " +
+                                        std::to_string(imm6 & 31));
+        } else if (2 == f3) {
+            imm = (bitsOf(c, 12, 12) << 5) | (bitsOf(c, 6, 4) << 2) |
+                  (bitsOf(c, 3, 2) << 6);
+            return format("c.lwsp", memory(ctx, rd, imm, RiscvReg::SP));
+        } else if (6 == f3) {
+            imm = (bitsOf(c, 12, 9) << 2) | (bitsOf(c, 8, 7) << 6);
+            return format("c.swsp", memory(ctx, rs2, imm, RiscvReg::SP));
+        } else if (4 == f3 && 0 == rs2) {
+            if (0 == bitsOf(c, 12, 12))
+                return format("c.jr", ctx.reg[rd]->name);
+            else if (0 == rd)
+                return "c.ebreak";
+            return format("c.jalr", ctx.reg[rd]->name);
+        } else if (4 == f3) {
+            return format((0 == bitsOf(c, 12, 12)) ? "c.mv" : "c.add",
+                          std::string(ctx.reg[rd]->name) + ", " +
+                              ctx.reg[rs2]->name);
+        }
+        break;
+    }
+
+    std::ostringstream oss;
+    oss << ".half 0x" << std::hex << std::setw(4) << std::setfill('0') << c;
+    return oss.str();
+}
+
+/* Decodes an instruction.
+ *
+ * PARAMETERS:
+ *   ctx   - the context
+ *   pc    - the address
+ *   size  - (out) the size of the instruction (8 for a pair of them
+ *           printed as a pseudo instruction)
+ * RETURNS:
+ *   the text of the instruction
+ */
+static std::string decodeInstr(DisasmContext &ctx, int pc, int &size) {
+    unsigned c = read16(ctx.obj, pc);
+
+    if (3 != (c & 3)) {
+        size = 2;
+        return decodeRvc(ctx, pc, c);
+    }
+
+    c = read32(ctx.obj, pc);
+    size = 4;
+    int op = bitsOf(c, 6, 0), f3 = bitsOf(c, 14, 12), f7 = bitsOf(c, 31, 25);
+    int rd = bitsOf(c, 11, 7), rs1 = bitsOf(c, 19, 15), rs2 = bitsOf(c, 24, 20);
+    int imm_i = signExtend(bitsOf(c, 31, 20), 12);
+    int imm_s = signExtend((f7 << 5) | rd, 12);
+    int imm_b = signExtend((bitsOf(c, 31, 31) << 12) | (bitsOf(c, 7, 7) << 11) |
+                               (bitsOf(c, 30, 25) << 5) |
+                               (bitsOf(c, 11, 8) << 1),
+                           13);
+    int imm_j = signExtend((bitsOf(c, 31, 31) << 20) |
+                               (bitsOf(c, 19, 12) << 12) |
+                               (bitsOf(c, 20, 20) << 11) |
+                               (bitsOf(c, 30, 21) << 1),
+                           21);
+    int imm_u = bitsOf(c, 31, 12);
+    const char *name = NULL;
+
+    // the pseudo instructions (see asm/riscv_encode.cpp)
+    std::map<int, RiscvObject::Reloc *>::iterator it = ctx.relocs.find(pc);
+    if (it != ctx.relocs.end()) {
+        RiscvObject::Reloc *r = it->second;
+        switch (r->type) {
+        case RiscvObject::R_RISCV_CALL_PLT:
+            size = 8;
+            return format("call", r->symbol);
+
+        case RiscvObject::R_RISCV_PCREL_HI20:
+            size = 8;
+            return format("la", std::string(ctx.reg[rd]->name) + ", " +
+                                    r->symbol);
+
+        case RiscvObject::R_RISCV_JAL:
+            return format((0 == rd) ? "j" : "jal", r->symbol);
+        }
+    }
+    if (0x17 == op && pc + 8 <= (int)ctx.obj->text.size()) {
+        unsigned next = read32(ctx.obj, pc + 4);
+        if ((next & 0xfffff) == (0x67u | ((unsigned)rd << 15))) {
+            // (auipc and jalr zero through the same register)
+            size = 8;
+            return format("jump", labelAt(ctx, pc + (int)(imm_u << 12) +
+                                                    signExtend(next >> 20,
+                                                               12)) +
+                                      ", " + ctx.reg[rd]->name);
+        }
+    }
+
+    switch (op) {
+    case 0x33: // (OP)
+        if (0 == f7)
+            name = op_names[f3];
+        else if (1 == f7)
+            name = m_names[f3];
+        else if (0x20 == f7 && (0 == f3 || 5 == f3))
+            name = (0 == f3) ? "sub" : "sra";
+        else if (0x10 == f7 && 0 == (f3 & 1) && 0 != f3)
+            name = (2 == f3) ? "sh1add" : (4 == f3) ? "sh2add" : "sh3add";
+        else if (0x05 == f7 && f3 >= 4)
+            name = (4 == f3) ? "min"
+                             : (5 == f3) ? "minu" : (6 == f3) ? "max" : "maxu";
+        else if (0x07 == f7 && (5 == f3 || 7 == f3))
+            name = (5 == f3) ? "czero.eqz" : "czero.nez";
+        if (NULL != name)
+            return format(name, regs3(ctx, rd, rs1, rs2));
+        break;
+
+    case 0x13: // (OP-IMM)
+        if (1 == f3 && 0 == f7)
+            return format("slli", regsImm(ctx, rd, rs1, rs2));
+        else if (5 == f3 && (0 == f7 || 0x20 == f7))
+            return format((0 == f7) ? "srli" : "srai",
+                          regsImm(ctx, rd, rs1, rs2));
+        else if (1 != f3 && 5 != f3)
+            return format((0 == f3)   ? "addi"
+                          : (2 == f3) ? "slti"
+                          : (3 == f3) ? "sltiu"
+                          : (4 == f3) ? "xori"
+                          : (6 == f3) ? "ori"
+                                      : "andi",
+                          regsImm(ctx, rd, rs1, imm_i));
+        break;
+
+    case 0x03: // (LOAD)
+        if (NULL != load_names[f3])
+            return format(load_names[f3], memory(ctx, rd, imm_i, rs1));
+        break;
+
+    case 0x23: // (STORE)
+        if (NULL != store_names[f3])
+            return format(store_names[f3], memory(ctx, rs2, imm_s, rs1));
+        break;
+
+    case 0x63: // (BRANCH)
+        if (NULL != branch_names[f3])
+            return format(branch_names[f3],
+                          std::string(ctx.reg[rs1]->name) + ", " +
+                              ctx.reg[rs2]->name + ", " +
+                              labelAt(ctx, pc + imm_b));
+        break;
+
+    case 0x6f: // (JAL)
+        return format("jal", std::string(ctx.reg[rd]->name) + ", " +
+                                 labelAt(ctx, pc + imm_j));
+
+    case 0x67: // (JALR)
+        if (0 == f3)
+            return format("jalr", memory(ctx, rd, imm_i, rs1));
+        break;
+
+    case 0x37: // (LUI)
+    case 0x17: // (AUIPC)
+        return format((0x37 == op) ? "lui" : "auipc",
+                      std::string(ctx.reg[rd]->name) + ", " +
+                          std::to_string(imm_u));
+    }
+
+    std::ostringstream oss;
+    oss << ".word 0x" << std::hex << std::setw(8) << std::setfill('0') << c;
+    return oss.str();
+}
+
+/* Prints the disassembly of the object code.
+ *
+ * PARAMETERS:
+ *   os    - the output stream
+ *   arch  - the ISA string of the code, e.g. "rv32i2p1_m2p0"
+ */
+void RiscvDesc::disassemble(std::ostream &os, std::string arch) {
+    DisasmContext ctx;
+    ctx.obj = _obj;
+    ctx.reg = _reg;
+    int size = 0;
+
+    for (size_t k = 0; k < _obj->symbols.size(); ++k) {
+        RiscvObject::Symbol &s = _obj->symbols[k];
+        if (RiscvObject::TEXT == s.section && s.func)
+            ctx.labels[s.value] = s.name;
+    }
+    for (size_t k = 0; k < _obj->relocs.size(); ++k)
+        ctx.relocs[_obj->relocs[k].offset] = &_obj->relocs[k];
+
+    // Step 1. finds the targets of the branches
+    for (int pc = 0; pc < (int)_obj->text.size(); pc += size)
+        decodeInstr(ctx, pc, size);
+
+    // Step 2. prints the code
+    _result = &os;
+    emit(std::string(), (".attribute arch, \"" + arch + "\"").c_str(), NULL);
+    emit(std::string(), ".text", NULL);
+    emit(std::string(), ".globl main", NULL);
+    emit(std::string(), ".align 2", NULL);
+    for (int pc = 0; pc < (int)_obj->text.size(); pc += size) {
+        std::map<int, std::string>::iterator it = ctx.labels.find(pc);
+        if (it != ctx.labels.end())
+            emit(it->second, NULL, NULL);
+
+        std::string text = decodeInstr(ctx, pc, size);
+        std::ostringstream code;
+        code << std::hex << std::setfill('0') << std::setw(4) << pc << ":";
+        if (2 == size)
+            code << " " << std::setw(4) << read16(_obj, pc);
+        for (int w = 0; w + 4 <= size; w += 4) // (both codes of a pair)
+            code << " " << std::setw(8) << read32(_obj, pc + w);
+        emit(std::string(), text.c_str(), code.str().c_str());
+    }
+
+    // Step 3. prints the variables
+    for (size_t k = 0; k < _obj->symbols.size(); ++k) {
+        RiscvObject::Symbol &s = _obj->symbols[k];
+        if (RiscvObject::TEXT == s.section)
+            continue;
+
+        std::string body = ".zero " + std::to_string(s.size);
+        if (RiscvObject::DATA == s.section) {
+            unsigned v = 0;
+            for (int b = 3; b >= 0; --b)
+                v = (v << 8) | _obj->data[s.value + b];
+            body = ".word " + std::to_string((int)v);
+        }
+        emit(std::string(), (RiscvObject::DATA == s.section) ? ".data" : ".bss",
+             NULL);
+        emit(std::string(), ".align 2", NULL); // (as the sections of writeElf)
+        emit(std::string(), (".global " + s.name).c_str(), NULL);
+        emit(s.name, NULL, NULL);
+        emit(std::string(), body.c_str(), NULL);
+    }
+}
@@ -0,0 +1,274 @@
+/*****************************************************
+ *  ELF Object Files of RiscvDesc.
+ *
+ *  The object code (see asm/riscv_encode.cpp) is written out as an ELF32
+ *  little-endian relocatable for RISC-V, ready for any RISC-V linker:
+ *      the ELF header
+ *      .text              the code
+ *      .rela.text         the relocations of .text
+ *      .data              the initialized variables
+ *      .bss               the zeroed variables (no bytes in the file)
+ *      .riscv.attributes  the ISA string (i.e. ".attribute arch")
+ *      .symtab            the symbols (the local ones first)
+ *      .strtab            the names of the symbols
+ *      .shstrtab          the names of the sections
+ *      the section headers
+ *  The e_flags say whether there are compressed instructions (EF_RISCV_RVC)
+ *  and the soft-float ABI.
+ */
+
+#include "asm/riscv_md.hpp"
+#include "config.hpp"
+#include "options.hpp"
+
+#include <map>
+
+using namespace mind::assembly;
+using namespace mind;
+
+// the section headers
+enum {
+    SEC_NULL = 0,
+    SEC_TEXT,
+    SEC_RELA_TEXT,
+    SEC_DATA,
+    SEC_BSS,
+    SEC_ATTRIBUTES,
+    SEC_SYMTAB,
+    SEC_STRTAB,
+    SEC_SHSTRTAB,
+    NUM_SECTIONS
+};
+
+// the constants of ELF (see elf.h)
+#define ET_REL 1
+#define EM_RISCV 243
+#define EF_RISCV_RVC 1
+#define SHT_PROGBITS 1
+#define SHT_SYMTAB 2
+#define SHT_STRTAB 3
+#define SHT_RELA 4
+#define SHT_NOBITS 8
+#define SHT_RISCV_ATTRIBUTES 0x70000003
+#define SHF_WRITE 1
+#define SHF_ALLOC 2
+#define SHF_EXECINSTR 4
+#define SHF_INFO_LINK 0x40
+#define STB_LOCAL 0
+#define STB_GLOBAL 1
+#define STT_NOTYPE 0
+#define STT_OBJECT 1
+#define STT_FUNC 2
+#define STT_FILE 4
+#define SHN_ABS 0xfff1
+
+#define EHDR_SIZE 52
+#define SHDR_SIZE 40
+#define SYM_SIZE 16
+#define RELA_SIZE 12
+
+// appends little-endian values to a byte buffer
+static void put8(std::string &buf, unsigned v) { buf += (char)(v & 0xff); }
+
+static void put16(std::string &buf, unsigned v) {
+    put8(buf, v);
+    put8(buf, v >> 8);
+}
+
+static void put32(std::string &buf, unsigned v) {
+    put16(buf, v & 0xffff);
+    put16(buf, v >> 16);
+}
+
+// pads a byte buffer with zeros to a multiple of 4
+static void align4(std::string &buf) {
+    while (0 != (buf.size() & 3))
+        put8(buf, 0);
+}
+
+// appends a name to a string table
+static unsigned addString(std::string &strtab, std::string name) {
+    unsigned k = strtab.size();
+    strtab += name;
+    put8(strtab, 0);
+    return k;
+}
+
+// appends a symbol to .symtab
+static void addSymbol(std::string &symtab, unsigned name, unsigned value,
+                      unsigned size, int bind, int type, unsigned shndx) {
+    put32(symtab, name);
+    put32(symtab, value);
+    put32(symtab, size);
+    put8(symtab, (bind << 4) | type);
+    put8(symtab, 0); // (STV_DEFAULT)
+    put16(symtab, shndx);
+}
+
+// appends a section header
+static void addSection(std::string &shdrs, unsigned name, unsigned type,
+                       unsigned flags, unsigned offset, unsigned size,
+                       unsigned link, unsigned info, unsigned align,
+                       unsigned entsize) {
+    put32(shdrs, name);
+    put32(shdrs, type);
+    put32(shdrs, flags);
+    put32(shdrs, 0); // (sh_addr)
+    put32(shdrs, offset);
+    put32(shdrs, size);
+    put32(shdrs, link);
+    put32(shdrs, info);
+    put32(shdrs, align);
+    put32(shdrs, entsize);
+}
+
+/* Writes the object code as an ELF32 relocatable.
+ *
+ * PARAMETERS:
+ *   os    - the output stream (binary)
+ *   arch  - the ISA string of the code, e.g. "rv32i2p1_m2p0"
+ */
+void RiscvDesc::writeElf(std::ostream &os, std::string arch) {
+    std::string symtab, strtab, shstrtab, rela, attrs;
+    std::map<std::string, int> index; // symbol -> index in .symtab
+    int num_syms = 0;
+    int first_global;
+
+    // Step 1. the symbols, the local ones first
+    const int shndx[] = {0, SEC_TEXT, SEC_DATA, SEC_BSS};
+    put8(strtab, 0);
+    addSymbol(symtab, 0, 0, 0, STB_LOCAL, STT_NOTYPE, 0);
+    addSymbol(symtab, addString(strtab, Option::getInput()), 0, 0, STB_LOCAL,
+              STT_FILE, SHN_ABS);
+    num_syms = 2;
+    for (int global = 0; global <= 1; ++global) {
+        if (1 == global)
+            first_global = num_syms;
+        for (size_t k = 0; k < _obj->symbols.size(); ++k) {
+            RiscvObject::Symbol &s = _obj->symbols[k];
+            if ((int)s.global != global)
+                continue;
+            addSymbol(symtab, addString(strtab, s.name), s.value, s.size,
+                      global ? STB_GLOBAL : STB_LOCAL,
+                      s.func ? STT_FUNC
+                             : (RiscvObject::TEXT == s.section) ? STT_NOTYPE
+                                                                : STT_OBJECT,
+                      shndx[s.section]);
+            index[s.name] = num_syms++;
+        }
+    }
+    // (a function declared but not defined)
+    for (size_t k = 0; k < _obj->relocs.size(); ++k) {
+        std::string &name = _obj->relocs[k].symbol;
+        if (index.find(name) != index.end())
+            continue;
+        addSymbol(symtab, addString(strtab, name), 0, 0, STB_GLOBAL,
+                  STT_NOTYPE, 0);
+        index[name] = num_syms++;
+    }
+
+    // Step 2. the relocations
+    for (size_t k = 0; k < _obj->relocs.size(); ++k) {
+        RiscvObject::Reloc &r = _obj->relocs[k];
+        put32(rela, r.offset);
+        put32(rela, (index[r.symbol] << 8) | r.type);
+        put32(rela, 0); // (r_addend)
+    }
+
+    // Step 3. the attributes (a "riscv" subsection of a file attribute)
+    std::string arch_attr;
+    put8(arch_attr, 5); // (Tag_RISCV_arch)
+    addString(arch_attr, arch);
+    put8(attrs, 'A'); // (the format version)
+    put32(attrs, 4 + 6 + 5 + arch_attr.size());
+    addString(attrs, "riscv");
+    put8(attrs, 1); // (Tag_File)
+    put32(attrs, 5 + arch_attr.size());
+    attrs += arch_attr;
+
+    // Step 4. the sections, one after another
+    std::string out(EHDR_SIZE, '\0');
+    unsigned offset[NUM_SECTIONS], size[NUM_SECTIONS];
+    unsigned name[NUM_SECTIONS];
+    const char *names[NUM_SECTIONS] = {
+        "",        ".text",   ".rela.text", ".data",     ".bss",
+        ".riscv.attributes",  ".symtab",    ".strtab",   ".shstrtab"};
+    put8(shstrtab, 0);
+    name[SEC_NULL] = 0;
+    for (int k = SEC_TEXT; k < NUM_SECTIONS; ++k)
+        name[k] = addString(shstrtab, names[k]);
+
+    offset[SEC_NULL] = size[SEC_NULL] = 0;
+    offset[SEC_TEXT] = out.size();
+    out.append(_obj->text.begin(), _obj->text.end());
+    size[SEC_TEXT] = _obj->text.size();
+    align4(out);
+    offset[SEC_RELA_TEXT] = out.size();
+    out += rela;
+    size[SEC_RELA_TEXT] = rela.size();
+    offset[SEC_DATA] = out.size();
+    out.append(_obj->data.begin(), _obj->data.end());
+    size[SEC_DATA] = _obj->data.size();
+    offset[SEC_BSS] = out.size();
+    size[SEC_BSS] = _obj->bss_size;
+    offset[SEC_ATTRIBUTES] = out.size();
+    out += attrs;
+    size[SEC_ATTRIBUTES] = attrs.size();
+    align4(out);
+    offset[SEC_SYMTAB] = out.size();
+    out += symtab;
+    size[SEC_SYMTAB] = symtab.size();
+    offset[SEC_STRTAB] = out.size();
+    out += strtab;
+    size[SEC_STRTAB] = strtab.size();
+    offset[SEC_SHSTRTAB] = out.size();
+    out += shstrtab;
+    size[SEC_SHSTRTAB] = shstrtab.size();
+    align4(out);
+
+    // Step 5. the section headers
+    unsigned shoff = out.size();
+    addSection(out, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    addSection(out, name[SEC_TEXT], SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR,
+               offset[SEC_TEXT], size[SEC_TEXT], 0, 0,
+               (0 != (_isa_used & Option::EXT_C)) ? 2 : 4, 0);
+    addSection(out, name[SEC_RELA_TEXT], SHT_RELA, SHF_INFO_LINK,
+               offset[SEC_RELA_TEXT], size[SEC_RELA_TEXT], SEC_SYMTAB,
+               SEC_TEXT, 4, RELA_SIZE);
+    addSection(out, name[SEC_DATA], SHT_PROGBITS, SHF_WRITE | SHF_ALLOC,
+               offset[SEC_DATA], size[SEC_DATA], 0, 0, 4, 0);
+    addSection(out, name[SEC_BSS], SHT_NOBITS, SHF_WRITE | SHF_ALLOC,
+               offset[SEC_BSS], size[SEC_BSS], 0, 0, 4, 0);
+    addSection(out, name[SEC_ATTRIBUTES], SHT_RISCV_ATTRIBUTES, 0,
+               offset[SEC_ATTRIBUTES], size[SEC_ATTRIBUTES], 0, 0, 1, 0);
+    addSection(out, name[SEC_SYMTAB], SHT_SYMTAB, 0, offset[SEC_SYMTAB],
+               size[SEC_SYMTAB], SEC_STRTAB, first_global, 4, SYM_SIZE);
+    addSection(out, name[SEC_STRTAB], SHT_STRTAB, 0, offset[SEC_STRTAB],
+               size[SEC_STRTAB], 0, 0, 1, 0);
+    addSection(out, name[SEC_SHSTRTAB], SHT_STRTAB, 0, offset[SEC_SHSTRTAB],
+               size[SEC_SHSTRTAB], 0, 0, 1, 0);
+
+    // Step 6. the ELF header
+    std::string ehdr;
+    ehdr += "\177ELF";
+    put8(ehdr, 1); // (ELFCLASS32)
+    put8(ehdr, 1); // (ELFDATA2LSB)
+    put8(ehdr, 1); // (EV_CURRENT)
+    ehdr.resize(16, '\0');
+    put16(ehdr, ET_REL);
+    put16(ehdr, EM_RISCV);
+    put32(ehdr, 1); // (e_version)
+    put32(ehdr, 0); // (e_entry)
+    put32(ehdr, 0); // (e_phoff)
+    put32(ehdr, shoff);
+    put32(ehdr, (0 != (_isa_used & Option::EXT_C)) ? EF_RISCV_RVC : 0);
+    put16(ehdr, EHDR_SIZE);
+    put16(ehdr, 0); // (e_phentsize)
+    put16(ehdr, 0); // (e_phnum)
+    put16(ehdr, SHDR_SIZE);
+    put16(ehdr, NUM_SECTIONS);
+    put16(ehdr, SEC_SHSTRTAB);
+    out.replace(0, EHDR_SIZE, ehdr);
+
+    os.write(out.data(), out.size());
+}
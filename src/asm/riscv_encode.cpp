@@ -0,0 +1,468 @@
+/*****************************************************
+ *  Machine Code of RiscvDesc.
+ *
+ *  With "-filetype=obj" (or "-c"), the instructions are encoded into .text
+ *  instead of being printed, and the global variables into .data (or .bss,
+ *  if they are 0). Every instruction takes exactly the size the branch
+ *  relaxation has laid it out with (see getInstrSize), so the branches and
+ *  the jumps inside a function are resolved here, while the references to
+ *  other functions and to the variables are left to the linker:
+ *      call f      =>   auipc ra, 0        # R_RISCV_CALL_PLT f
+ *                       jalr  ra, 0(ra)
+ *      la   a0, x  =>   auipc a0, 0        # R_RISCV_PCREL_HI20 x
+ *                       addi  a0, a0, 0    # R_RISCV_PCREL_LO12_I (the auipc)
+ *      j    f      =>   jal   zero, 0      # R_RISCV_JAL f
+ *
+ *  The object code is written out by writeElf (see asm/riscv_elf.cpp).
+ */
+
+#include "asm/riscv_md.hpp"
+#include "config.hpp"
+#include "options.hpp"
+
+#include <map>
+
+using namespace mind::assembly;
+using namespace mind;
+
+#define WORD_SIZE 4
+
+// the major opcodes (the lowest 7 bits)
+#define OP_LOAD 0x03
+#define OP_IMM 0x13
+#define OP_AUIPC 0x17
+#define OP_STORE 0x23
+#define OP_REG 0x33
+#define OP_LUI 0x37
+#define OP_BRANCH 0x63
+#define OP_JALR 0x67
+#define OP_JAL 0x6f
+
+// gets the bits hi..lo of a value
+static unsigned bitsOf(int v, int hi, int lo) {
+    return ((unsigned)v >> lo) & ((1u << (hi - lo + 1)) - 1);
+}
+
+// the instruction formats
+static unsigned typeR(int f7, int rs2, int rs1, int f3, int rd) {
+    return (f7 << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) |
+           OP_REG;
+}
+
+static unsigned typeI(int imm, int rs1, int f3, int rd, int op) {
+    return (bitsOf(imm, 11, 0) << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) |
+           op;
+}
+
+static unsigned typeS(int imm, int rs2, int rs1, int f3) {
+    return (bitsOf(imm, 11, 5) << 25) | (rs2 << 20) | (rs1 << 15) |
+           (f3 << 12) | (bitsOf(imm, 4, 0) << 7) | OP_STORE;
+}
+
+static unsigned typeB(int imm, int rs2, int rs1, int f3) {
+    return (bitsOf(imm, 12, 12) << 31) | (bitsOf(imm, 10, 5) << 25) |
+           (rs2 << 20) | (rs1 << 15) | (f3 << 12) | (bitsOf(imm, 4, 1) << 8) |
+           (bitsOf(imm, 11, 11) << 7) | OP_BRANCH;
+}
+
+static unsigned typeU(unsigned hi20, int rd, int op) {
+    return (hi20 << 12) | (rd << 7) | op;
+}
+
+static unsigned typeJ(int imm, int rd) {
+    return (bitsOf(imm, 20, 20) << 31) | (bitsOf(imm, 10, 1) << 21) |
+           (bitsOf(imm, 11, 11) << 20) | (bitsOf(imm, 19, 12) << 12) |
+           (rd << 7) | OP_JAL;
+}
+
+// splits a value into the upper 20 bits and the lower 12 (signed) bits
+static void splitHiLo(int v, unsigned &hi, int &lo) {
+    hi = (((unsigned)v + 0x800) >> 12) & 0xfffff;
+    lo = (int)((unsigned)v - (hi << 12));
+}
+
+// appends a 16-bit or a 32-bit code (little-endian)
+static void put16(util::Vector<unsigned char> &sec, unsigned c) {
+    sec.push_back(c & 0xff);
+    sec.push_back((c >> 8) & 0xff);
+}
+
+static void put32(util::Vector<unsigned char> &sec, unsigned c) {
+    put16(sec, c & 0xffff);
+    put16(sec, c >> 16);
+}
+
+/* Tests whether an immediate fits in a signed field.
+ *
+ * PARAMETERS:
+ *   i     - the immediate (or the offset)
+ *   n     - the width of the field in bits
+ * RETURNS:
+ *   true if -2^(n-1) <= i < 2^(n-1)
+ * NOTE:
+ *   also used by the compression and the branch relaxation
+ */
+bool RiscvDesc::fitsBits(int i, int n) {
+    return i >= -(1 << (n - 1)) && i < (1 << (n - 1));
+}
+
+/* Gets the number of a register.
+ *
+ * PARAMETERS:
+ *   r     - the register
+ * RETURNS:
+ *   the number of r (e.g. 10 for a0)
+ */
+int RiscvDesc::getRegNum(RiscvReg *r) {
+    for (int k = 0; k < RiscvReg::TOTAL_NUM; ++k)
+        if (_reg[k] == r)
+            return k;
+
+    mind_assert(false); // not a register
+    return 0;
+}
+
+/* Encodes the instructions of a function into .text.
+ *
+ * PARAMETERS:
+ *   name  - the name of the function (global if it is "main")
+ *   i     - the instruction sequence (laid out by relaxBranches)
+ */
+void RiscvDesc::encodeFuncty(std::string name, RiscvInstr *i) {
+    std::map<std::string, int> where; // label -> address
+    int base = _obj->text.size();
+    int pc = base;
+
+    for (RiscvInstr *p = i; NULL != p; p = p->next) {
+        if (RiscvInstr::LABEL == p->op_code && !p->cancelled)
+            where[p->l] = pc;
+        pc += getInstrSize(p);
+    }
+
+    RiscvObject::Symbol sym;
+    sym.name = name;
+    sym.section = RiscvObject::TEXT;
+    sym.value = base;
+    sym.size = pc - base;
+    sym.global = (name == "main");
+    sym.func = true;
+    _obj->symbols.push_back(sym);
+
+    for (RiscvInstr *p = i; NULL != p; p = p->next) {
+        int start = _obj->text.size();
+        // (the labels of the calls and of the variables are not looked up)
+        std::map<std::string, int>::iterator it = where.end();
+        if (RiscvInstr::CALL != p->op_code && RiscvInstr::LA != p->op_code &&
+            RiscvInstr::LABEL != p->op_code)
+            it = where.find(p->l);
+        encodeInstr(p, (it == where.end()) ? -1 : it->second);
+        mind_assert((int)_obj->text.size() - start == getInstrSize(p));
+    }
+}
+
+/* Encodes a single instruction into .text.
+ *
+ * PARAMETERS:
+ *   i      - the instruction
+ *   target - the address of its target in .text, or -1 if the target is
+ *            another function (or a runtime routine)
+ */
+void RiscvDesc::encodeInstr(RiscvInstr *i, int target) {
+    util::Vector<unsigned char> &text = _obj->text;
+    int pc = text.size();
+    int dist = target - pc;
+
+    if (i->cancelled)
+        return;
+    if (i->compressed) { // (see asm/riscv_compress.cpp)
+        mind_assert(target >= 0 || (RiscvInstr::J != i->op_code &&
+                                    RiscvInstr::BEQZ != i->op_code &&
+                                    RiscvInstr::BNEZ != i->op_code &&
+                                    RiscvInstr::BEQ != i->op_code &&
+                                    RiscvInstr::BNE != i->op_code));
+        _isa_used |= Option::EXT_C;
+        put16(text, encodeRvcInstr(i, dist));
+        return;
+    }
+
+    int r0 = (NULL == i->r0) ? 0 : getRegNum(i->r0);
+    int r1 = (NULL == i->r1) ? 0 : getRegNum(i->r1);
+    int r2 = (NULL == i->r2) ? 0 : getRegNum(i->r2);
+    int ra = RiscvReg::RA;
+    RiscvObject::Reloc rel;
+    rel.offset = pc;
+    rel.symbol = i->l;
+    unsigned hi;
+    int lo;
+
+    switch (i->op_code) {
+    case RiscvInstr::COMMENT:
+    case RiscvInstr::LABEL:
+        return;
+
+    case RiscvInstr::LI:
+        if (fitsBits(i->i, 12)) {
+            put32(text, typeI(i->i, 0, 0, r0, OP_IMM));
+        } else {
+            splitHiLo(i->i, hi, lo);
+            put32(text, typeU(hi, r0, OP_LUI));
+            if (0 != lo)
+                put32(text, typeI(lo, r0, 0, r0, OP_IMM));
+        }
+        break;
+
+    case RiscvInstr::MOVE:
+        put32(text, typeI(0, r1, 0, r0, OP_IMM)); // (addi)
+        break;
+
+    case RiscvInstr::NEG:
+        put32(text, typeR(0x20, r1, 0, 0, r0)); // (sub from zero)
+        break;
+
+    case RiscvInstr::NOT:
+        put32(text, typeI(-1, r1, 4, r0, OP_IMM)); // (xori -1)
+        break;
+
+    case RiscvInstr::SEQZ:
+        put32(text, typeI(1, r1, 3, r0, OP_IMM)); // (sltiu 1)
+        break;
+
+    case RiscvInstr::SNEZ:
+        put32(text, typeR(0, r1, 0, 3, r0)); // (sltu from zero)
+        break;
+
+    case RiscvInstr::LW:
+        put32(text, typeI(i->i, r1, 2, r0, OP_LOAD));
+        break;
+
+    case RiscvInstr::SW:
+        put32(text, typeS(i->i, r0, r1, 2));
+        break;
+
+    case RiscvInstr::RET:
+        put32(text, typeI(0, ra, 0, 0, OP_JALR));
+        break;
+
+    case RiscvInstr::ADD:
+        put32(text, typeR(0, r2, r1, 0, r0));
+        break;
+
+    case RiscvInstr::SUB:
+        put32(text, typeR(0x20, r2, r1, 0, r0));
+        break;
+
+    case RiscvInstr::SLT:
+        put32(text, typeR(0, r2, r1, 2, r0));
+        break;
+
+    case RiscvInstr::SLTU:
+        put32(text, typeR(0, r2, r1, 3, r0));
+        break;
+
+    case RiscvInstr::SGT:
+        put32(text, typeR(0, r1, r2, 2, r0)); // (slt, swapped)
+        break;
+
+    case RiscvInstr::XOR:
+        put32(text, typeR(0, r2, r1, 4, r0));
+        break;
+
+    case RiscvInstr::OR:
+        put32(text, typeR(0, r2, r1, 6, r0));
+        break;
+
+    case RiscvInstr::AND:
+        put32(text, typeR(0, r2, r1, 7, r0));
+        break;
+
+    case RiscvInstr::MUL:
+        put32(text, typeR(1, r2, r1, 0, r0));
+        break;
+
+    case RiscvInstr::MULH:
+        put32(text, typeR(1, r2, r1, 1, r0));
+        break;
+
+    case RiscvInstr::DIV:
+        put32(text, typeR(1, r2, r1, 4, r0));
+        break;
+
+    case RiscvInstr::REM:
+        put32(text, typeR(1, r2, r1, 6, r0));
+        break;
+
+    case RiscvInstr::SH1ADD:
+        put32(text, typeR(0x10, r2, r1, 2, r0));
+        break;
+
+    case RiscvInstr::SH2ADD:
+        put32(text, typeR(0x10, r2, r1, 4, r0));
+        break;
+
+    case RiscvInstr::SH3ADD:
+        put32(text, typeR(0x10, r2, r1, 6, r0));
+        break;
+
+    case RiscvInstr::MIN:
+        put32(text, typeR(0x05, r2, r1, 4, r0));
+        break;
+
+    case RiscvInstr::MAX:
+        put32(text, typeR(0x05, r2, r1, 6, r0));
+        break;
+
+    case RiscvInstr::CZERO_EQZ:
+        put32(text, typeR(0x07, r2, r1, 5, r0));
+        break;
+
+    case RiscvInstr::CZERO_NEZ:
+        put32(text, typeR(0x07, r2, r1, 7, r0));
+        break;
+
+    case RiscvInstr::ADDI:
+        put32(text, typeI(i->i, r1, 0, r0, OP_IMM));
+        break;
+
+    case RiscvInstr::SLTI:
+        put32(text, typeI(i->i, r1, 2, r0, OP_IMM));
+        break;
+
+    case RiscvInstr::XORI:
+        put32(text, typeI(i->i, r1, 4, r0, OP_IMM));
+        break;
+
+    case RiscvInstr::ORI:
+        put32(text, typeI(i->i, r1, 6, r0, OP_IMM));
+        break;
+
+    case RiscvInstr::ANDI:
+        put32(text, typeI(i->i, r1, 7, r0, OP_IMM));
+        break;
+
+    case RiscvInstr::SLLI:
+        put32(text, typeI(i->i, r1, 1, r0, OP_IMM));
+        break;
+
+    case RiscvInstr::SRLI:
+        put32(text, typeI(i->i, r1, 5, r0, OP_IMM));
+        break;
+
+    case RiscvInstr::SRAI:
+        put32(text, typeI(0x400 | i->i, r1, 5, r0, OP_IMM));
+        break;
+
+    case RiscvInstr::BEQZ:
+        mind_assert(target >= 0);
+        put32(text, typeB(dist, 0, r0, 0));
+        break;
+
+    case RiscvInstr::BNEZ:
+        mind_assert(target >= 0);
+        put32(text, typeB(dist, 0, r0, 1));
+        break;
+
+    case RiscvInstr::BEQ:
+        mind_assert(target >= 0);
+        put32(text, typeB(dist, r1, r0, 0));
+        break;
+
+    case RiscvInstr::BNE:
+        mind_assert(target >= 0);
+        put32(text, typeB(dist, r1, r0, 1));
+        break;
+
+    case RiscvInstr::BLT:
+        mind_assert(target >= 0);
+        put32(text, typeB(dist, r1, r0, 4));
+        break;
+
+    case RiscvInstr::BGE:
+        mind_assert(target >= 0);
+        put32(text, typeB(dist, r1, r0, 5));
+        break;
+
+    case RiscvInstr::BLTU:
+        mind_assert(target >= 0);
+        put32(text, typeB(dist, r1, r0, 6));
+        break;
+
+    case RiscvInstr::BGEU:
+        mind_assert(target >= 0);
+        put32(text, typeB(dist, r1, r0, 7));
+        break;
+
+    case RiscvInstr::J:
+    case RiscvInstr::JAL:
+        if (target < 0) {
+            rel.type = RiscvObject::R_RISCV_JAL;
+            _obj->relocs.push_back(rel);
+            dist = 0;
+        }
+        put32(text, typeJ(dist, (RiscvInstr::JAL == i->op_code) ? ra : 0));
+        break;
+
+    case RiscvInstr::JUMP:
+        mind_assert(target >= 0);
+        splitHiLo(dist, hi, lo);
+        put32(text, typeU(hi, RiscvReg::A7, OP_AUIPC));
+        put32(text, typeI(lo, RiscvReg::A7, 0, 0, OP_JALR));
+        break;
+
+    case RiscvInstr::CALL:
+        rel.type = RiscvObject::R_RISCV_CALL_PLT;
+        _obj->relocs.push_back(rel);
+        put32(text, typeU(0, ra, OP_AUIPC));
+        put32(text, typeI(0, ra, 0, ra, OP_JALR));
+        break;
+
+    case RiscvInstr::LA: {
+        // (the lower half refers to a label at the auipc)
+        RiscvObject::Symbol sym;
+        sym.name = ".Lpcrel_hi" + std::to_string(pc);
+        sym.section = RiscvObject::TEXT;
+        sym.value = pc;
+        sym.size = 0;
+        sym.global = false;
+        sym.func = false;
+        _obj->symbols.push_back(sym);
+        rel.type = RiscvObject::R_RISCV_PCREL_HI20;
+        _obj->relocs.push_back(rel);
+        rel.offset = pc + 4;
+        rel.symbol = sym.name;
+        rel.type = RiscvObject::R_RISCV_PCREL_LO12_I;
+        _obj->relocs.push_back(rel);
+        put32(text, typeU(0, r0, OP_AUIPC));
+        put32(text, typeI(0, r0, 0, r0, OP_IMM));
+        break;
+    }
+
+    default:
+        mind_assert(false); // other instructions not supported
+    }
+    _isa_used |= extensionOf(i->op_code);
+}
+
+/* Encodes a global variable.
+ *
+ * PARAMETERS:
+ *   name  - the name of the variable
+ *   value - the initial value (in .bss if it is 0)
+ */
+void RiscvDesc::encodeGlobal(std::string name, int value) {
+    RiscvObject::Symbol sym;
+    sym.name = name;
+    sym.size = WORD_SIZE;
+    sym.global = true;
+    sym.func = false;
+
+    if (0 == value) {
+        sym.section = RiscvObject::BSS;
+        sym.value = _obj->bss_size;
+        _obj->bss_size += WORD_SIZE;
+    } else {
+        sym.section = RiscvObject::DATA;
+        sym.value = _obj->data.size();
+        put32(_obj->data, value);
+    }
+    _obj->symbols.push_back(sym);
+}
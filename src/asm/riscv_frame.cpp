@@ -0,0 +1,477 @@
+/*****************************************************
+ *  Stack-frame Layout of RiscvDesc.
+ *
+ *  The stack-frame of a function looks like (from high to low addresses):
+ *
+ *      the stack arguments
+ *      ------------------------------- <- CFA (i.e. sp on entry)
+ *      the saved registers               (_saved_regs[k] at CFA - 4 * (k + 1))
+ *      the slots of RiscvStackFrameManager
+ *      ------------------------------- <- sp
+ *
+ *  While the basic blocks are being translated, the frame is addressed
+ *  through fp, which stands for the CFA. Without -O, fp is really set up
+ *  that way: ra and fp are always saved, and every return restores them.
+ *
+ *  With -O, there is no frame pointer at all. Once the frame size F is
+ *  known, every "x(fp)" is rewritten into "(x + F - d)(sp)", where d is how
+ *  far sp has been moved by the current call sequence. Moreover:
+ *    - ra is saved only if the function calls others, and a callee-saved
+ *      register only if the function uses it;
+ *    - a function that needs no frame (e.g. a leaf function which never
+ *      spills) has neither prologue nor epilogue;
+ *    - otherwise the prologue is shrink-wrapped: it is moved down to a block
+ *      which dominates all the blocks touching the frame, so that the paths
+ *      which don't need the frame (e.g. the base case of a recursion) skip
+ *      it. Only the returns after the prologue restore the registers;
+ *    - a tail call (see asm/riscv_abi.cpp) ends with the epilogue and a
+ *      jump to the callee instead of "ret", and needs no ra of its own.
+ *
+ *  Offsets and immediates beyond 12 bits are computed in t6, which is kept
+ *  out of both register allocators when the frame might be that large.
+ */
+
+#include "asm/riscv_md.hpp"
+#include "3rdparty/vector.hpp"
+#include "config.hpp"
+#include "options.hpp"
+#include "tac/flow_graph.hpp"
+#include "tac/tac.hpp"
+
+using namespace mind::assembly;
+using namespace mind::tac;
+using namespace mind::util;
+using namespace mind;
+
+#define WORD_SIZE 4
+#define MAX_SAVED_REGS 13 // ra, fp and s1-s11
+#define MIN_IMM (-2048)   // the range of a 12-bit immediate
+#define MAX_IMM 2047
+
+// whether an offset (or an immediate) fits in an instruction
+static bool fitsImm(int i) { return i >= MIN_IMM && i <= MAX_IMM; }
+
+// gets the number of successors of a basic block
+static int numSucc(BasicBlock *b) {
+    switch (b->end_kind) {
+    case BasicBlock::BY_JUMP:
+        return 1;
+
+    case BasicBlock::BY_JZERO:
+        return 2;
+
+    default:
+        return 0;
+    }
+}
+
+/* Tests whether the prologue can be placed at the start of a basic block.
+ *
+ * PARAMETERS:
+ *   g     - the control-flow graph
+ *   c     - the candidate block
+ * RETURNS:
+ *   true if c is not inside a loop (so that the prologue is executed at most
+ *   once), and every return reachable from c is dominated by c (so that no
+ *   return may be reached both with and without the frame)
+ */
+static bool canHoldProlog(FlowGraph *g, int c) {
+    Vector<int> seen;
+    Vector<int> stack;
+    BasicBlock *b = g->getBlock(c);
+
+    if (g->getLoopDepth(c) > 0)
+        return false;
+
+    seen.resize(g->size(), 0);
+    seen[c] = 1;
+    for (int s = 0; s < numSucc(b); ++s)
+        stack.push_back(b->next[s]);
+
+    while (!stack.empty()) {
+        int k = stack.back();
+        stack.pop_back();
+        if (seen[k])
+            continue;
+
+        seen[k] = 1;
+        b = g->getBlock(k);
+        if (BasicBlock::BY_RETURN == b->end_kind && !g->dominates(c, k))
+            return false;
+        for (int s = 0; s < numSucc(b); ++s)
+            stack.push_back(b->next[s]);
+    }
+
+    return true;
+}
+
+/* Tests whether an instruction sequence touches the stack-frame.
+ *
+ * PARAMETERS:
+ *   i     - the instruction sequence
+ * RETURNS:
+ *   true if it addresses the frame, uses a callee-saved register, or calls
+ *   a function (which clobbers ra)
+ */
+bool RiscvDesc::usesFrame(RiscvInstr *i) {
+    for (; NULL != i; i = i->next) {
+        if (RiscvInstr::CALL == i->op_code || RiscvInstr::JAL == i->op_code)
+            return true;
+
+        RiscvReg *r[3] = {i->r0, i->r1, i->r2};
+        for (int k = 0; k < 3; ++k)
+            if (NULL != r[k] &&
+                (r[k] == _reg[RiscvReg::FP] || r[k]->callee_saved))
+                return true;
+    }
+
+    return false;
+}
+
+/* Rewrites the frame accesses of an instruction sequence to use sp (-O).
+ *
+ * PARAMETERS:
+ *   i     - the instruction sequence
+ *   size  - the size of the frame allocated when the sequence runs (0 if
+ *           it runs before the prologue)
+ */
+void RiscvDesc::rebaseFrame(RiscvInstr *i, int size) {
+    RiscvReg *fp = _reg[RiscvReg::FP];
+    RiscvReg *sp = _reg[RiscvReg::SP];
+    int depth = 0; // how far the call sequence has moved sp
+
+    for (; NULL != i; i = i->next) {
+        if (RiscvInstr::ADDI == i->op_code && sp == i->r0 && sp == i->r1) {
+            depth -= i->i;
+        } else if (fp == i->r1) {
+            mind_assert(RiscvInstr::LW == i->op_code ||
+                        RiscvInstr::SW == i->op_code);
+            i->r1 = sp;
+            i->i += size + depth;
+        }
+        mind_assert(fp != i->r0 && fp != i->r2);
+    }
+}
+
+/* Decides the registers to save and whether the frame might be large.
+ *
+ * PARAMETERS:
+ *   g     - the control-flow graph
+ * NOTE:
+ *   it should be called before registers are allocated, since t6 is
+ *   reserved for large offsets here. the global register allocator
+ *   appends the callee-saved registers it uses to _saved_regs.
+ */
+void RiscvDesc::prepareFrame(FlowGraph *g) {
+    int num_params = 0; // the parameters are on the stack without -O
+    int max_args = 0;
+    bool has_call = false;
+
+    for (size_t id = 0; id < g->numTemps(); ++id)
+        if (NULL != g->getTemp(id) && g->getTemp(id)->is_offset_fixed)
+            ++num_params;
+    for (FlowGraph::iterator it = g->begin(); it != g->end(); ++it) {
+        int args = 0;
+        for (Tac *t = (*it)->tac_chain; t != NULL; t = t->next) {
+            if (Tac::PARAM == t->op_code) {
+                ++args;
+            } else {
+                // (a tail call leaves ra to the callee, while a runtime
+                // routine needs it)
+                has_call |= (Tac::CALL == t->op_code &&
+                             t != findTailCall(*it)) ||
+                            needsRuntime(t);
+                max_args = (args > max_args ? args : max_args);
+                args = 0;
+            }
+        }
+    }
+
+    // the farthest an offset may go: the whole frame (a slot per variable
+    // at most), the stack arguments above it, and a call sequence (the
+    // arguments and the saved variables) below it
+    int num_temps = g->numTemps();
+    int bound = alignStack(WORD_SIZE * (num_temps + MAX_SAVED_REGS)) +
+                WORD_SIZE * num_params +
+                alignStack(WORD_SIZE * (max_args + num_temps));
+    _big_frame = !fitsImm(bound);
+    _reg[RiscvReg::T6]->general = !_big_frame;
+
+    _saved_regs.clear();
+    if (!Option::doOptimize()) {
+        _saved_regs.push_back(RiscvReg::RA);
+        _saved_regs.push_back(RiscvReg::FP);
+    } else if (has_call) {
+        _saved_regs.push_back(RiscvReg::RA);
+    }
+}
+
+/* Reserves the variables shared between basic blocks in the stack-frame.
+ *
+ * PARAMETERS:
+ *   g     - the control-flow graph (liveness should have been analyzed)
+ * RETURNS:
+ *   how many variables are reserved (i.e. the number of slots needed if
+ *   every variable had a slot of its own)
+ * NOTE:
+ *   two variables may share a slot if they are never alive at the same
+ *   position, so the slots are assigned by greedily coloring the
+ *   interference graph. the variables which already have a slot (see
+ *   prepareEntry) keep it.
+ */
+int RiscvDesc::reserveSlots(FlowGraph *g) {
+    size_t n = g->numTemps();
+    LiveSet in_memory(n); // the variables to reserve
+    Vector<int> reserved; // (the same, as a list)
+    Vector<int> index_of; // the position in "reserved" (-1 if not reserved)
+    Vector<LiveSet *> interfere; // (indexed by the position too)
+
+    for (FlowGraph::iterator it = g->begin(); it != g->end(); ++it) {
+        LiveSet *liveout = (*it)->LiveOut;
+        for (LiveSet::iterator sit = liveout->begin(); sit != liveout->end();
+             ++sit)
+            if (0 == g->getTemp(*sit)->reg)
+                in_memory.add(*sit);
+    }
+    for (size_t id = 0; id < n; ++id) {
+        Temp v = g->getTemp(id);
+        if (NULL != v && v->is_offset_fixed) {
+            in_memory.remove(id);
+            if (v->offset < 0) // (not a parameter passed on the stack)
+                in_memory.add(id);
+        }
+    }
+
+    index_of.resize(n, -1);
+    for (LiveSet::iterator it = in_memory.begin(); it != in_memory.end();
+         ++it) {
+        index_of[*it] = reserved.size();
+        reserved.push_back(*it);
+    }
+    int num_reserved = reserved.size();
+
+    // Step 1. builds the interference graph: two variables alive at the
+    //         same position are both alive right after the later of their
+    //         definitions, unless neither is defined before that position
+    //         (i.e. both are alive on entry)
+    interfere.resize(num_reserved, NULL);
+    for (int k = 0; k < num_reserved; ++k)
+        interfere[k] = new LiveSet(num_reserved);
+
+    Vector<int> on_entry;
+    for (int k = 0; k < num_reserved; ++k)
+        if (g->getBlock(0)->LiveIn->contains(reserved[k]))
+            on_entry.push_back(k);
+    for (size_t j = 0; j < on_entry.size(); ++j)
+        for (size_t k = 0; k < on_entry.size(); ++k)
+            if (j != k)
+                interfere[on_entry[j]]->add(on_entry[k]);
+
+    for (FlowGraph::iterator it = g->begin(); it != g->end(); ++it) {
+        LiveCursor cursor(*it);
+        for (Tac *t = (*it)->tac_chain; t != NULL; t = t->next) {
+            cursor.advance(t);
+            Temp d = t->getDef();
+            if (NULL == d || index_of[d->id] < 0)
+                continue;
+
+            int j = index_of[d->id];
+            for (int k = 0; k < num_reserved; ++k)
+                if (k != j && cursor.live()->contains(reserved[k])) {
+                    interfere[j]->add(k);
+                    interfere[k]->add(j);
+                }
+        }
+    }
+
+    // Step 2. assigns the lowest slot not taken by the neighbours
+    Vector<int> slot_of; // (-1 if not assigned yet)
+    Vector<int> taken;
+
+    slot_of.resize(num_reserved, -1);
+    for (int k = 0; k < num_reserved; ++k)
+        if (g->getTemp(reserved[k])->is_offset_fixed)
+            slot_of[k] = _frame->slotOf(g->getTemp(reserved[k]));
+
+    for (int k = 0; k < num_reserved; ++k) {
+        if (slot_of[k] >= 0)
+            continue;
+
+        taken.clear();
+        taken.resize(num_reserved + 1, 0);
+        for (LiveSet::iterator nit = interfere[k]->begin();
+             nit != interfere[k]->end(); ++nit)
+            if (slot_of[*nit] >= 0)
+                taken[slot_of[*nit]] = 1;
+
+        int slot = 0;
+        while (taken[slot])
+            ++slot;
+        slot_of[k] = slot;
+        _frame->reserve(g->getTemp(reserved[k]), slot);
+    }
+
+    return num_reserved;
+}
+
+/* Builds the prologue and the epilogues of a function.
+ *
+ * PARAMETERS:
+ *   g     - the control-flow graph (with the instr_chain of every block)
+ *   entry - the instructions to execute before the first basic block
+ * RETURNS:
+ *   the leading code of the function (the prologue and "entry", in an
+ *   order depending on where the prologue goes)
+ * NOTE:
+ *   the instr_chain of the blocks are updated, and all the offsets out of
+ *   range are legalized.
+ */
+RiscvInstr *RiscvDesc::layoutFrame(FlowGraph *g, RiscvInstr *entry) {
+    RiscvInstr leading;
+    RiscvReg *sp = _reg[RiscvReg::SP];
+    int num_saved = _saved_regs.size();
+    int size = _frame->getStackFrameSize() + num_saved * WORD_SIZE;
+
+    leading.next = NULL;
+    _tail = &leading;
+    if (!Option::doOptimize()) {
+        // see also the epilogue in prepareSingleChain
+        addInstr(RiscvInstr::SW, _reg[RiscvReg::RA], sp, NULL, -WORD_SIZE,
+                 std::string(), NULL);
+        addInstr(RiscvInstr::SW, _reg[RiscvReg::FP], sp, NULL,
+                 -2 * WORD_SIZE, std::string(), NULL);
+        addInstr(RiscvInstr::MOVE, _reg[RiscvReg::FP], sp, NULL, 0,
+                 std::string(), NULL);
+        addInstr(RiscvInstr::ADDI, sp, sp, NULL, -size, std::string(), NULL);
+        _tail->next = entry;
+        entry = leading.next;
+
+    } else {
+        Vector<int> order;
+        g->getPostorder(order);
+
+        // Step 1. finds where to place the prologue: -1 means "before the
+        //         entry code", and -2 means "nowhere"
+        int prolog_at = -2;
+        size = alignStack(size);
+        if (size > 0 && usesFrame(entry)) {
+            prolog_at = -1;
+        } else if (size > 0) {
+            for (size_t k = 0; k < order.size(); ++k) {
+                BasicBlock *b = g->getBlock(order[k]);
+                if (!usesFrame((RiscvInstr *)b->instr_chain))
+                    continue;
+                prolog_at = (prolog_at < 0)
+                                ? order[k]
+                                : g->commonDominator(prolog_at, order[k]);
+            }
+            while (prolog_at >= 0 && !canHoldProlog(g, prolog_at))
+                prolog_at = (0 == prolog_at) ? -1 : g->getIdom(prolog_at);
+        }
+
+        // Step 2. addresses the frame through sp
+        rebaseFrame(entry, -1 == prolog_at ? size : 0);
+        for (FlowGraph::iterator it = g->begin(); it != g->end(); ++it) {
+            BasicBlock *b = *it;
+            bool framed = (-1 == prolog_at) ||
+                          (prolog_at >= 0 && g->getIdom(b->bb_num) >= 0 &&
+                           g->dominates(prolog_at, b->bb_num));
+            b->mark = framed; // (cleared again before emitTrace)
+            rebaseFrame((RiscvInstr *)b->instr_chain, framed ? size : 0);
+        }
+
+        // Step 3. inserts the prologue
+        if (prolog_at != -2) {
+            addInstr(RiscvInstr::ADDI, sp, sp, NULL, -size, std::string(),
+                     NULL);
+            for (int k = 0; k < num_saved; ++k)
+                addInstr(RiscvInstr::SW, _reg[_saved_regs[k]], sp, NULL,
+                         size - (k + 1) * WORD_SIZE, std::string(), NULL);
+        }
+        if (prolog_at >= 0) {
+            BasicBlock *b = g->getBlock(prolog_at);
+            _tail->next = (RiscvInstr *)b->instr_chain;
+            b->instr_chain = leading.next;
+            leading.next = entry;
+        } else {
+            _tail->next = entry;
+        }
+        entry = leading.next;
+
+        // Step 4. appends the epilogues
+        for (FlowGraph::iterator it = g->begin(); it != g->end(); ++it) {
+            BasicBlock *b = *it;
+            if (BasicBlock::BY_RETURN != b->end_kind)
+                continue;
+
+            leading.next = (RiscvInstr *)b->instr_chain;
+            for (_tail = &leading; NULL != _tail->next; _tail = _tail->next)
+                ;
+            if (b->mark && prolog_at != -2) {
+                for (int k = 0; k < num_saved; ++k)
+                    addInstr(RiscvInstr::LW, _reg[_saved_regs[k]], sp, NULL,
+                             size - (k + 1) * WORD_SIZE, std::string(), NULL);
+                addInstr(RiscvInstr::ADDI, sp, sp, NULL, size, std::string(),
+                         NULL);
+            }
+            Tac *call = findTailCall(b);
+            if (NULL != call)
+                addInstr(RiscvInstr::J, NULL, NULL, NULL, 0,
+                         std::string("_") + call->op1.label->str_form, NULL);
+            else
+                addInstr(RiscvInstr::RET, NULL, NULL, NULL, 0, std::string(),
+                         NULL);
+            b->instr_chain = leading.next;
+            b->mark = 0;
+        }
+    }
+    _tail = NULL;
+
+    for (FlowGraph::iterator it = g->begin(); it != g->end(); ++it) {
+        (*it)->instr_chain = legalizeOffsets((RiscvInstr *)(*it)->instr_chain);
+        (*it)->mark = 0;
+    }
+
+    return legalizeOffsets(entry);
+}
+
+/* Expands the offsets and immediates out of the 12-bit range.
+ *
+ * PARAMETERS:
+ *   i     - the instruction sequence
+ * RETURNS:
+ *   the new instruction sequence
+ * NOTE:
+ *   "lw/sw r, off(base)" becomes "li t6, off; add t6, t6, base; lw/sw r,
+ *   0(t6)", and "addi r, r1, imm" becomes "li t6, imm; add r, r1, t6".
+ */
+RiscvInstr *RiscvDesc::legalizeOffsets(RiscvInstr *i) {
+    RiscvInstr leading;
+    RiscvReg *t6 = _reg[RiscvReg::T6];
+
+    leading.next = i;
+    for (RiscvInstr *prev = &leading; NULL != prev->next; prev = prev->next) {
+        i = prev->next;
+        if (fitsImm(i->i) ||
+            (RiscvInstr::LW != i->op_code && RiscvInstr::SW != i->op_code &&
+             RiscvInstr::ADDI != i->op_code))
+            continue;
+
+        mind_assert(_big_frame); // t6 should have been reserved
+        _tail = prev;
+        addInstr(RiscvInstr::LI, t6, NULL, NULL, i->i, std::string(), NULL);
+        if (RiscvInstr::ADDI == i->op_code) {
+            i->op_code = RiscvInstr::ADD;
+            i->r2 = t6;
+        } else {
+            addInstr(RiscvInstr::ADD, t6, t6, i->r1, 0, std::string(), NULL);
+            i->r1 = t6;
+        }
+        i->i = 0;
+        _tail->next = i;
+        prev = _tail;
+    }
+    _tail = NULL;
+
+    return leading.next;
+}
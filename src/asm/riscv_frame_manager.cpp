@@ -63,6 +63,42 @@ void RiscvStackFrameManager::reserve(Temp v) {
     UPDATE_MAX();
 }
 
+/* Reserves a temporary variable in a given slot of the reserved area.
+ *
+ * PARAMETERS:
+ *   v        - the temporary variable to reserve
+ *   slot_num - an existing slot of the reserved area, or the next one
+ * NOTE:
+ *   the caller should make sure that the variables sharing a slot are
+ *   never alive at the same time (see RiscvDesc::reserveSlots).
+ */
+void RiscvStackFrameManager::reserve(Temp v, int slot_num) {
+    mind_assert(!v->is_offset_fixed && size == reserved_size &&
+                slot_num <= reserved_size);
+
+    if (slot_num == reserved_size) {
+        ensureCapacity();
+        size = reserved_size = reserved_size + 1;
+        UPDATE_MAX();
+    }
+    v->offset = offsetOf(slot_num);
+    v->is_offset_fixed = true;
+    slots[slot_num] = v;
+}
+
+/* Gets the slot number of a reserved variable.
+ *
+ * PARAMETERS:
+ *   v     - the reserved variable
+ * RETURNS:
+ *   the slot number
+ */
+int RiscvStackFrameManager::slotOf(Temp v) {
+    mind_assert(v->is_offset_fixed);
+
+    return (start_offset - v->offset) / WORD_SIZE;
+}
+
 /* Finds a slot with the given variable as its content.
  *
  * PARAMETERS:
@@ -91,7 +127,7 @@ int RiscvStackFrameManager::findSlotOf(Temp v) {
  *   a slot number representing the slot into which
  *   the variable can be safely saved.
  */
-int RiscvStackFrameManager::getSlotToWrite(Temp v, Set<Temp> *liveness) {
+int RiscvStackFrameManager::getSlotToWrite(Temp v, BitSet *liveness) {
     mind_assert(NULL != v && NULL != liveness && !v->is_offset_fixed);
 
     int i = findSlotOf(v);
@@ -104,7 +140,7 @@ int RiscvStackFrameManager::getSlotToWrite(Temp v, Set<Temp> *liveness) {
 
     // now we should look for an available slot
     for (i = reserved_size; i < size; ++i) {
-        if (!liveness->contains(slots[i])) {
+        if (!liveness->contains(slots[i]->id)) {
             // ok, let's drive it out
             slots[i]->is_offset_fixed = false;
             v->offset = offsetOf(i);
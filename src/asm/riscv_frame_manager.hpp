@@ -7,6 +7,7 @@
 #ifndef __MIND_RISCVFM__
 #define __MIND_RISCVFM__
 
+#include "3rdparty/bitset.hpp"
 #include "3rdparty/set.hpp"
 #include "define.hpp"
 
@@ -29,8 +30,12 @@ class RiscvStackFrameManager {
     void reset(void);
     // reserves a variable in the local variable area
     void reserve(tac::Temp v);
+    // reserves a variable in a given slot (possibly shared with others)
+    void reserve(tac::Temp v, int slot_num);
+    // gets the slot number of a reserved variable
+    int slotOf(tac::Temp v);
     // gets a slot to spill some register (i.e. to save some temporary variable)
-    int getSlotToWrite(tac::Temp v, util::Set<tac::Temp> *liveness);
+    int getSlotToWrite(tac::Temp v, util::BitSet *liveness);
     // gets the size of the stack frame
     int getStackFrameSize(void);
 
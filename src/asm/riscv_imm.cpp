@@ -0,0 +1,724 @@
+/*****************************************************
+ *  Immediate Operands of RiscvDesc.
+ *
+ *  Every integer constant is loaded into a fresh temporary variable by a
+ *  LOAD_IMM4 TAC, which is used once or twice in the same basic block.
+ *  Such variables are marked as constants (see findConstants), and then
+ *  1. an operation with a small constant operand is translated into the
+ *     I-type form (addi, slti, andi, ori, xori), see emitImmediateTac;
+ *  2. a constant 0 is read from x0 (see getRegForRead);
+ *  3. the LOAD_IMM4 itself is dropped, and the constant is loaded ("li")
+ *     only where it is still needed in a register (see getRegForRead);
+ *  4. a multiplication by a constant of the form +-2^k, 2^a + 2^b or
+ *     2^a - 2^b becomes shifts and an addition (or a subtraction), or
+ *     "shNadd" with Zba, and a division or a modulo by a constant becomes
+ *     shifts for the powers of 2, or a multiplication by the "magic number"
+ *     of the divisor otherwise (see emitMulDivImmTac). without M, every
+ *     other multiplication by a constant is a chain of shifts and additions
+ *     (see emitShiftAddMul), and so is the multiplication by the magic
+ *     number, instead of a call of the runtime routines.
+ */
+
+#include "asm/riscv_md.hpp"
+#include "3rdparty/vector.hpp"
+#include "config.hpp"
+#include "options.hpp"
+#include "tac/flow_graph.hpp"
+#include "tac/tac.hpp"
+
+using namespace mind::assembly;
+using namespace mind::tac;
+using namespace mind::util;
+using namespace mind;
+
+#define MIN_IMM (-2048) // the range of a 12-bit immediate
+#define MAX_IMM 2047
+#define WORD_BITS 32
+
+// whether a variable is a constant "c" such that "c + bias" fits in an
+// I-type instruction
+static bool isImm(Temp v, int bias) {
+    long long i = (long long)v->value + bias;
+    return v->is_const && i >= MIN_IMM && i <= MAX_IMM;
+}
+
+/* Marks the temporary variables which hold a constant.
+ *
+ * PARAMETERS:
+ *   g     - the control-flow graph (liveness should have been analyzed)
+ * NOTE:
+ *   a variable is a constant if its only definition is a LOAD_IMM4 and it
+ *   is never alive at the boundary of a basic block. since it is not alive
+ *   at the entry of the function either, every use of it is reached by
+ *   that very definition.
+ */
+void RiscvDesc::findConstants(FlowGraph *g) {
+    int n = (int)g->numTemps();
+    Vector<int> defs; // how many times every variable is defined (or -1 if
+                      // it is alive at some block boundary)
+
+    defs.resize(n, 0);
+    for (FlowGraph::iterator it = g->begin(); it != g->end(); ++it) {
+        BasicBlock *b = *it;
+        for (Tac *t = b->tac_chain; t != NULL; t = t->next) {
+            if (Tac::PUSH == t->op_code || Tac::PARAM == t->op_code ||
+                NULL == t->op0.var)
+                continue;
+
+            Temp v = t->op0.var;
+            ++defs[v->id];
+            v->is_const = (Tac::LOAD_IMM4 == t->op_code);
+            v->value = t->op1.ival;
+        }
+    }
+
+    for (FlowGraph::iterator it = g->begin(); it != g->end(); ++it) {
+        LiveSet *live = (*it)->LiveOut;
+        for (LiveSet::iterator sit = live->begin(); sit != live->end(); ++sit)
+            defs[*sit] = -1;
+    }
+    LiveSet *live_in = g->getBlock(0)->LiveIn;
+    for (LiveSet::iterator sit = live_in->begin(); sit != live_in->end(); ++sit)
+        defs[*sit] = -1;
+
+    for (int k = 0; k < n; ++k) {
+        Temp v = g->getTemp(k);
+        if (NULL != v && 1 != defs[k])
+            v->is_const = false;
+    }
+}
+
+// gets k if u is 2^k (or -1 if u is not a power of 2)
+static int log2Of(unsigned u) {
+    if (0 == u || 0 != (u & (u - 1)))
+        return -1;
+
+    int k = 0;
+    while (u > 1) {
+        u >>= 1;
+        ++k;
+    }
+    return k;
+}
+
+/* Factors a multiplier for the shift-and-add instructions of Zba.
+ *
+ * PARAMETERS:
+ *   u     - the multiplier (odd)
+ *   n1    - (output) the first shift (0 if there is no such factoring)
+ *   n2    - (output) the second shift (0 if one instruction is enough)
+ * NOTE:
+ *   u = (2^n1 + 1) * (2^n2 + 1), where n1 and n2 are 1, 2 or 3, i.e.
+ *   x * u is "shN1add x, x" (and then "shN2add" of the result by itself).
+ */
+static void factorShAdd(unsigned u, int &n1, int &n2) {
+    n1 = n2 = 0;
+    for (int i = 1; i <= 3; ++i) {
+        unsigned f = (1u << i) + 1;
+        if (0 != u % f)
+            continue;
+        if (1 == u / f) {
+            n1 = i;
+            return;
+        }
+        for (int j = 1; j <= 3; ++j)
+            if (u / f == (1u << j) + 1) {
+                n1 = i;
+                n2 = j;
+                return;
+            }
+    }
+}
+
+// gets the shift-and-add instruction of a shift (1, 2 or 3)
+static RiscvInstr::OpCode shAdd(int n) {
+    return (RiscvInstr::OpCode)(RiscvInstr::SH1ADD + n - 1);
+}
+
+/* Finds the magic number of a signed division by a constant.
+ *
+ * PARAMETERS:
+ *   d     - the divisor (neither 0, 1, -1 nor a power of 2 in magnitude)
+ *   magic - (output) the magic number M
+ *   shift - (output) the shift s
+ * NOTE:
+ *   n / d is the high word of M * n (plus n if d > 0 and M < 0, or minus
+ *   n if d < 0 and M > 0) shifted right arithmetically by s, plus 1 if it
+ *   is negative. see "Hacker's Delight" (10-4) for the proof.
+ */
+static void findMagic(int d, int &magic, int &shift) {
+    const unsigned two31 = 0x80000000u;
+    unsigned ad = (d < 0) ? 0u - (unsigned)d : (unsigned)d;
+    unsigned t = two31 + ((unsigned)d >> 31);
+    unsigned anc = t - 1 - t % ad; // the absolute value of nc
+    unsigned q1 = two31 / anc, r1 = two31 - q1 * anc; // 2^p / |nc|
+    unsigned q2 = two31 / ad, r2 = two31 - q2 * ad;   // 2^p / |d|
+    unsigned delta;
+    int p = WORD_BITS - 1;
+
+    do {
+        ++p;
+        q1 <<= 1;
+        r1 <<= 1;
+        if (r1 >= anc) {
+            ++q1;
+            r1 -= anc;
+        }
+        q2 <<= 1;
+        r2 <<= 1;
+        if (r2 >= ad) {
+            ++q2;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && 0 == r1));
+
+    magic = (int)(q2 + 1);
+    if (d < 0)
+        magic = -magic;
+    shift = p - WORD_BITS;
+}
+
+/* Finds the magic number of a division of a magnitude by a constant.
+ *
+ * PARAMETERS:
+ *   d     - the divisor (neither 0, 1 nor a power of 2)
+ *   magic - (output) the magic number m (below 2^32)
+ *   shift - (output) the shift s
+ * NOTE:
+ *   n / d (rounded down) is (n * m) >> (32 + s) for every 0 <= n <= 2^31,
+ *   the magnitudes of the dividends. with e = m * d - 2^(32 + s), it holds
+ *   as long as n * e < 2^(32 + s), i.e. e < 2^(s + 1). among the shifts
+ *   which work, the one whose m has the fewest 1 bits is taken, since every
+ *   1 bit costs an addition and a shift (see emitMulDivImmTac).
+ */
+static void findMagicU(unsigned d, unsigned &magic, int &shift) {
+    int best = WORD_BITS + 1;
+
+    for (int s = 0; s < WORD_BITS; ++s) {
+        unsigned long long p = 1ull << (WORD_BITS + s);
+        unsigned long long m = (p + d - 1) / d;
+        if (0 != (m >> WORD_BITS))
+            break; // (and so are the larger shifts)
+        if (m * d - p >= (1ull << (s + 1)))
+            continue;
+
+        int n = 0;
+        for (unsigned long long v = m; 0 != v; v &= v - 1)
+            ++n;
+        if (n < best) {
+            best = n;
+            magic = (unsigned)m;
+            shift = s;
+        }
+    }
+    mind_assert(best <= WORD_BITS); // (s = ceil(log2(d)) - 1 always works)
+}
+
+/* Writes a multiplier in the canonical signed-digit form.
+ *
+ * PARAMETERS:
+ *   c      - the multiplier (not 0)
+ *   digits - (output) the nonzero digits, from the highest one: p + 1 for
+ *            a digit 1 at 2^p, and -(p + 1) for a digit -1
+ * NOTE:
+ *   no two digits are adjacent, so there are no more digits than 1 bits in
+ *   |c| (e.g. 7 = 2^3 - 2^0). a negative c has the digits of |c| negated.
+ */
+static void findSignedDigits(int c, Vector<int> &digits) {
+    unsigned long long u = (c < 0) ? 0ull - (long long)c : (long long)c;
+    Vector<int> low; // (from the lowest digit)
+
+    for (int p = 0; 0 != u; ++p, u >>= 1) {
+        if (0 == (u & 1))
+            continue;
+        int d = (1 == (u & 3)) ? 1 : -1; // (so that the next bit is 0)
+        u -= d;
+        low.push_back((d > 0) == (c > 0) ? p + 1 : -(p + 1));
+    }
+    digits.clear();
+    for (size_t k = low.size(); k > 0; --k)
+        digits.push_back(low[k - 1]);
+}
+
+// picks the constant operand of a commutative operation (false if none)
+static bool pickImm(Tac *t, Temp &x, int &c) {
+    if (isImm(t->op2.var, 0)) {
+        x = t->op1.var;
+        c = t->op2.var->value;
+    } else if (isImm(t->op1.var, 0)) {
+        x = t->op2.var;
+        c = t->op1.var->value;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+/* Translates a TAC with a constant operand into an I-type instruction.
+ *
+ * PARAMETERS:
+ *   t     - the TAC
+ * RETURNS:
+ *   true if t has been translated (false if it needs the general form)
+ * NOTE:
+ *   the comparisons are rewritten into "x < c" (and its negation):
+ *     x < c   =>  x < c               c < x   =>  !(x < c + 1)
+ *     x <= c  =>  x < c + 1           c <= x  =>  !(x < c)
+ *     x > c   =>  !(x < c + 1)        c > x   =>  x < c
+ *     x >= c  =>  !(x < c)            c >= x  =>  x < c + 1
+ *   and x == c (x != c) is tested as (x ^ c) == 0 (!= 0).
+ */
+bool RiscvDesc::emitImmediateTac(Tac *t) {
+    RiscvInstr::OpCode op;
+    bool negate = false; // whether the result of SLTI is negated
+    Temp x = NULL;       // the variable operand
+    int c = 0;           // the immediate operand
+    Temp a = t->op1.var, b = t->op2.var;
+
+    switch (t->op_code) {
+    case Tac::ASSIGN:
+        if (!a->is_const)
+            return false;
+        op = RiscvInstr::LI;
+        c = a->value;
+        break;
+
+    case Tac::ADD:
+        if (!pickImm(t, x, c))
+            return false;
+        op = RiscvInstr::ADDI;
+        break;
+
+    case Tac::SUB:
+        if (!isImm(b, 0) || MIN_IMM == b->value)
+            return false;
+        op = RiscvInstr::ADDI;
+        x = a;
+        c = -b->value;
+        break;
+
+    case Tac::LAND:
+        if (!pickImm(t, x, c))
+            return false;
+        op = RiscvInstr::ANDI;
+        break;
+
+    case Tac::LOR:
+        if (!pickImm(t, x, c))
+            return false;
+        op = RiscvInstr::ORI;
+        break;
+
+    case Tac::EQU:
+    case Tac::NEQ:
+        if (!pickImm(t, x, c))
+            return false;
+        op = RiscvInstr::XORI;
+        break;
+
+    case Tac::MUL:
+    case Tac::DIV:
+    case Tac::MOD:
+        return emitMulDivImmTac(t);
+
+    case Tac::LES:
+    case Tac::LEQ:
+    case Tac::GTR:
+    case Tac::GEQ: {
+        // whether it is "x < ..." or "x <= ..." with x on the left
+        bool less = (Tac::LES == t->op_code || Tac::LEQ == t->op_code);
+        bool strict = (Tac::LES == t->op_code || Tac::GTR == t->op_code);
+        int bias = strict ? 0 : 1;
+        if (isImm(b, less ? bias : 1 - bias)) {
+            x = a;
+            c = b->value + (less ? bias : 1 - bias);
+            negate = !less;
+        } else if (isImm(a, less ? 1 - bias : bias)) {
+            x = b;
+            c = a->value + (less ? 1 - bias : bias);
+            negate = less;
+        } else {
+            return false;
+        }
+        op = RiscvInstr::SLTI;
+        break;
+    }
+
+    default:
+        return false;
+    }
+
+    // eliminates useless assignments
+    if (!_live->contains(t->op0.var->id))
+        return true;
+
+    if (NULL == x) {
+        int r0 = getRegForWrite(t->op0.var, 0, 0, _live);
+        addInstr(RiscvInstr::LI, _reg[r0], NULL, NULL, c, std::string(), NULL);
+        return true;
+    }
+
+    int r1 = getRegForRead(x, 0, _live);
+    int r0 = getRegForWrite(t->op0.var, r1, 0, _live);
+    if (RiscvInstr::XORI == op) {
+        RiscvInstr::OpCode set = (Tac::EQU == t->op_code) ? RiscvInstr::SEQZ
+                                                          : RiscvInstr::SNEZ;
+        if (0 == c) { // x == 0 or x != 0
+            addInstr(set, _reg[r0], _reg[r1], NULL, 0, std::string(), NULL);
+        } else {
+            addInstr(op, _reg[r0], _reg[r1], NULL, c, std::string(), NULL);
+            addInstr(set, _reg[r0], _reg[r0], NULL, 0, std::string(), NULL);
+        }
+    } else {
+        addInstr(op, _reg[r0], _reg[r1], NULL, c, std::string(), NULL);
+        if (negate)
+            addInstr(RiscvInstr::SEQZ, _reg[r0], _reg[r0], NULL, 0,
+                     std::string(), NULL);
+    }
+
+    return true;
+}
+
+/* Multiplies a register by a constant with shifts and additions.
+ *
+ * PARAMETERS:
+ *   r0    - the register of the product
+ *   r1    - the register multiplied
+ *   s     - a scratch register (different from r1, but maybe r0)
+ *   c     - the multiplier (not 0)
+ * NOTE:
+ *   by Horner's rule on the canonical signed digits of c (see
+ *   findSignedDigits): a digit at 2^p after one at 2^q costs
+ *   "s = (s << (q - p)) +- x", and the last digit a final shift. s holds
+ *   the negation of the product so far while all the digits so far are -1,
+ *   so that no "neg" is needed unless all of them are. r0 is written by
+ *   the last instruction only, since it may be s.
+ */
+void RiscvDesc::emitShiftAddMul(int r0, int r1, int s, int c) {
+    struct Step {
+        RiscvInstr::OpCode op;
+        int rs1, rs2, imm;
+    };
+    Vector<int> digits;
+    Vector<Step> steps;
+    Step st;
+
+    findSignedDigits(c, digits);
+    bool negated = (digits[0] < 0); // (s holds -(the product so far))
+    int p = (negated ? -digits[0] : digits[0]) - 1;
+    int from = r1;
+    for (size_t k = 1; k < digits.size(); ++k) {
+        bool plus = (digits[k] > 0);
+        int q = (plus ? digits[k] : -digits[k]) - 1;
+        st.op = RiscvInstr::SLLI;
+        st.rs1 = from;
+        st.rs2 = 0;
+        st.imm = p - q;
+        steps.push_back(st);
+        // s = s +- x, or x - s (s = -y, and y + x = x - s)
+        st.op = (plus != negated) ? RiscvInstr::ADD : RiscvInstr::SUB;
+        st.rs1 = (plus && negated) ? r1 : s;
+        st.rs2 = (plus && negated) ? s : r1;
+        st.imm = 0;
+        steps.push_back(st);
+        negated = negated && !plus;
+        from = s;
+        p = q;
+    }
+    st.rs2 = st.imm = 0;
+    if (p > 0) {
+        st.op = RiscvInstr::SLLI;
+        st.rs1 = from;
+        st.imm = p;
+        steps.push_back(st);
+        from = s;
+    }
+    if (negated || steps.empty()) {
+        st.op = negated ? RiscvInstr::NEG : RiscvInstr::MOVE;
+        st.rs1 = from;
+        st.imm = 0;
+        steps.push_back(st);
+    }
+
+    for (size_t k = 0; k < steps.size(); ++k) {
+        int rd = (k + 1 == steps.size()) ? r0 : s;
+        addInstr(steps[k].op, _reg[rd], _reg[steps[k].rs1],
+                 (0 == steps[k].rs2) ? NULL : _reg[steps[k].rs2], steps[k].imm,
+                 std::string(), NULL);
+    }
+}
+
+/* Translates a multiplication, a division or a modulo by a constant.
+ *
+ * PARAMETERS:
+ *   t     - the MUL, DIV or MOD TAC
+ * RETURNS:
+ *   true if t has been translated (false if it needs "mul", "div" or "rem")
+ * NOTE:
+ *   for x * c, with u = |c|:
+ *     u = 2^k          =>  x << k                 (negated if c < 0)
+ *     u = 2^a + 2^b    =>  ((x << (a - b)) + x) << b   (if c > 0)
+ *     u = 2^a - 2^b    =>  ((x << (a - b)) - x) << b   (x - ... if c < 0)
+ *   and with Zba, for c > 0:
+ *     u = (2^n1 + 1)(2^n2 + 1) 2^b  =>  shN2add(shN1add(x, x), ...) << b
+ *   for x / d (rounded toward 0), with |d| = 2^k, the negative dividends
+ *   are biased by 2^k - 1 first:
+ *     y = x + ((x >> 31) >>> (32 - k))
+ *     x / d = y >> k (negated if d < 0),  x % d = x - (y & -2^k)
+ *   otherwise q = x / d comes from the magic number (see findMagic), and
+ *   x % d = x - q * d. without M, any other x * c is a chain of shifts and
+ *   additions (see emitShiftAddMul), and so is the magic number: with
+ *   t = x >> 31, |x| = (x ^ t) - t, and
+ *     q = (((|x| * m) >> (32 + s)) ^ t) - t   (negated if d < 0)
+ *   where (|x| * m) >> 32 is found by Horner's rule from the lowest bit of
+ *   m (see findMagicU), "y = (y + |x|) >> n" for every 1 bit: y < |x|
+ *   <= 2^31 keeps the sums within 32 bits, and the shifts lose nothing,
+ *   since (y >> a) >> b = y >> (a + b) even when the bits shifted out are
+ *   dropped at every step. the result is written by the last instruction
+ *   only, since it may share the register of x.
+ */
+bool RiscvDesc::emitMulDivImmTac(Tac *t) {
+    Temp x = t->op1.var;
+    int c;
+
+    if (t->op2.var->is_const) {
+        c = t->op2.var->value;
+    } else if (Tac::MUL == t->op_code && x->is_const) {
+        c = x->value;
+        x = t->op2.var;
+    } else {
+        return false;
+    }
+
+    unsigned u = (c < 0) ? 0u - (unsigned)c : (unsigned)c;
+    int k = log2Of(u);
+    int a = 0, b = 0; // (for a multiplication not by a power of 2)
+    int n1 = 0, n2 = 0; // (the same, with Zba)
+    bool plus = false;
+    bool chain = false; // (the same, by more shifts and additions)
+
+    if (0 == c && Tac::MUL != t->op_code)
+        return false; // (the division traps, or not, at run time)
+    if (Tac::MUL == t->op_code && 0 != c && k < 0) {
+        b = log2Of(u & (0u - u)); // the lowest bit
+        if (c > 0 && 0 != (_isa & Option::EXT_ZBA))
+            factorShAdd(u >> b, n1, n2);
+        plus = (log2Of(u - (1u << b)) >= 0);
+        if (0 == n1) {
+            if (plus)
+                a = log2Of(u - (1u << b));
+            else if (log2Of(u + (1u << b)) >= 0)
+                a = log2Of(u + (1u << b));
+            else
+                chain = true;
+            chain |= (plus && c < 0); // (neither is the negation)
+            if (chain && 0 != (_isa & Option::EXT_M))
+                return false; // (mul is shorter)
+        }
+    }
+
+    // eliminates useless computations
+    if (!_live->contains(t->op0.var->id))
+        return true;
+
+    RiscvReg *zero = _reg[RiscvReg::ZERO];
+    int r1 = getRegForRead(x, 0, _live);
+    int s1 = 0, s2 = 0;
+    int r0;
+
+    // Case 1. a multiplication
+    if (Tac::MUL == t->op_code) {
+        if (0 == c) {
+            r0 = getRegForWrite(t->op0.var, r1, 0, _live);
+            addInstr(RiscvInstr::LI, _reg[r0], NULL, NULL, 0, std::string(),
+                     NULL);
+        } else if (k >= 0) {
+            r0 = getRegForWrite(t->op0.var, r1, 0, _live);
+            if (0 == k)
+                addInstr((c > 0) ? RiscvInstr::MOVE : RiscvInstr::NEG,
+                         _reg[r0], _reg[r1], NULL, 0, std::string(), NULL);
+            else
+                addInstr(RiscvInstr::SLLI, _reg[r0], _reg[r1], NULL, k,
+                         std::string(), NULL);
+            if (c < 0 && 0 != k)
+                addInstr(RiscvInstr::NEG, _reg[r0], _reg[r0], NULL, 0,
+                         std::string(), NULL);
+        } else if (0 != n1) {
+            s1 = getScratchReg(r1, 0, _live);
+            r0 = getRegForWrite(t->op0.var, r1, s1, _live);
+            int s = (0 == n2 && 0 == b) ? r0 : s1;
+            addInstr(shAdd(n1), _reg[s], _reg[r1], _reg[r1], 0, std::string(),
+                     NULL);
+            if (0 != n2)
+                addInstr(shAdd(n2), _reg[(0 == b) ? r0 : s1], _reg[s1],
+                         _reg[s1], 0, std::string(), NULL);
+            if (0 != b)
+                addInstr(RiscvInstr::SLLI, _reg[r0], _reg[s1], NULL, b,
+                         std::string(), NULL);
+        } else if (chain) {
+            s1 = getScratchReg(r1, 0, _live);
+            r0 = getRegForWrite(t->op0.var, r1, s1, _live);
+            emitShiftAddMul(r0, r1, s1, c);
+        } else {
+            s1 = getScratchReg(r1, 0, _live);
+            r0 = getRegForWrite(t->op0.var, r1, s1, _live);
+            addInstr(RiscvInstr::SLLI, _reg[s1], _reg[r1], NULL, a - b,
+                     std::string(), NULL);
+            int s = (0 == b) ? r0 : s1;
+            if (plus)
+                addInstr(RiscvInstr::ADD, _reg[s], _reg[s1], _reg[r1], 0,
+                         std::string(), NULL);
+            else if (c > 0)
+                addInstr(RiscvInstr::SUB, _reg[s], _reg[s1], _reg[r1], 0,
+                         std::string(), NULL);
+            else
+                addInstr(RiscvInstr::SUB, _reg[s], _reg[r1], _reg[s1], 0,
+                         std::string(), NULL);
+            if (0 != b)
+                addInstr(RiscvInstr::SLLI, _reg[r0], _reg[s1], NULL, b,
+                         std::string(), NULL);
+        }
+        return true;
+    }
+
+    // Case 2. a division (or a modulo) by 1 or -1
+    if (1 == u) {
+        r0 = getRegForWrite(t->op0.var, r1, 0, _live);
+        if (Tac::MOD == t->op_code)
+            addInstr(RiscvInstr::MOVE, _reg[r0], zero, NULL, 0, std::string(),
+                     NULL);
+        else
+            addInstr((c > 0) ? RiscvInstr::MOVE : RiscvInstr::NEG, _reg[r0],
+                     _reg[r1], NULL, 0, std::string(), NULL);
+        return true;
+    }
+
+    // Case 3. a division (or a modulo) by a power of 2
+    if (k > 0) {
+        s1 = getScratchReg(r1, 0, _live);
+        r0 = getRegForWrite(t->op0.var, r1, s1, _live);
+        if (1 == k) {
+            addInstr(RiscvInstr::SRLI, _reg[s1], _reg[r1], NULL, WORD_BITS - 1,
+                     std::string(), NULL);
+        } else {
+            addInstr(RiscvInstr::SRAI, _reg[s1], _reg[r1], NULL, WORD_BITS - 1,
+                     std::string(), NULL);
+            addInstr(RiscvInstr::SRLI, _reg[s1], _reg[s1], NULL, WORD_BITS - k,
+                     std::string(), NULL);
+        }
+        addInstr(RiscvInstr::ADD, _reg[s1], _reg[s1], _reg[r1], 0,
+                 std::string(), NULL);
+
+        if (Tac::DIV == t->op_code) {
+            addInstr(RiscvInstr::SRAI, _reg[r0], _reg[s1], NULL, k,
+                     std::string(), NULL);
+            if (c < 0)
+                addInstr(RiscvInstr::NEG, _reg[r0], _reg[r0], NULL, 0,
+                         std::string(), NULL);
+            return true;
+        }
+
+        if (k < WORD_BITS - 1 && -(1 << k) >= MIN_IMM) {
+            addInstr(RiscvInstr::ANDI, _reg[s1], _reg[s1], NULL, -(1 << k),
+                     std::string(), NULL);
+        } else {
+            addInstr(RiscvInstr::SRAI, _reg[s1], _reg[s1], NULL, k,
+                     std::string(), NULL);
+            addInstr(RiscvInstr::SLLI, _reg[s1], _reg[s1], NULL, k,
+                     std::string(), NULL);
+        }
+        addInstr(RiscvInstr::SUB, _reg[r0], _reg[r1], _reg[s1], 0,
+                 std::string(), NULL);
+        return true;
+    }
+
+    // Case 4. a division (or a modulo) by the magic number, without M
+    if (0 == (_isa & Option::EXT_M)) {
+        unsigned m;
+        int shift;
+        findMagicU(u, m, shift);
+        s1 = getScratchReg(r1, 0, _live);
+        s2 = getScratchReg(r1, s1, _live);
+        r0 = getRegForWrite(t->op0.var, r1, s1, _live);
+
+        addInstr(RiscvInstr::SRAI, _reg[s1], _reg[r1], NULL, WORD_BITS - 1,
+                 std::string(), NULL);
+        addInstr(RiscvInstr::XOR, _reg[s2], _reg[r1], _reg[s1], 0,
+                 std::string(), NULL);
+        addInstr(RiscvInstr::SUB, _reg[s2], _reg[s2], _reg[s1], 0,
+                 std::string(), NULL); // s2 = |x|
+        int last = log2Of(m & (0u - m)); // (|x| added at the lowest bit)
+        int from = s2;
+        for (int i = last + 1; i < WORD_BITS; ++i) {
+            if (0 == (m & (1u << i)))
+                continue;
+            addInstr(RiscvInstr::SRLI, _reg[s1], _reg[from], NULL, i - last,
+                     std::string(), NULL);
+            addInstr(RiscvInstr::ADD, _reg[s1], _reg[s1], _reg[s2], 0,
+                     std::string(), NULL);
+            from = s1;
+            last = i;
+        }
+        addInstr(RiscvInstr::SRLI, _reg[s1], _reg[from], NULL,
+                 WORD_BITS - last + shift, std::string(), NULL);
+        addInstr(RiscvInstr::SRAI, _reg[s2], _reg[r1], NULL, WORD_BITS - 1,
+                 std::string(), NULL);
+        addInstr(RiscvInstr::XOR, _reg[s1], _reg[s1], _reg[s2], 0,
+                 std::string(), NULL);
+
+        if (Tac::DIV == t->op_code) {
+            if (c > 0)
+                addInstr(RiscvInstr::SUB, _reg[r0], _reg[s1], _reg[s2], 0,
+                         std::string(), NULL);
+            else
+                addInstr(RiscvInstr::SUB, _reg[r0], _reg[s2], _reg[s1], 0,
+                         std::string(), NULL);
+            return true;
+        }
+        // (x % d = x % |d|)
+        addInstr(RiscvInstr::SUB, _reg[s1], _reg[s1], _reg[s2], 0,
+                 std::string(), NULL);
+        emitShiftAddMul(s2, s1, s2, (int)u);
+        addInstr(RiscvInstr::SUB, _reg[r0], _reg[r1], _reg[s2], 0,
+                 std::string(), NULL);
+        return true;
+    }
+
+    // Case 5. a division (or a modulo) by the magic number
+    int magic, shift;
+    findMagic(c, magic, shift);
+    s1 = getScratchReg(r1, 0, _live);
+    s2 = getScratchReg(r1, s1, _live);
+    r0 = getRegForWrite(t->op0.var, r1, s1, _live);
+
+    addInstr(RiscvInstr::LI, _reg[s1], NULL, NULL, magic, std::string(), NULL);
+    addInstr(RiscvInstr::MULH, _reg[s1], _reg[r1], _reg[s1], 0, std::string(),
+             NULL);
+    if (c > 0 && magic < 0)
+        addInstr(RiscvInstr::ADD, _reg[s1], _reg[s1], _reg[r1], 0,
+                 std::string(), NULL);
+    else if (c < 0 && magic > 0)
+        addInstr(RiscvInstr::SUB, _reg[s1], _reg[s1], _reg[r1], 0,
+                 std::string(), NULL);
+    if (shift > 0)
+        addInstr(RiscvInstr::SRAI, _reg[s1], _reg[s1], NULL, shift,
+                 std::string(), NULL);
+    addInstr(RiscvInstr::SRLI, _reg[s2], _reg[s1], NULL, WORD_BITS - 1,
+             std::string(), NULL);
+
+    if (Tac::DIV == t->op_code) {
+        addInstr(RiscvInstr::ADD, _reg[r0], _reg[s1], _reg[s2], 0,
+                 std::string(), NULL);
+        return true;
+    }
+    addInstr(RiscvInstr::ADD, _reg[s1], _reg[s1], _reg[s2], 0, std::string(),
+             NULL);
+    addInstr(RiscvInstr::LI, _reg[s2], NULL, NULL, c, std::string(), NULL);
+    addInstr(RiscvInstr::MUL, _reg[s1], _reg[s1], _reg[s2], 0, std::string(),
+             NULL);
+    addInstr(RiscvInstr::SUB, _reg[r0], _reg[r1], _reg[s1], 0, std::string(),
+             NULL);
+    return true;
+}
@@ -0,0 +1,260 @@
+/*****************************************************
+ *  Basic Block Layout of RiscvDesc.
+ *
+ *  The blocks are ordered so that as many control-flow edges as possible
+ *  become fall-throughs, and then the jumps to the next block are dropped
+ *  (or a conditional branch is inverted, so that its target falls through).
+ *
+ *  Without -O, the blocks are laid out in traces, following the "then" (or
+ *  the only) successor of every block, as the original recursive emitter
+ *  did. With -O, the layout is loop-aware: the edges are merged into chains
+ *  greedily, the edges of the innermost loops first and the back edges
+ *  before the others, so that a loop ends with its test and the back edge
+ *  is the branch taken (see also "Profile Guided Code Positioning", Pettis
+ *  and Hansen, with the loop depth of tac/loops.cpp as the estimated
+ *  frequency).
+ *
+ *  Both algorithms are iterative, so that very large functions don't
+ *  overflow the stack of the compiler.
+ */
+
+#include "asm/riscv_md.hpp"
+#include "3rdparty/vector.hpp"
+#include "config.hpp"
+#include "options.hpp"
+#include "tac/flow_graph.hpp"
+#include "tac/tac.hpp"
+
+#include <algorithm>
+
+using namespace mind::assembly;
+using namespace mind::tac;
+using namespace mind::util;
+using namespace mind;
+
+namespace {
+// a control-flow edge (a candidate fall-through)
+struct LayoutEdge {
+    int from;  // the source block
+    int to;    // the target block
+    int depth; // the loop depth of the edge
+    bool back; // whether it is a back edge
+    int order; // the position of the edge (for a deterministic result)
+};
+
+// the edges to merge first
+bool edge_before(const LayoutEdge &a, const LayoutEdge &b) {
+    if (a.depth != b.depth)
+        return a.depth > b.depth;
+    if (a.back != b.back)
+        return a.back;
+    return a.order < b.order;
+}
+} // namespace
+
+// gets the successors of a basic block (the preferred fall-through first)
+static int getSuccessors(BasicBlock *b, int succ[2]) {
+    switch (b->end_kind) {
+    case BasicBlock::BY_JUMP:
+        succ[0] = b->next[0];
+        return 1;
+
+    case BasicBlock::BY_JZERO:
+        succ[0] = b->next[1];
+        succ[1] = b->next[0];
+        return 2;
+
+    default:
+        return 0;
+    }
+}
+
+// gets the branch taken exactly when the given one is not taken
+static RiscvInstr::OpCode invertBranch(RiscvInstr::OpCode op) {
+    switch (op) {
+    case RiscvInstr::BEQZ:
+        return RiscvInstr::BNEZ;
+    case RiscvInstr::BNEZ:
+        return RiscvInstr::BEQZ;
+    case RiscvInstr::BEQ:
+        return RiscvInstr::BNE;
+    case RiscvInstr::BNE:
+        return RiscvInstr::BEQ;
+    case RiscvInstr::BLT:
+        return RiscvInstr::BGE;
+    case RiscvInstr::BGE:
+        return RiscvInstr::BLT;
+    case RiscvInstr::BLTU:
+        return RiscvInstr::BGEU;
+    case RiscvInstr::BGEU:
+        return RiscvInstr::BLTU;
+    default:
+        mind_assert(false); // not a conditional branch
+        return op;
+    }
+}
+
+// finds the chain of a block (with path compression)
+static int findChain(Vector<int> &chain_of, int b) {
+    int root = b;
+    while (chain_of[root] != root)
+        root = chain_of[root];
+    while (chain_of[b] != root) {
+        int up = chain_of[b];
+        chain_of[b] = root;
+        b = up;
+    }
+
+    return root;
+}
+
+/* Orders the basic blocks of a function.
+ *
+ * PARAMETERS:
+ *   g     - the control-flow graph
+ *   order - (output) the block numbers in the order of the layout
+ * NOTE:
+ *   the entry block always comes first. the unreachable blocks come last.
+ */
+void RiscvDesc::layoutBlocks(FlowGraph *g, Vector<int> &order) {
+    int n = (int)g->size();
+    int succ[2];
+
+    order.clear();
+    for (int k = 0; k < n; ++k)
+        g->getBlock(k)->mark = 0;
+
+    if (!Option::doOptimize()) {
+        // the traces, following the preferred successors
+        for (int k = 0; k < n; ++k)
+            for (BasicBlock *b = g->getBlock(k); !b->mark;) {
+                b->mark = 1;
+                order.push_back(b->bb_num);
+                if (0 == getSuccessors(b, succ))
+                    break;
+                b = g->getBlock(succ[0]);
+            }
+        return;
+    }
+
+    Vector<int> postorder;
+    Vector<LayoutEdge> edges;
+
+    g->getPostorder(postorder);
+
+    // Step 1. collects the edges (in reverse postorder)
+    for (int k = (int)postorder.size() - 1; k >= 0; --k) {
+        int u = postorder[k];
+        int ns = getSuccessors(g->getBlock(u), succ);
+        for (int s = 0; s < ns; ++s) {
+            LayoutEdge e;
+            e.from = u;
+            e.to = succ[s];
+            e.depth = std::min(g->getLoopDepth(u), g->getLoopDepth(e.to));
+            e.back = g->dominates(e.to, u);
+            e.order = edges.size();
+            edges.push_back(e);
+        }
+    }
+    std::sort(edges.begin(), edges.end(), edge_before);
+
+    // Step 2. merges the chains (every block starts as a chain of its own,
+    //         and the chains are kept in a union-find forest, where the
+    //         root of a chain is always its head)
+    Vector<int> next_of, prev_of, chain_of;
+
+    next_of.resize(n, -1);
+    prev_of.resize(n, -1);
+    chain_of.resize(n);
+    for (int k = 0; k < n; ++k)
+        chain_of[k] = k;
+
+    for (size_t k = 0; k < edges.size(); ++k) {
+        int u = edges[k].from, v = edges[k].to;
+        // u should end a chain, and v should start another one (except the
+        // entry block, which is always the first)
+        if (next_of[u] >= 0 || prev_of[v] >= 0 || 0 == v)
+            continue;
+
+        int cu = findChain(chain_of, u), cv = findChain(chain_of, v);
+        if (cu == cv)
+            continue;
+        next_of[u] = v;
+        prev_of[v] = u;
+        chain_of[cv] = cu;
+    }
+
+    // Step 3. places the chains, depth-first from the entry block (the
+    //         successors of the tail of a chain are placed first)
+    Vector<int> stack;
+
+    stack.push_back(0);
+    while (!stack.empty()) {
+        int h = stack.back();
+        stack.pop_back();
+        if (g->getBlock(h)->mark)
+            continue;
+
+        for (int b = h; b >= 0; b = next_of[b]) {
+            g->getBlock(b)->mark = 1;
+            order.push_back(b);
+            int ns = getSuccessors(g->getBlock(b), succ);
+            for (int s = ns - 1; s >= 0; --s)
+                if (!g->getBlock(succ[s])->mark)
+                    stack.push_back(findChain(chain_of, succ[s]));
+        }
+    }
+
+    for (int k = 0; k < n; ++k)
+        if (!g->getBlock(k)->mark) {
+            g->getBlock(k)->mark = 1;
+            order.push_back(k);
+        }
+}
+
+/* Chains up the assembly code of the basic blocks (appended to "_tail").
+ *
+ * PARAMETERS:
+ *   g     - the control-flow graph
+ *   order - the order of the blocks (see layoutBlocks)
+ * NOTE:
+ *   a block ends with "j L" (BY_JUMP) or "b<cond> ..., L0; j L1"
+ *   (BY_JZERO). a jump to the next block is dropped, and the latter
+ *   becomes "b<!cond> ..., L1" if L0 is the next block.
+ */
+void RiscvDesc::emitTrace(FlowGraph *g, Vector<int> &order) {
+    for (size_t k = 0; k < order.size(); ++k) {
+        BasicBlock *b = g->getBlock(order[k]);
+        const char *next_label = NULL;
+
+        if (k + 1 < order.size())
+            next_label = g->getBlock(order[k + 1])->entry_label;
+
+        addInstr(RiscvInstr::LABEL, NULL, NULL, NULL, 0,
+                 std::string(b->entry_label), NULL);
+        _tail->next = (RiscvInstr *)b->instr_chain;
+        //todo:2.1翻译选择的指令
+        RiscvInstr *last = NULL, *branch = NULL;
+        while (NULL != _tail->next) {
+            _tail = _tail->next;
+            if (RiscvInstr::COMMENT != _tail->op_code) {
+                branch = last;
+                last = _tail;
+            }
+        }
+        b->mark = 0;
+
+        if (BasicBlock::BY_RETURN == b->end_kind || NULL == next_label)
+            continue;
+
+        mind_assert(RiscvInstr::J == last->op_code);
+        if (last->l == next_label) {
+            last->cancelled = true;
+        } else if (BasicBlock::BY_JZERO == b->end_kind &&
+                   branch->l == next_label) {
+            branch->op_code = invertBranch(branch->op_code);
+            branch->l = last->l;
+            last->cancelled = true;
+        }
+    }
+}
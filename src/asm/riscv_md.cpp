@@ -12,6 +12,7 @@
 #include "scope/scope.hpp"
 #include "symb/symbol.hpp"
 #include "tac/flow_graph.hpp"
+#include "tac/inliner.hpp"
 #include "tac/tac.hpp"
 
 #include <cstring>
@@ -38,6 +39,8 @@ RiscvReg::RiscvReg(const char *reg_name, bool is_general) {
     dirty = false;
     var = NULL;
     general = is_general;
+    global = false;
+    callee_saved = false;
 }
 
 /* Constructor of RiscvDesc.
@@ -52,8 +55,8 @@ RiscvDesc::RiscvDesc(void) {
     _counter = new OffsetCounter(start, dir);
 
     // initializes the register vector
-    // (we regard all general-purpose registers as caller-saved, which is
-    // different from the Riscv specification)
+    // (without -O, we regard all general-purpose registers as caller-saved,
+    // which is different from the Riscv specification)
     _reg[RiscvReg::ZERO] = new RiscvReg("zero", false); // zero
     _reg[RiscvReg::RA] = new RiscvReg("ra", false);     // return address
     _reg[RiscvReg::SP] = new RiscvReg("sp", false);     // stack pointer
@@ -87,8 +90,18 @@ RiscvDesc::RiscvDesc(void) {
     _reg[RiscvReg::A6] = new RiscvReg("a6", false); // argument
     _reg[RiscvReg::A7] = new RiscvReg("a7", false); // argument
 
+    // callee-saved registers of the standard calling convention (-O)
+    _reg[RiscvReg::S1]->callee_saved = true;
+    for (int i = RiscvReg::S2; i <= RiscvReg::S11; ++i)
+        _reg[i]->callee_saved = true;
+
     _lastUsedReg = 0;
     _label_counter = 0;
+    _tail_call = NULL;
+    _isa = Option::getExtensions();
+    _isa_used = 0;
+    _runtime_used = 0;
+    _obj = NULL;
 }
 
 /* Gets the offset counter for this machine.
@@ -98,26 +111,53 @@ RiscvDesc::RiscvDesc(void) {
  */
 OffsetCounter *RiscvDesc::getOffsetCounter(void) { return _counter; }
 
+/* Gets the ISA string of some extensions (with the versions of the
+ * specifications, in the canonical order).
+ *
+ * PARAMETERS:
+ *   ext   - the extensions (see Option::ext_t)
+ * RETURNS:
+ *   the ISA string, e.g. "rv32i2p1_m2p0"
+ */
+static std::string isaString(int ext) {
+    std::string s = "rv32i2p1";
+
+    if (0 != (ext & Option::EXT_M))
+        s += "_m2p0";
+    if (0 != (ext & Option::EXT_C))
+        s += "_c2p0";
+    if (0 != (ext & Option::EXT_ZICOND))
+        s += "_zicond1p0";
+    if (0 != (ext & Option::EXT_ZBA))
+        s += "_zba1p0";
+    if (0 != (ext & Option::EXT_ZBB))
+        s += "_zbb1p0";
+
+    return s;
+}
+
 /* Translates the given Piece list into assembly code and output.
  *
  * PARAMETERS:
  *   ps    - the Piece list
  *   os    - the output stream
+ * NOTE:
+ *   the code goes through a buffer, since the preamble reports the
+ *   extensions which the code turns out to need. with "-filetype=obj",
+ *   the code is encoded instead (see asm/riscv_encode.cpp).
  */
 void RiscvDesc::emitPieces(scope::GlobalScope *gscope, Piece *ps,
                            std::ostream &os) {
 
-    _result = &os;
+    std::ostringstream body;
+    _result = &body;
     // output to .data and .bss segment
     //todo:step10 and 11
     std::ostringstream _data, _bss;
+    if (Option::getLevel() == Option::ASMGEN &&
+        Option::getFileType() != Option::FILE_ASM)
+        _obj = new RiscvObject();
 
-    if (Option::getLevel() == Option::ASMGEN) {
-        // program preamble
-        emit(EMPTY_STR, ".text", NULL);
-        emit(EMPTY_STR, ".globl main", NULL);
-        emit(EMPTY_STR, ".align 2", NULL);
-    }
     // translates node by node
     while (NULL != ps) {
         switch (ps->kind) {
@@ -126,7 +166,13 @@ void RiscvDesc::emitPieces(scope::GlobalScope *gscope, Piece *ps,
             break;
 
         case Piece::GLOBAL:
+            if (NULL != _obj) {
+                encodeGlobal(ps->as.globalVar->name, ps->as.globalVar->value);
+                break;
+            }
             emit(EMPTY_STR, ".data", NULL);
+            // (the code before may end at a halfword with the C extension)
+            emit(EMPTY_STR, ".align 2", NULL);
             emit(EMPTY_STR, ((std::string)(".global ") + ps->as.globalVar->name).c_str(), NULL);
             emit(ps->as.globalVar->name.c_str(), NULL, NULL);
             emit(EMPTY_STR, ((std::string)(".word ") + std::to_string(ps->as.globalVar->value)).c_str(), NULL);
@@ -139,6 +185,38 @@ void RiscvDesc::emitPieces(scope::GlobalScope *gscope, Piece *ps,
 
         ps = ps->next;
     }
+    emitRuntime();
+
+    _result = &os;
+    if (NULL != _obj) {
+        if (Option::getFileType() == Option::FILE_OBJ)
+            writeElf(os, isaString(_isa_used));
+        else
+            disassemble(os, isaString(_isa_used));
+    } else if (Option::getLevel() == Option::ASMGEN) {
+        // program preamble
+        emit(EMPTY_STR,
+             (".attribute arch, \"" + isaString(_isa_used) + "\"").c_str(),
+             NULL);
+        emit(EMPTY_STR, ".text", NULL);
+        emit(EMPTY_STR, ".globl main", NULL);
+        emit(EMPTY_STR, ".align 2", NULL);
+    }
+    os << body.str();
+
+    if (Option::doOptimize() && Option::showStatistics()) {
+        Inliner::dumpStats(std::cerr);
+        FlowGraph::dumpConstantStats(std::cerr);
+        FlowGraph::dumpValueStats(std::cerr);
+        FlowGraph::dumpBranchStats(std::cerr);
+        FlowGraph::dumpInvariantStats(std::cerr);
+        FlowGraph::dumpInductionStats(std::cerr);
+        dumpPeepholeStats(std::cerr);
+    }
+    if (Option::showStatistics())
+        dumpRelaxStats(std::cerr);
+    if (0 != (_isa & Option::EXT_C) && Option::showStatistics())
+        dumpCompressStats(std::cerr);
 }
 
 /* Allocates a new label (for a basic block).
@@ -147,14 +225,44 @@ void RiscvDesc::emitPieces(scope::GlobalScope *gscope, Piece *ps,
  *   a new label guaranteed to be non-conflict with the existing ones
  */
 const char *RiscvDesc::getNewLabel(void) {
-    mind_assert(_label_counter < 10000);
+    mind_assert(_label_counter < 100000000); // (for very large functions)
 
-    char *buf = new char[10];
+    char *buf = new char[16];
     std::sprintf(buf, "__LL%d", _label_counter++);
 
     return buf;
 }
 
+/* Tests whether a TAC is a comparison (or a logical not) feeding nothing but
+ * the JZERO which ends its basic block (so that they can be fused into a
+ * single branch).
+ *
+ * PARAMETERS:
+ *   b     - the basic block
+ *   t     - a TAC of b
+ * RETURNS:
+ *   true if t can be fused with the JZERO (see emitBranchTac)
+ */
+static bool isBranchCompare(BasicBlock *b, Tac *t) {
+    if (BasicBlock::BY_JZERO != b->end_kind || NULL != t->next ||
+        t->op0.var != b->var || b->LiveOut->contains(b->var->id))
+        return false;
+
+    switch (t->op_code) {
+    case Tac::EQU:
+    case Tac::NEQ:
+    case Tac::LES:
+    case Tac::LEQ:
+    case Tac::GTR:
+    case Tac::GEQ:
+    case Tac::LNOT:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
 /* Translates a single basic block into Riscv instructions.
  *
  * PARAMETERS:
@@ -165,14 +273,25 @@ const char *RiscvDesc::getNewLabel(void) {
  */
 RiscvInstr *RiscvDesc::prepareSingleChain(BasicBlock *b, FlowGraph *g) {
     RiscvInstr leading;
+    Tac *fused = NULL; // the comparison translated along with the JZERO
     int r0;
 
+    leading.next = NULL; // (a block ending in a tail call may emit nothing)
     _tail = &leading;
+    _tail_call = findTailCall(b);
+    LiveCursor cursor(b);
     //基本块里的所有tac
-    for (Tac *t = b->tac_chain; t != NULL; t = t->next)
+    for (Tac *t = b->tac_chain; t != NULL; t = t->next) {
+        cursor.advance(t);
+        _live = cursor.live(); // the LiveOut set of t
+        if (isBranchCompare(b, t)) {
+            fused = t;
+            break;
+        }
         //*******重点
         //todo:1.1
         emitTac(t);
+    }
     
     switch (b->end_kind) {
         //jump 离开栈帧块
@@ -185,20 +304,31 @@ RiscvInstr *RiscvDesc::prepareSingleChain(BasicBlock *b, FlowGraph *g) {
         break;
 
     case BasicBlock::BY_JZERO:
-        r0 = getRegForRead(b->var, 0, b->LiveOut);
-        spillDirtyRegs(b->LiveOut);
-        // uses "branch if equal to zero" instruction
-        addInstr(RiscvInstr::BEQZ, _reg[r0], NULL, NULL, 0,
-                 std::string(g->getBlock(b->next[0])->entry_label), NULL);
+        if (NULL != fused) {
+            emitBranchTac(fused, b->LiveOut,
+                          std::string(g->getBlock(b->next[0])->entry_label));
+        } else {
+            r0 = getRegForRead(b->var, 0, b->LiveOut);
+            spillDirtyRegs(b->LiveOut);
+            // uses "branch if equal to zero" instruction
+            addInstr(RiscvInstr::BEQZ, _reg[r0], NULL, NULL, 0,
+                     std::string(g->getBlock(b->next[0])->entry_label), NULL);
+        }
         addInstr(RiscvInstr::J, NULL, NULL, NULL, 0,
                  std::string(g->getBlock(b->next[1])->entry_label), NULL);
         break;
         //step9
     case BasicBlock::BY_RETURN:
+        if (NULL != _tail_call)
+            break; // (the callee returns in our place, see layoutFrame)
         r0 = getRegForRead(b->var, 0, b->LiveOut);
         spillDirtyRegs(b->LiveOut); // just to deattach all temporary variables
         addInstr(RiscvInstr::MOVE, _reg[RiscvReg::A0], _reg[r0], NULL, 0,
                  EMPTY_STR, NULL);
+        // with -O, the epilogue is added by layoutFrame
+        if (Option::doOptimize())
+            break;
+        // restores the stack-frame (see layoutFrame)
         addInstr(RiscvInstr::MOVE, _reg[RiscvReg::SP], _reg[RiscvReg::FP], NULL,
                  0, EMPTY_STR, NULL);
         addInstr(RiscvInstr::LW, _reg[RiscvReg::RA], _reg[RiscvReg::FP], NULL,
@@ -212,6 +342,7 @@ RiscvInstr *RiscvDesc::prepareSingleChain(BasicBlock *b, FlowGraph *g) {
         mind_assert(false); // unreachable
     }
     _tail = NULL;
+    _tail_call = NULL;
     return leading.next;
 }
 
@@ -227,6 +358,9 @@ void RiscvDesc::emitTac(Tac *t) {
     t->dump(oss);
     //tac的comment
     addInstr(RiscvInstr::COMMENT, NULL, NULL, NULL, 0, EMPTY_STR, oss.str().c_str() + 4);
+    // uses the I-type form if an operand is a small constant
+    if (emitImmediateTac(t))
+        return;
     //tac指令做代码翻译
     switch (t->op_code) {
     case Tac::LOAD_IMM4:
@@ -245,24 +379,43 @@ void RiscvDesc::emitTac(Tac *t) {
         emitUnaryTac(RiscvInstr::NEG, t);
         break;
 
-    case Tac::EQU:
+    // the comparisons are followed by a unary operation on the result (on a
+    // copy of the TAC, since t itself is still needed by LiveCursor)
+    case Tac::EQU: {
         emitBinaryTac(RiscvInstr::SUB, t);
-        t->op1 = t->op0;
-        emitUnaryTac(RiscvInstr::SEQZ, t);
+        Tac u = *t;
+        u.op1 = u.op0;
+        emitUnaryTac(RiscvInstr::SEQZ, &u);
         break;
-    
-    case Tac::NEQ:
+    }
+
+    case Tac::NEQ: {
         emitBinaryTac(RiscvInstr::SUB, t);
-        t->op1 = t->op0;
-        emitUnaryTac(RiscvInstr::SNEZ, t);
+        Tac u = *t;
+        u.op1 = u.op0;
+        emitUnaryTac(RiscvInstr::SNEZ, &u);
         break;
-        
+    }
 
-    case Tac::GEQ:
+    case Tac::GEQ: {
         emitBinaryTac(RiscvInstr::SLT, t);
-        t->op1 = t->op0;
-        emitUnaryTac(RiscvInstr::SEQZ, t);
+        Tac u = *t;
+        u.op1 = u.op0;
+        emitUnaryTac(RiscvInstr::SEQZ, &u);
         break;
+    }
+
+    case Tac::LES:
+        emitBinaryTac(RiscvInstr::SLT, t);
+        break;
+
+    case Tac::LEQ: {
+        emitBinaryTac(RiscvInstr::SGT, t);
+        Tac u = *t;
+        u.op1 = u.op0;
+        emitUnaryTac(RiscvInstr::SEQZ, &u);
+        break;
+    }
 
     case Tac::GTR:
         emitBinaryTac(RiscvInstr::SGT, t);
@@ -285,15 +438,41 @@ void RiscvDesc::emitTac(Tac *t) {
         break;
     
     case Tac::MUL:
-        emitBinaryTac(RiscvInstr::MUL, t);
+        if (0 == (_isa & Option::EXT_M))
+            emitRuntimeTac(t);
+        else
+            emitBinaryTac(RiscvInstr::MUL, t);
         break;
     
     case Tac::DIV:
-        emitBinaryTac(RiscvInstr::DIV, t);
+        if (0 == (_isa & Option::EXT_M))
+            emitRuntimeTac(t);
+        else
+            emitBinaryTac(RiscvInstr::DIV, t);
         break;
 
     case Tac::MOD:
-        emitBinaryTac(RiscvInstr::REM, t);
+        if (0 == (_isa & Option::EXT_M))
+            emitRuntimeTac(t);
+        else
+            emitBinaryTac(RiscvInstr::REM, t);
+        break;
+
+    // (from the if-conversion, see tac/ifconv.cpp)
+    case Tac::MIN:
+        emitBinaryTac(RiscvInstr::MIN, t);
+        break;
+
+    case Tac::MAX:
+        emitBinaryTac(RiscvInstr::MAX, t);
+        break;
+
+    case Tac::KEEP_NZ:
+        emitBinaryTac(RiscvInstr::CZERO_EQZ, t);
+        break;
+
+    case Tac::KEEP_Z:
+        emitBinaryTac(RiscvInstr::CZERO_NEZ, t);
         break;
 
     case Tac::ASSIGN:
@@ -310,10 +489,13 @@ void RiscvDesc::emitTac(Tac *t) {
         break;
 
     case Tac::CALL: 
-        emitCallTac(t);
+        if (Option::doOptimize()) // the standard calling convention
+            emitStdCallTac(t);
+        else
+            emitCallTac(t);
         /*{
             addInstr(RiscvInstr::CALL, NULL, NULL, NULL, 0, std::string("_") + t->op1.label->str_form, NULL);
-            int r0 = getRegForWrite(t->op0.var, 0, 0, t->LiveOut);
+            int r0 = getRegForWrite(t->op0.var, 0, 0, _live);
             addInstr(RiscvInstr::MOVE, _reg[r0], _reg[RiscvReg::A0], NULL, 0, EMPTY_STR, NULL);
             }
         */
@@ -338,32 +520,47 @@ void RiscvDesc::emitTac(Tac *t) {
 
 
 void RiscvDesc::emitCallTac(Tac *t) {
-
-    Set<Temp>* liveness = t->LiveOut->clone();
+    // the values to preserve across the call
+    util::Vector<Temp> saved;
+    for (LiveSet::iterator it = _live->begin(); it != _live->end(); ++it)
+        if ((int)*it != t->op0.var->id)
+            saved.push_back(_graph->getTemp(*it));
+
+    // the arguments must survive until all of them have been stored (they
+    // are pinned in the live set, so that saving the other values doesn't
+    // evict them)
+    util::Vector<int> pinned;
+    int count = 0;
+    for(Tac *it = t->prev; it != NULL && it->op_code == Tac::PARAM; it = it->prev) {
+        count += 4;
+        if (!_live->contains(it->op0.var->id)) {
+            _live->add(it->op0.var->id);
+            pinned.push_back(it->op0.var->id);
+        }
+    }
 
     {
         int cnt = 0;
-        for(auto temp : *liveness){
+        for(auto temp : saved){
             cnt -= 4;
-            int r1 = getRegForRead(temp, 0, t->LiveOut);
+            int r1 = getRegForRead(temp, 0, _live);
             addInstr(RiscvInstr::SW,  _reg[r1], _reg[RiscvReg::SP], NULL, cnt, EMPTY_STR, NULL);
         }
         addInstr(RiscvInstr::ADDI, _reg[RiscvReg::SP], _reg[RiscvReg::SP], NULL, cnt, EMPTY_STR, NULL);
     }
 
-    int count = 0;
-    for(Tac *it = t->prev; it != NULL && it->op_code == Tac::PARAM; it = it->prev) count += 4;
-
     if(count > 0){
         addInstr(RiscvInstr::ADDI, _reg[RiscvReg::SP], _reg[RiscvReg::SP], NULL, -count, EMPTY_STR, NULL);
         int cnt = count;
         for(Tac *it = t->prev; it != NULL && it->op_code == Tac::PARAM; it = it->prev){
             cnt -= 4;
-            int r1 = getRegForRead(it->op0.var, 0, it->LiveOut);
+            int r1 = getRegForRead(it->op0.var, 0, _live);
             addInstr(RiscvInstr::SW,  _reg[r1], _reg[RiscvReg::SP], NULL, cnt, EMPTY_STR, NULL);
         }
     }
-    count += liveness->size() * 4;
+    for (size_t k = 0; k < pinned.size(); ++k)
+        _live->remove(pinned[k]);
+    count += saved.size() * 4;
 
     addInstr(RiscvInstr::CALL, NULL, NULL, NULL, 0, std::string("_") + t->op1.label->str_form, NULL);
     
@@ -371,20 +568,99 @@ void RiscvDesc::emitCallTac(Tac *t) {
     {
         int cnt = 0;
         addInstr(RiscvInstr::ADDI, _reg[RiscvReg::SP], _reg[RiscvReg::SP], NULL, count, EMPTY_STR, NULL);
-        for(auto temp: *liveness){
+        for(auto temp: saved){
             cnt -= 4;
-            int r1 = getRegForWrite(temp, 0, 0, t->LiveOut);
+            int r1 = getRegForWrite(temp, 0, 0, _live);
             addInstr(RiscvInstr::LW,  _reg[r1], _reg[RiscvReg::SP], NULL, cnt, EMPTY_STR, NULL);
         }
     }
     
-    int r0 = getRegForWrite(t->op0.var, 0, 0, t->LiveOut);
+    int r0 = getRegForWrite(t->op0.var, 0, 0, _live);
     addInstr(RiscvInstr::MOVE, _reg[r0], _reg[RiscvReg::A0], NULL, 0, EMPTY_STR, NULL);
 }
 
 
+/* Translates a comparison TAC along with the JZERO ending its basic block,
+ * i.e. "c = a OP b; JZERO c, L" becomes a single "branch to L unless
+ * a OP b".
+ *
+ * PARAMETERS:
+ *   t        - the comparison TAC (see isBranchCompare)
+ *   live_out - the LiveOut set of the basic block
+ *   l        - the label to jump to if the comparison doesn't hold
+ * NOTE:
+ *   "a > b" and "a <= b" are tested with the operands swapped, and
+ *   "c = !a; JZERO c, L" becomes "bnez a, L".
+ */
+void RiscvDesc::emitBranchTac(Tac *t, LiveSet *live_out, std::string l) {
+    std::ostringstream oss;
+    RiscvInstr::OpCode op;
+    bool swap = false;
+
+    t->dump(oss);
+    addInstr(RiscvInstr::COMMENT, NULL, NULL, NULL, 0, EMPTY_STR,
+             oss.str().c_str() + 4);
+
+    switch (t->op_code) {
+    case Tac::EQU:
+        op = RiscvInstr::BNE;
+        break;
+
+    case Tac::NEQ:
+        op = RiscvInstr::BEQ;
+        break;
+
+    case Tac::LES:
+        op = RiscvInstr::BGE;
+        break;
+
+    case Tac::LEQ:
+        op = RiscvInstr::BLT;
+        swap = true;
+        break;
+
+    case Tac::GTR:
+        op = RiscvInstr::BGE;
+        swap = true;
+        break;
+
+    case Tac::GEQ:
+        op = RiscvInstr::BLT;
+        break;
+
+    case Tac::LNOT: {
+        int r1 = getRegForRead(t->op1.var, 0, live_out);
+        spillDirtyRegs(live_out);
+        addInstr(RiscvInstr::BNEZ, _reg[r1], NULL, NULL, 0, l, NULL);
+        return;
+    }
+
+    default:
+        mind_assert(false); // unreachable
+        return;
+    }
+
+    // the operands must survive until both of them are in registers
+    bool live1 = live_out->contains(t->op1.var->id);
+    bool live2 = live_out->contains(t->op2.var->id);
+    live_out->add(t->op1.var->id);
+    live_out->add(t->op2.var->id);
+    int r1 = getRegForRead(t->op1.var, 0, live_out);
+    int r2 = getRegForRead(t->op2.var, r1, live_out);
+    if (!live1)
+        live_out->remove(t->op1.var->id);
+    if (!live2)
+        live_out->remove(t->op2.var->id);
+    spillDirtyRegs(live_out);
+
+    if (swap)
+        addInstr(op, _reg[r2], _reg[r1], NULL, 0, l, NULL);
+    else
+        addInstr(op, _reg[r1], _reg[r2], NULL, 0, l, NULL);
+}
+
 void RiscvDesc::emitPushTac(Tac *t) {
-    int r1 = getRegForRead(t->op0.var, 0, t->LiveOut);
+    int r1 = getRegForRead(t->op0.var, 0, _live);
     addInstr(RiscvInstr::ADDI, _reg[RiscvReg::SP], _reg[RiscvReg::SP], NULL, -4, EMPTY_STR, NULL);
     addInstr(RiscvInstr::SW,  _reg[r1], _reg[RiscvReg::SP], NULL, 0, EMPTY_STR, NULL);
 }
@@ -404,34 +680,35 @@ void RiscvDesc::emitPushTac(Tac *t) {
 void RiscvDesc::emitLoadImm4Tac(Tac *t) {
     // eliminates useless assignments
     //计算结果不在Liveout，之后不会被用到
-    if (!t->LiveOut->contains(t->op0.var))
+    // (a constant is loaded where it is used, see getRegForRead)
+    if (!_live->contains(t->op0.var->id) || t->op0.var->is_const)
         return;
 
     // uses "load immediate number" instruction
     //分配实际的寄存器
-    int r0 = getRegForWrite(t->op0.var, 0, 0, t->LiveOut);
+    int r0 = getRegForWrite(t->op0.var, 0, 0, _live);
     //加载到指令队列
     addInstr(RiscvInstr::LI, _reg[r0], NULL, NULL, t->op1.ival, EMPTY_STR,
              NULL);
 }
 
 void RiscvDesc::emitLoadSymbolTac(Tac *t) {
-    if (!t->LiveOut->contains(t->op0.var))
+    if (!_live->contains(t->op0.var->id))
         return;
 
     // uses "load immediate number" instruction
-    int r0 = getRegForWrite(t->op0.var, 0, 0, t->LiveOut);
+    int r0 = getRegForWrite(t->op0.var, 0, 0, _live);
     addInstr(RiscvInstr::LA, _reg[r0], NULL, NULL, 0, t->op1.name,
              NULL);
 }
 
 void RiscvDesc::emitLoadTac(Tac *t) {
-    if (!t->LiveOut->contains(t->op0.var))
+    if (!_live->contains(t->op0.var->id))
         return;
 
     // uses "load immediate number" instruction
-    int r1 = getRegForRead(t->op1.var, 0, t->LiveOut);
-    int r0 = getRegForWrite(t->op0.var, r1, 0, t->LiveOut);
+    int r1 = getRegForRead(t->op1.var, 0, _live);
+    int r0 = getRegForWrite(t->op0.var, r1, 0, _live);
     addInstr(RiscvInstr::LW, _reg[r0], _reg[r1], NULL, t->op1.offset, EMPTY_STR,
              NULL);
 }
@@ -444,11 +721,11 @@ void RiscvDesc::emitLoadTac(Tac *t) {
 //1个参数，1个返回值
 void RiscvDesc::emitUnaryTac(RiscvInstr::OpCode op, Tac *t) {
     // eliminates useless assignments
-    if (!t->LiveOut->contains(t->op0.var))
+    if (!_live->contains(t->op0.var->id))
         return;
 
-    int r1 = getRegForRead(t->op1.var, 0, t->LiveOut);
-    int r0 = getRegForWrite(t->op0.var, r1, 0, t->LiveOut);
+    int r1 = getRegForRead(t->op1.var, 0, _live);
+    int r0 = getRegForWrite(t->op0.var, r1, 0, _live);
 
     addInstr(op, _reg[r0], _reg[r1], NULL, 0, EMPTY_STR, NULL);
 }
@@ -461,16 +738,21 @@ void RiscvDesc::emitUnaryTac(RiscvInstr::OpCode op, Tac *t) {
 //2个参数，1个返回值
 void RiscvDesc::emitBinaryTac(RiscvInstr::OpCode op, Tac *t) {
     // eliminates useless assignments
-    if (!t->LiveOut->contains(t->op0.var))
+    if (!_live->contains(t->op0.var->id))
         return;
 
-    Set<Temp>* liveness = t->LiveOut->clone();
     //加入Live，防止r1找到寄存器，r2找不到寄存器，把r1替换掉了
-    liveness->add(t->op1.var);
-    liveness->add(t->op2.var);
-    int r1 = getRegForRead(t->op1.var, 0, liveness);
-    int r2 = getRegForRead(t->op2.var, r1, liveness);
-    int r0 = getRegForWrite(t->op0.var, r1, r2, liveness);
+    bool live1 = _live->contains(t->op1.var->id);
+    bool live2 = _live->contains(t->op2.var->id);
+    _live->add(t->op1.var->id);
+    _live->add(t->op2.var->id);
+    int r1 = getRegForRead(t->op1.var, 0, _live);
+    int r2 = getRegForRead(t->op2.var, r1, _live);
+    int r0 = getRegForWrite(t->op0.var, r1, r2, _live);
+    if (!live1)
+        _live->remove(t->op1.var->id);
+    if (!live2)
+        _live->remove(t->op2.var->id);
 
     addInstr(op, _reg[r0], _reg[r1], _reg[r2], 0, EMPTY_STR, NULL);
 }
@@ -509,40 +791,63 @@ void RiscvDesc::emit(std::string label, const char *body, const char *comment) {
 //函数分为多个基本块
 void RiscvDesc::emitFuncty(Functy f) {
     mind_assert(NULL != f);
-    //栈帧管理器（调用函数时寄存器的保存）
-    _frame = new RiscvStackFrameManager(-3 * WORD_SIZE);
     //1.建立数据流图
     FlowGraph *g = FlowGraph::makeGraph(f);
+    _graph = g;
     //2.数据流图优化（code:tac）
+    if (Option::doOptimize()) {
+        g->buildSSA();
+        g->propagateConstants(); // folds constants and constant branches
+        g->numberValues();       // removes the redundant computations
+        g->convertBranches(0 != (_isa & Option::EXT_ZBB),     // (min/max)
+                           0 != (_isa & Option::EXT_ZICOND)); // (czero)
+        g->hoistInvariants(numAllocatableRegs()); // (loop-invariant ones)
+        g->reduceStrength(); // (the multiplications of induction variables)
+        if (Option::getLevel() == Option::DATAFLOW) {
+            std::cout << "SSA Form of " << f->entry << ":" << std::endl;
+            g->dump(std::cout);
+        }
+        g->destroySSA();
+    }
     g->simplify();        // simple optimization
     //3.数据流图分析(活跃性分析(变量的作用域))
     g->analyzeLiveness(); // computes LiveOut set of the basic blocks
+    for (FlowGraph::iterator it = g->begin(); it != g->end(); ++it)
+        (*it)->analyzeLiveness(); // computes the dead operands of every TAC
+    findConstants(g); // (the constants are not kept in registers)
+    prepareFrame(g);
+    if (Option::doOptimize()) // keeps variables in registers across blocks
+        allocateRegisters(g);
+    //栈帧管理器（调用函数时寄存器的保存）
+    // (the slots start below the saved registers)
+    _frame = new RiscvStackFrameManager(-(1 + (int)_saved_regs.size()) *
+                                        WORD_SIZE);
+    // takes the parameters (the standard calling convention)
+    RiscvInstr *entry = Option::doOptimize() ? prepareEntry(g) : NULL;
     //4.扫描基本块的liveout,保存到栈帧
-    for (FlowGraph::iterator it = g->begin(); it != g->end(); ++it) {
-        // all variables shared between basic blocks should be reserved
-        Set<Temp> *liveout = (*it)->LiveOut;
-        for (Set<Temp>::iterator sit = liveout->begin(); sit != liveout->end();
-             ++sit) {
-            _frame->reserve(*sit);
-        }
+    // all variables shared between basic blocks should be reserved
+    // (unless the global register allocator has found a register)
+    int num_reserved = reserveSlots(g);
+    int reserved_size = _frame->getStackFrameSize();
+    for (FlowGraph::iterator it = g->begin(); it != g->end(); ++it)
         (*it)->entry_label = getNewLabel(); // adds entry label of a basic block
-    }
     //5.代码生成
     for (FlowGraph::iterator it = g->begin(); it != g->end(); ++it) {
         BasicBlock *b = *it;
-        b->analyzeLiveness(); // computes LiveOut set of every TAC
         _frame->reset();
         // translates the TAC sequences of this block
         //***************************
         //主要代码生成部分
         //todo:1
         b->instr_chain = prepareSingleChain(b, g);
-        if (Option::doOptimize()) // use "-O" option to enable optimization
-            simplePeephole((RiscvInstr *)b->instr_chain);
         b->mark = 0; // clears the marks (for the next step)
     }
     if (Option::getLevel() == Option::DATAFLOW) {
         std::cout << "Control-flow Graph of " << f->entry << ":" << std::endl;
+        std::cout << "* FRAME: " << num_reserved << " variables in "
+                  << reserved_size / WORD_SIZE << " slots (reserved area "
+                  << num_reserved * WORD_SIZE << " -> " << reserved_size
+                  << " bytes)" << std::endl;
         g->dump(std::cout);
         // TO STUDENTS: You might not want to get lots of outputs when
         // debugging.
@@ -554,7 +859,10 @@ void RiscvDesc::emitFuncty(Functy f) {
     mind_assert(!f->entry->str_form.empty()); // this assertion should hold for every Functy
     // outputs the header of a function
     //开辟栈帧，存储旧栈帧的栈顶地址和返回值
-    emitProlog(f->entry, _frame->getStackFrameSize());
+    RiscvInstr leading;
+    leading.next = layoutFrame(g, entry);
+    for (_tail = &leading; NULL != _tail->next; _tail = _tail->next)
+        ;
     // chains up the assembly code of every basic block and output.
     //
     // ``A trace is a sequence of statements that could be consecutively
@@ -562,21 +870,39 @@ void RiscvDesc::emitFuncty(Functy f) {
     //   conditional branches.''
     //           -- Modern Compiler Implementation in Java (the ``Tiger Book'')
     //instr指令的emit
-    for (FlowGraph::iterator it = g->begin(); it != g->end(); ++it)
-        //todo:2
-        emitTrace(*it, g);
+    Vector<int> order;
+    layoutBlocks(g, order);
+    //todo:2
+    emitTrace(g, order);
+    _tail = NULL;
+    if (Option::doOptimize()) // use "-O" option to enable optimization
+        simplePeephole(leading.next);
+    if (0 != (_isa & Option::EXT_C)) // (the 16-bit instructions)
+        compressInstrs(leading.next, f->entry->str_form);
+    else
+        relaxBranches(leading.next); // (the jumps out of reach)
+    if (NULL != _obj) { // (see asm/riscv_encode.cpp)
+        std::ostringstream oss;
+        oss << f->entry;
+        encodeFuncty((f->entry->str_form == "main") ? "main" : oss.str(),
+                     leading.next);
+        return;
+    }
+    emitProlog(f->entry);
+    for (RiscvInstr *i = leading.next; NULL != i; i = i->next)
+        emitInstr(i);
     //代码生成结束
 }
 
-/* Outputs the leading code of a function.
+/* Outputs the label of a function.
  *
  * PARAMETERS:
  *   entry_label - the function label
- *   frame_size  - stack-frame size of this function
  * NOTE:
- *   the prolog code is used to save context and establish the stack frame.
+ *   the prolog code, which saves context and establishes the stack frame,
+ *   is built by layoutFrame (see asm/riscv_frame.cpp).
  */
-void RiscvDesc::emitProlog(Label entry_label, int frame_size) {
+void RiscvDesc::emitProlog(Label entry_label) {
     std::ostringstream oss;
 
     emit(EMPTY_STR, NULL, NULL); // an empty line
@@ -587,14 +913,39 @@ void RiscvDesc::emitProlog(Label entry_label, int frame_size) {
         oss << entry_label;
     }
     emit(oss.str(), NULL, "function entry"); // marks the function entry label
-    oss.str("");
-    // saves old context
-    emit(EMPTY_STR, "sw    ra, -4(sp)", NULL); // saves old frame pointer
-    emit(EMPTY_STR, "sw    fp, -8(sp)", NULL); // saves return address
-    // establishes new stack frame (new context)
-    emit(EMPTY_STR, "mv    fp, sp", NULL);
-    oss << "addi  sp, sp, -" << (frame_size + 2 * WORD_SIZE); // 2 WORD's for old $fp and $ra
-    emit(EMPTY_STR, oss.str().c_str(), NULL);
+}
+
+/* Gets the extension an instruction belongs to.
+ *
+ * PARAMETERS:
+ *   op    - the opcode
+ * RETURNS:
+ *   the extension (see Option::ext_t), or 0 for the base ISA
+ */
+int RiscvDesc::extensionOf(RiscvInstr::OpCode op) {
+    switch (op) {
+    case RiscvInstr::MUL:
+    case RiscvInstr::MULH:
+    case RiscvInstr::DIV:
+    case RiscvInstr::REM:
+        return Option::EXT_M;
+
+    case RiscvInstr::SH1ADD:
+    case RiscvInstr::SH2ADD:
+    case RiscvInstr::SH3ADD:
+        return Option::EXT_ZBA;
+
+    case RiscvInstr::MIN:
+    case RiscvInstr::MAX:
+        return Option::EXT_ZBB;
+
+    case RiscvInstr::CZERO_EQZ:
+    case RiscvInstr::CZERO_NEZ:
+        return Option::EXT_ZICOND;
+
+    default:
+        return 0;
+    }
 }
 
 /* Outputs a single instruction.
@@ -605,12 +956,21 @@ void RiscvDesc::emitProlog(Label entry_label, int frame_size) {
 void RiscvDesc::emitInstr(RiscvInstr *i) {
     if (i->cancelled)
         return;
+    if (i->compressed) { // (see asm/riscv_compress.cpp)
+        _isa_used |= Option::EXT_C;
+        emit(EMPTY_STR, printRvcInstr(i).c_str(), i->comment);
+        return;
+    }
     std::ostringstream oss;
     oss << std::left << std::setw(6);
     switch (i->op_code) {
     case RiscvInstr::COMMENT:
         emit(EMPTY_STR, NULL, i->comment);
         return;
+
+    case RiscvInstr::LABEL:
+        emit(i->l, NULL, NULL);
+        return;
     
    case RiscvInstr::LI:
         oss << "li" << i->r0->name << ", " << i->i;
@@ -664,12 +1024,16 @@ void RiscvDesc::emitInstr(RiscvInstr *i) {
         oss << "sltu" << i->r0->name << ", " << i->r1->name << "," << i->r2->name;
         break;
 
+    case RiscvInstr::SLTI:
+        oss << "slti" << i->r0->name << ", " << i->r1->name << ", " << i->i;
+        break;
+
     case RiscvInstr::SGT:
         oss << "sgt" << i->r0->name << ", " << i->r1->name << "," << i->r2->name;
         break;
     
     case RiscvInstr::XOR:
-        oss << "xor" << i->r0->name << ", " << i->r0->name << "," <<  "0x1";
+        oss << "xor" << i->r0->name << ", " << i->r1->name << ", " << i->r2->name;
         break;
 
     case RiscvInstr::ADD:
@@ -679,7 +1043,31 @@ void RiscvDesc::emitInstr(RiscvInstr *i) {
     case RiscvInstr::ADDI:
         oss << "addi" << i->r0->name << ", " << i->r1->name << ", "<< i->i;
         break;
+
+    case RiscvInstr::ANDI:
+        oss << "andi" << i->r0->name << ", " << i->r1->name << ", " << i->i;
+        break;
+
+    case RiscvInstr::ORI:
+        oss << "ori" << i->r0->name << ", " << i->r1->name << ", " << i->i;
+        break;
+
+    case RiscvInstr::XORI:
+        oss << "xori" << i->r0->name << ", " << i->r1->name << ", " << i->i;
+        break;
     
+    case RiscvInstr::SLLI:
+        oss << "slli" << i->r0->name << ", " << i->r1->name << ", " << i->i;
+        break;
+
+    case RiscvInstr::SRLI:
+        oss << "srli" << i->r0->name << ", " << i->r1->name << ", " << i->i;
+        break;
+
+    case RiscvInstr::SRAI:
+        oss << "srai" << i->r0->name << ", " << i->r1->name << ", " << i->i;
+        break;
+
     case RiscvInstr::SUB:
         oss << "sub" << i->r0->name << ", " << i->r1->name << ", " << i->r2->name;
         break;
@@ -688,6 +1076,10 @@ void RiscvDesc::emitInstr(RiscvInstr *i) {
         oss << "mul" << i->r0->name << ", " << i->r1->name << ", " << i->r2->name;
         break;
     
+    case RiscvInstr::MULH:
+        oss << "mulh" << i->r0->name << ", " << i->r1->name << ", " << i->r2->name;
+        break;
+
     case RiscvInstr::DIV:
         oss << "div" << i->r0->name << ", " << i->r1->name << ", " << i->r2->name;
         break;
@@ -700,6 +1092,34 @@ void RiscvDesc::emitInstr(RiscvInstr *i) {
         oss << "beqz" << i->r0->name << ", " << i->l;
         break;
 
+    case RiscvInstr::BNEZ:
+        oss << "bnez" << i->r0->name << ", " << i->l;
+        break;
+
+    case RiscvInstr::BEQ:
+        oss << "beq" << i->r0->name << ", " << i->r1->name << ", " << i->l;
+        break;
+
+    case RiscvInstr::BNE:
+        oss << "bne" << i->r0->name << ", " << i->r1->name << ", " << i->l;
+        break;
+
+    case RiscvInstr::BLT:
+        oss << "blt" << i->r0->name << ", " << i->r1->name << ", " << i->l;
+        break;
+
+    case RiscvInstr::BGE:
+        oss << "bge" << i->r0->name << ", " << i->r1->name << ", " << i->l;
+        break;
+
+    case RiscvInstr::BLTU:
+        oss << "bltu" << i->r0->name << ", " << i->r1->name << ", " << i->l;
+        break;
+
+    case RiscvInstr::BGEU:
+        oss << "bgeu" << i->r0->name << ", " << i->r1->name << ", " << i->l;
+        break;
+
     case RiscvInstr::J:
         oss << "j" << i->l;
         break;
@@ -712,48 +1132,53 @@ void RiscvDesc::emitInstr(RiscvInstr *i) {
         oss << "la" << i->r0->name << ", " << i->l;
         break;
 
-    default:
-        mind_assert(false); // other instructions not supported
-    }
+    case RiscvInstr::SH1ADD:
+        oss << "sh1add " << i->r0->name << ", " << i->r1->name << ", "
+            << i->r2->name;
+        break;
 
-    emit(EMPTY_STR, oss.str().c_str(), i->comment);
-}
+    case RiscvInstr::SH2ADD:
+        oss << "sh2add " << i->r0->name << ", " << i->r1->name << ", "
+            << i->r2->name;
+        break;
 
-/* Outputs a "trace" (see also: RiscvDesc::emitFuncty).
- *
- * PARAMETERS:
- *   b     - the leading basic block of this trace
- *   g     - the control-flow graph
- * NOTE:
- *   we just do a simple depth-first search against the CFG
- */
-void RiscvDesc::emitTrace(BasicBlock *b, FlowGraph *g) {
-    // a trace is a series of consecutive basic blocks
-    if (b->mark > 0)
-        return;
-    b->mark = 1;
-    emit(std::string(b->entry_label), NULL, NULL);
-    RiscvInstr *i = (RiscvInstr *)b->instr_chain;
-    while (NULL != i) {
-        //todo:2.1翻译选择的指令
-        emitInstr(i);
-        i = i->next;
-    }
-    switch (b->end_kind) {
-    case BasicBlock::BY_JUMP:
-        emitTrace(g->getBlock(b->next[0]), g);
+    case RiscvInstr::SH3ADD:
+        oss << "sh3add " << i->r0->name << ", " << i->r1->name << ", "
+            << i->r2->name;
         break;
 
-    case BasicBlock::BY_JZERO:
-        emitTrace(g->getBlock(b->next[1]), g);
+    case RiscvInstr::MIN:
+        oss << "min" << i->r0->name << ", " << i->r1->name << ", " << i->r2->name;
         break;
 
-    case BasicBlock::BY_RETURN:
+    case RiscvInstr::MAX:
+        oss << "max" << i->r0->name << ", " << i->r1->name << ", " << i->r2->name;
+        break;
+
+    case RiscvInstr::CZERO_EQZ:
+        oss << "czero.eqz " << i->r0->name << ", " << i->r1->name << ", "
+            << i->r2->name;
+        break;
+
+    case RiscvInstr::CZERO_NEZ:
+        oss << "czero.nez " << i->r0->name << ", " << i->r1->name << ", "
+            << i->r2->name;
+        break;
+
+    case RiscvInstr::JAL:
+        oss << "jal" << i->l;
+        break;
+
+    case RiscvInstr::JUMP:
+        oss << "jump" << i->l << ", " << _reg[RiscvReg::A7]->name;
         break;
 
     default:
-        mind_assert(false); // unreachable
+        mind_assert(false); // other instructions not supported
     }
+    _isa_used |= extensionOf(i->op_code);
+
+    emit(EMPTY_STR, oss.str().c_str(), i->comment);
 }
 
 /* Appends an instruction line to "_tail". (internal helper function)
@@ -782,23 +1207,12 @@ void RiscvDesc::addInstr(RiscvInstr::OpCode op_code, RiscvReg *r0, RiscvReg *r1,
     _tail->r2 = r2;
     _tail->i = i;
     _tail->l = l;
-    _tail->comment = cmt;
+    _tail->comment = NULL;
+    if (NULL != cmt) // the caller's buffer is usually a temporary one
+        _tail->comment = std::strcpy(new char[std::strlen(cmt) + 1], cmt);
 }
 
 
-/******************** a simple peephole optimizer *********************/
-
-/* Performs a peephole optimization pass to the instruction sequence.
- *
- * PARAMETERS:
- *   iseq  - the instruction sequence to optimize
- */
-void RiscvDesc::simplePeephole(RiscvInstr *iseq) {
-    // if you are interested in peephole optimization, you can implement here
-    // of course, beyond our requirements
-    
-}
-
 /******************* REGISTER ALLOCATOR ***********************/
 
 /* Acquires a register to read some variable.
@@ -812,6 +1226,13 @@ void RiscvDesc::simplePeephole(RiscvInstr *iseq) {
  */
 int RiscvDesc::getRegForRead(Temp v, int avoid1, LiveSet *live) {
     std::ostringstream oss;
+
+    // the global register allocator has settled it
+    if (0 != v->reg)
+        return v->reg;
+    // the constant 0 is always there
+    if (v->is_const && 0 == v->value)
+        return RiscvReg::ZERO;
     //查看是否是之前已经用到的寄存器
     int i = lookupReg(v);
 
@@ -825,7 +1246,12 @@ int RiscvDesc::getRegForRead(Temp v, int avoid1, LiveSet *live) {
 
         _reg[i]->var = v;
         //选择返回的寄存器
-        if (v->is_offset_fixed) {
+        if (v->is_const) {
+            oss << "load the constant " << v << " = " << v->value;
+            addInstr(RiscvInstr::LI, _reg[i], NULL, NULL, v->value, EMPTY_STR,
+                     oss.str().c_str());
+
+        } else if (v->is_offset_fixed) {
             RiscvReg *base = _reg[RiscvReg::FP];
             oss << "load " << v << " from (" << base->name
                 << (v->offset < 0 ? "" : "+") << v->offset << ") into "
@@ -855,9 +1281,12 @@ int RiscvDesc::getRegForRead(Temp v, int avoid1, LiveSet *live) {
  *   number of the register which can be safely written to
  */
 int RiscvDesc::getRegForWrite(Temp v, int avoid1, int avoid2, LiveSet *live) {
-    if (NULL == v || !live->contains(v))
+    if (NULL == v || !live->contains(v->id))
         return RiscvReg::ZERO;
 
+    if (0 != v->reg)
+        return v->reg;
+
     int i = lookupReg(v);
 
     if (i < 0) {
@@ -889,7 +1318,7 @@ void RiscvDesc::spillReg(int i, LiveSet *live) {
 
     Temp v = _reg[i]->var;
 
-    if ((NULL != v) && _reg[i]->dirty && live->contains(v)) {
+    if ((NULL != v) && _reg[i]->dirty && live->contains(v->id)) {
         RiscvReg *base = _reg[RiscvReg::FP];
 
         if (!v->is_offset_fixed) {
@@ -916,7 +1345,7 @@ void RiscvDesc::spillDirtyRegs(LiveSet *live) {
     // determines whether we should spill the registers
     for (i = 0; i < RiscvReg::TOTAL_NUM; ++i) {
         if ((NULL != _reg[i]->var) && _reg[i]->dirty &&
-            live->contains(_reg[i]->var))
+            live->contains(_reg[i]->var->id))
             break;
 
         _reg[i]->var = NULL;
@@ -942,7 +1371,7 @@ void RiscvDesc::spillDirtyRegs(LiveSet *live) {
  */
 int RiscvDesc::lookupReg(tac::Temp v) {
     for (int i = 0; i < RiscvReg::TOTAL_NUM; ++i)
-        if (_reg[i]->general && _reg[i]->var == v)
+        if (_reg[i]->general && !_reg[i]->global && _reg[i]->var == v)
             return i;
 
     return -1;
@@ -960,16 +1389,17 @@ int RiscvDesc::lookupReg(tac::Temp v) {
 int RiscvDesc::selectRegToSpill(int avoid1, int avoid2, LiveSet *live) {
     // looks for a "ready" one
     for (int i = 0; i < RiscvReg::TOTAL_NUM; ++i) {
-        if (!_reg[i]->general)
+        if (!_reg[i]->general || _reg[i]->global)
             continue;
 
-        if ((i != avoid1) && (i != avoid2) && !live->contains(_reg[i]->var))
+        if ((i != avoid1) && (i != avoid2) &&
+            (NULL == _reg[i]->var || !live->contains(_reg[i]->var->id)))
             return i;
     }
 
     // looks for a clean one (so that we could save a "store")
     for (int i = 0; i < RiscvReg::TOTAL_NUM; ++i) {
-        if (!_reg[i]->general)
+        if (!_reg[i]->general || _reg[i]->global)
             continue;
 
         if ((i != avoid1) && (i != avoid2) && !_reg[i]->dirty)
@@ -982,7 +1412,31 @@ int RiscvDesc::selectRegToSpill(int avoid1, int avoid2, LiveSet *live) {
     do {
         _lastUsedReg = (_lastUsedReg + 1) % RiscvReg::TOTAL_NUM;
     } while ((_lastUsedReg == avoid1) || (_lastUsedReg == avoid2) ||
-             !_reg[_lastUsedReg]->general);
+             !_reg[_lastUsedReg]->general || _reg[_lastUsedReg]->global);
 
     return _lastUsedReg;
 }
+
+/* Acquires a register for an intermediate value.
+ *
+ * PARAMETERS:
+ *   avoid1 - the register which should not be selected
+ *   avoid2 - the same as "avoid1"
+ *   live   - the current liveness set
+ * RETURNS:
+ *   number of a register which holds no variable
+ * NOTE:
+ *   the register is not associated with any variable, so the value is lost
+ *   as soon as another register is acquired (unless it is avoided).
+ */
+int RiscvDesc::getScratchReg(int avoid1, int avoid2, LiveSet *live) {
+    for (int i = 0; i < RiscvReg::TOTAL_NUM; ++i)
+        if (_reg[i]->general && !_reg[i]->global && NULL == _reg[i]->var &&
+            i != avoid1 && i != avoid2)
+            return i;
+
+    int i = selectRegToSpill(avoid1, avoid2, live);
+    spillReg(i, live);
+
+    return i;
+}
@@ -6,7 +6,9 @@
 #ifndef __MIND_RISCVMD__
 #define __MIND_RISCVMD__
 
+#include "3rdparty/bitset.hpp"
 #include "3rdparty/set.hpp"
+#include "3rdparty/vector.hpp"
 #include "asm/mach_desc.hpp"
 #include "asm/riscv_frame_manager.hpp"
 #include "define.hpp"
@@ -14,13 +16,14 @@
 namespace mind {
 #define RISCV_COMPONENTS_DEFINED
 namespace assembly {
-// for convinience
-typedef util::Set<tac::Temp> LiveSet;
+// for convinience (a bit-vector indexed by TempObject::id)
+typedef util::BitSet LiveSet;
 
 /**
  * RISC-V register.
  *
- * NOTE: we regard all general-purpose registers as caller-saved
+ * NOTE: we regard all general-purpose registers as caller-saved, except
+ *       that s1-s11 are callee-saved under -O (see asm/riscv_abi.cpp)
  *
  */
 struct RiscvReg {
@@ -64,6 +67,8 @@ struct RiscvReg {
     tac::Temp var;    // associated variable
     bool dirty;       // whether it is out of sychronized with the memory
     bool general;     // whether it is a generl-purpose register
+    bool global;      // whether it is owned by the global register allocator
+    bool callee_saved; // whether it is preserved across calls (-O only)
 
     // two constructors for convenience
     RiscvReg(const char *reg_name, bool is_general);
@@ -82,19 +87,34 @@ struct RiscvInstr : public Instr {
     enum OpCode {
         // assembler directives
         COMMENT,
+        LABEL, // the entry label of a basic block
         // instructions/pseudo instructions
         AND,
         OR,
         XOR,
         ADD,
         ADDI,
+        ANDI,
+        ORI,
+        XORI,
+        SLLI,
+        SRLI,
+        SRAI,
         SUB,
         MUL,
+        MULH,
         DIV,
         REM,
         NEG,
         J,
         BEQZ,
+        BNEZ,
+        BEQ,
+        BNE,
+        BLT,
+        BGE,
+        BLTU,
+        BGEU,
         RET,
         LW,
         LI,
@@ -105,23 +125,79 @@ struct RiscvInstr : public Instr {
         SNEZ, 
         SLT,
         SLTU,
+        SLTI,
         SGT,
         SGE,
         CALL,
-        LA
+        LA,
+        // the extensions (see -march)
+        SH1ADD, // Zba
+        SH2ADD,
+        SH3ADD,
+        MIN, // Zbb
+        MAX,
+        CZERO_EQZ, // Zicond
+        CZERO_NEZ,
+        JAL, // the call of a runtime routine (see asm/riscv_runtime.cpp)
+        JUMP, // j beyond the reach of jal (see asm/riscv_relax.cpp)
         // You could add other instructions/pseudo instructions here
+        NUM_OPCODES // the number of opcodes
     } op_code; // operation code
 
     RiscvReg *r0, *r1, *r2; // 3 register operands
     int i;                  // offset or immediate number
-    std::string l;          // target label. for LA, B, BEQZ or JAL
+    std::string l;          // target label. for LA, J, CALL, LABEL or branches
     const char *comment;    // comment in this line
+    bool compressed;        // whether it is output in its 16-bit form (RVC)
 
     RiscvInstr *next; // next instruction
 
     // "cancelled" field is inherited from assembly::Instr.
 };
 
+/**
+ * RISC-V object code (see "-filetype=obj").
+ *
+ * NOTE: the functions and the variables are encoded one after another into
+ *       their sections, and then written out as an ELF32 relocatable (see
+ *       asm/riscv_elf.cpp)
+ */
+struct RiscvObject {
+    // the sections where the symbols are defined
+    enum { UNDEF = 0, TEXT, DATA, BSS };
+
+    // the relocations used (see the RISC-V ELF psABI)
+    enum {
+        R_RISCV_JAL = 17,
+        R_RISCV_CALL_PLT = 19,
+        R_RISCV_PCREL_HI20 = 23,
+        R_RISCV_PCREL_LO12_I = 24
+    };
+
+    struct Symbol {
+        std::string name;
+        int section; // TEXT, DATA or BSS
+        int value;   // the offset in the section
+        int size;    // the size in bytes
+        bool global; // whether it is seen by other object files
+        bool func;   // whether it is a function
+    };
+
+    struct Reloc {
+        int offset;         // the offset in .text
+        std::string symbol; // the symbol referred to
+        int type;           // R_RISCV_*
+    };
+
+    util::Vector<unsigned char> text; // the code
+    util::Vector<unsigned char> data; // the initialized variables
+    int bss_size;                     // the size of the zeroed variables
+    util::Vector<Symbol> symbols;     // the symbols defined
+    util::Vector<Reloc> relocs;       // the relocations of .text
+
+    RiscvObject() : bss_size(0) {}
+};
+
 /**
  * RISC-V machine description.
  *
@@ -146,8 +222,26 @@ class RiscvDesc : public MachineDesc {
     RiscvInstr *_tail;
     // stack-frame manager for `register spilling`
     RiscvStackFrameManager *_frame;
+    // the control-flow graph of the current function
+    tac::FlowGraph *_graph;
+    // the variables alive after the TAC being translated (see tac::LiveCursor)
+    LiveSet *_live;
+    // the registers saved by the current function (see asm/riscv_frame.cpp)
+    util::Vector<int> _saved_regs;
+    // the tail call ending the basic block being translated (if any)
+    tac::Tac *_tail_call;
+    // whether t6 is reserved for the offsets beyond 12 bits
+    bool _big_frame;
     // label counter for allocating new labels
     int _label_counter;
+    // the ISA extensions of the target (see Option::ext_t)
+    int _isa;
+    // the extensions of the instructions emitted so far
+    int _isa_used;
+    // the runtime routines called so far (see asm/riscv_runtime.cpp)
+    int _runtime_used;
+    // the object code being built (NULL when printing assembly code)
+    RiscvObject *_obj;
     
     // allocates a new label
     const char *getNewLabel(void);
@@ -170,24 +264,41 @@ class RiscvDesc : public MachineDesc {
     void emitPushTac(tac::Tac *);
     // translates a Call TAC into assembly instructions
     void emitCallTac(tac::Tac *);
+    // translates a comparison TAC fused with the JZERO ending its block
+    void emitBranchTac(tac::Tac *, LiveSet *, std::string);
+    // translates a TAC with a small constant operand (see asm/riscv_imm.cpp)
+    bool emitImmediateTac(tac::Tac *);
+    // translates a multiplication, division or modulo by a constant into
+    // shifts and additions (see asm/riscv_imm.cpp)
+    bool emitMulDivImmTac(tac::Tac *);
+    // multiplies a register by a constant with shifts and additions
+    void emitShiftAddMul(int, int, int, int);
 
     // outputs an instruction
     void emit(std::string, const char *, const char *);
     // outputs a function
     void emitFuncty(tac::Functy);
-    // prints the leading code of a function
-    void emitProlog(tac::Label, int);
-    // prints the assembly code of a single trace
-    void emitTrace(tac::BasicBlock *, tac::FlowGraph *);
+    // prints the label of a function
+    void emitProlog(tac::Label);
+    // orders the basic blocks (see asm/riscv_layout.cpp)
+    void layoutBlocks(tac::FlowGraph *, util::Vector<int> &);
+    // chains up the assembly code of the basic blocks in the given order
+    void emitTrace(tac::FlowGraph *, util::Vector<int> &);
     // prints a single RISC-V instruction
     void emitInstr(RiscvInstr *);
+    // gets the extension an instruction belongs to
+    int extensionOf(RiscvInstr::OpCode);
     // appends a new instruction to "_tail"
     void addInstr(RiscvInstr::OpCode, RiscvReg *, RiscvReg *, RiscvReg *, int,
                   std::string, const char *);
 
 
-    /*** sketch for peephole optimizer (inside a basic block) ***/
+    /*** the peephole optimizer (-O, see asm/riscv_peephole.cpp) ***/
+
+    // rewrites the instruction sequence of a function with the rule table
     void simplePeephole(RiscvInstr *);
+    // prints how many times every rule has been applied
+    void dumpPeepholeStats(std::ostream &);
 
 
     /*** the register allocator ***/
@@ -206,6 +317,101 @@ class RiscvDesc : public MachineDesc {
     int lookupReg(tac::Temp);
     // selects a register to spill into memory
     int selectRegToSpill(int, int, LiveSet *);
+    // acquires a register for an intermediate value (of a single TAC)
+    int getScratchReg(int, int, LiveSet *);
+
+    /*** the global register allocator (-O, see asm/riscv_reg_alloc.cpp) ***/
+
+    // assigns registers to the temporary variables of a whole function
+    void allocateRegisters(tac::FlowGraph *);
+    // gets how many registers the variables may be assigned
+    int numAllocatableRegs(void);
+
+    /*** the immediate operands (see asm/riscv_imm.cpp) ***/
+
+    // marks the temporary variables holding a constant
+    void findConstants(tac::FlowGraph *);
+
+    /*** the standard calling convention (-O, see asm/riscv_abi.cpp) ***/
+
+    // rounds a size up to the stack alignment
+    static int alignStack(int);
+    // translates a Call TAC, passing the arguments in registers
+    void emitStdCallTac(tac::Tac *);
+    // finds the call whose result a basic block returns (a tail call)
+    tac::Tac *findTailCall(tac::BasicBlock *);
+    // translates the entry code which takes the parameters and loads the
+    // register-allocated variables
+    RiscvInstr *prepareEntry(tac::FlowGraph *);
+
+    /*** the software multiplication and division (see
+     *** asm/riscv_runtime.cpp) ***/
+
+    // tests whether a TAC calls a runtime routine
+    bool needsRuntime(tac::Tac *);
+    // translates a MUL, DIV or MOD TAC into a call of a runtime routine
+    void emitRuntimeTac(tac::Tac *);
+    // outputs the runtime routines called
+    void emitRuntime(void);
+
+    /*** the compressed instructions (-march=...c, see
+     *** asm/riscv_compress.cpp) ***/
+
+    // tests whether a register is one of x8-x15
+    bool isRvcReg(RiscvReg *);
+    // gets the 16-bit form of an instruction (regardless of the distance
+    // to the target of a jump)
+    int getRvcForm(RiscvInstr *);
+    // chooses the instructions of a function to output in 16-bit forms
+    void compressInstrs(RiscvInstr *, std::string);
+    // prints an instruction in its 16-bit form
+    std::string printRvcInstr(RiscvInstr *);
+    // encodes an instruction in its 16-bit form
+    unsigned encodeRvcInstr(RiscvInstr *, int);
+    // prints the code size of every function
+    void dumpCompressStats(std::ostream &);
+
+    /*** the branch relaxation (see asm/riscv_relax.cpp) ***/
+
+    // gets the size of an instruction
+    int getInstrSize(RiscvInstr *);
+    // rewrites the jumps of a function which don't reach their targets
+    int relaxBranches(RiscvInstr *);
+    // prints the statistics of the branch relaxation
+    void dumpRelaxStats(std::ostream &);
+
+    /*** the object code (-filetype=obj, see asm/riscv_encode.cpp,
+     *** asm/riscv_elf.cpp and asm/riscv_disasm.cpp) ***/
+
+    // gets the number of a register (e.g. 10 for a0)
+    int getRegNum(RiscvReg *);
+    // tests whether an immediate fits in n bits (signed)
+    static bool fitsBits(int, int);
+    // encodes the instructions of a function into .text
+    void encodeFuncty(std::string, RiscvInstr *);
+    // encodes a single instruction
+    void encodeInstr(RiscvInstr *, int);
+    // encodes a global variable into .data or .bss
+    void encodeGlobal(std::string, int);
+    // writes the object code as an ELF32 relocatable
+    void writeElf(std::ostream &, std::string);
+    // prints the disassembly of the object code
+    void disassemble(std::ostream &, std::string);
+
+    /*** the stack-frame layout (see asm/riscv_frame.cpp) ***/
+
+    // decides the registers to save and whether the frame might be large
+    void prepareFrame(tac::FlowGraph *);
+    // reserves the variables shared between basic blocks in the stack-frame
+    int reserveSlots(tac::FlowGraph *);
+    // builds the prologue and the epilogues of a function
+    RiscvInstr *layoutFrame(tac::FlowGraph *, RiscvInstr *);
+    // tests whether an instruction sequence touches the stack-frame
+    bool usesFrame(RiscvInstr *);
+    // rewrites the frame accesses of an instruction sequence to use sp
+    void rebaseFrame(RiscvInstr *, int);
+    // expands the offsets and immediates out of the 12-bit range
+    RiscvInstr *legalizeOffsets(RiscvInstr *);
 };
 
 } // namespace assembly
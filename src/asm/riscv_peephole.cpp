@@ -0,0 +1,362 @@
+/*****************************************************
+ *  Peephole Optimizer of RiscvDesc.
+ *
+ *  The optimizer slides a small window over the instruction sequence of a
+ *  whole function (after the basic blocks have been laid out, so that the
+ *  labels are part of the sequence), and rewrites the patterns listed in
+ *  the rule table below.
+ *
+ *  A rule is made of the opcodes it matches at every position of the
+ *  window (as a set, see OPS), and an action which checks the remaining
+ *  conditions (e.g. which registers are involved) and does the rewriting.
+ *  The table is compiled into an index from the first opcode to the rules,
+ *  so that only a few rules are tried at every position.
+ *
+ *  The instructions removed are marked as "cancelled", and the counters
+ *  of the rules can be printed with the "-s" option.
+ */
+
+#include "asm/riscv_md.hpp"
+#include "config.hpp"
+#include "options.hpp"
+
+#include <iomanip>
+
+using namespace mind::assembly;
+using namespace mind;
+
+#define MAX_WINDOW 3 // the longest pattern
+#define MAX_SCAN 64  // how far to look for the next use of a register
+
+// the set of opcodes matched at a position of the window
+typedef unsigned long long OpSet;
+#define OPS(op) ((OpSet)1 << RiscvInstr::op)
+
+// the instructions writing r0 and reading nothing but r1 and r2
+#define ALU_OPS                                                                \
+    (OPS(ADD) | OPS(SUB) | OPS(MUL) | OPS(DIV) | OPS(REM) | OPS(AND) |         \
+     OPS(OR) | OPS(SLT) | OPS(SLTU) | OPS(SGT) | OPS(NEG) | OPS(NOT) |         \
+     OPS(SEQZ) | OPS(SNEZ) | OPS(ADDI) | OPS(ANDI) | OPS(ORI) | OPS(XORI) |   \
+     OPS(SLTI) | OPS(MOVE) | OPS(LW) | OPS(LA) | OPS(SH1ADD) |               \
+     OPS(SH2ADD) | OPS(SH3ADD) | OPS(MIN) | OPS(MAX) | OPS(CZERO_EQZ) |       \
+     OPS(CZERO_NEZ))
+
+namespace {
+// a window of consecutive (not cancelled) instructions
+struct Window {
+    RiscvInstr *i[MAX_WINDOW]; // the instructions (NULL beyond the end)
+    RiscvReg **reg;            // the registers of the machine
+};
+
+// a peephole rule
+struct PeepholeRule {
+    const char *name;         // the name (for the statistics)
+    int length;               // how many instructions it matches
+    OpSet ops[MAX_WINDOW];    // the opcodes matched at every position
+    bool (*action)(Window &); // checks the conditions and rewrites
+    int hits;                 // how many times it has been applied
+};
+} // namespace
+
+/* Tests whether an instruction reads a register.
+ *
+ * PARAMETERS:
+ *   i     - the instruction
+ *   r     - the register
+ * RETURNS:
+ *   true if r is an operand read by i (calls and returns are not handled
+ *   here, see isDeadAfter)
+ */
+static bool reads(RiscvInstr *i, RiscvReg *r) {
+    switch (i->op_code) {
+    case RiscvInstr::SW:
+        return (i->r0 == r || i->r1 == r);
+
+    case RiscvInstr::BEQZ:
+    case RiscvInstr::BNEZ:
+        return (i->r0 == r);
+
+    case RiscvInstr::BEQ:
+    case RiscvInstr::BNE:
+    case RiscvInstr::BLT:
+    case RiscvInstr::BGE:
+    case RiscvInstr::BLTU:
+    case RiscvInstr::BGEU:
+        return (i->r0 == r || i->r1 == r);
+
+    case RiscvInstr::COMMENT:
+    case RiscvInstr::LABEL:
+    case RiscvInstr::J:
+    case RiscvInstr::CALL:
+    case RiscvInstr::RET:
+    case RiscvInstr::LI:
+    case RiscvInstr::LA:
+        return false;
+
+    default:
+        return (i->r1 == r || i->r2 == r);
+    }
+}
+
+/* Gets the register written by an instruction.
+ *
+ * PARAMETERS:
+ *   i     - the instruction
+ * RETURNS:
+ *   the register written (NULL if none)
+ */
+static RiscvReg *writes(RiscvInstr *i) {
+    switch (i->op_code) {
+    case RiscvInstr::SW:
+    case RiscvInstr::BEQZ:
+    case RiscvInstr::BNEZ:
+    case RiscvInstr::BEQ:
+    case RiscvInstr::BNE:
+    case RiscvInstr::BLT:
+    case RiscvInstr::BGE:
+    case RiscvInstr::BLTU:
+    case RiscvInstr::BGEU:
+    case RiscvInstr::COMMENT:
+    case RiscvInstr::LABEL:
+    case RiscvInstr::J:
+    case RiscvInstr::CALL:
+    case RiscvInstr::JAL: // (a0 and a1, see asm/riscv_runtime.cpp)
+    case RiscvInstr::RET:
+        return NULL;
+
+    default:
+        return i->r0;
+    }
+}
+
+/* Tests whether the value of a register is no longer used after an
+ * instruction.
+ *
+ * PARAMETERS:
+ *   i     - the instruction
+ *   r     - the register
+ *   reg   - the registers of the machine
+ * RETURNS:
+ *   true if r is overwritten before it is read (conservatively)
+ * NOTE:
+ *   the search stops at the end of the basic block, where the register is
+ *   regarded as alive (it may be a global register), except that calls and
+ *   returns clobber the caller-saved registers.
+ */
+static bool isDeadAfter(RiscvInstr *i, RiscvReg *r, RiscvReg **reg) {
+    bool is_temp = (r->general && !r->callee_saved); // t0-t6
+    bool is_arg = false;                             // a0-a7
+
+    for (int k = RiscvReg::A0; k <= RiscvReg::A7; ++k)
+        is_arg |= (reg[k] == r);
+
+    int n = 0;
+    for (i = i->next; NULL != i && n < MAX_SCAN; i = i->next) {
+        if (i->cancelled)
+            continue;
+        ++n;
+        if (reads(i, r))
+            return false;
+        if (writes(i) == r)
+            return true;
+
+        switch (i->op_code) {
+        case RiscvInstr::CALL:
+            if (is_arg)
+                return false; // it might be an argument
+            if (is_temp)
+                return true;
+            break;
+
+        case RiscvInstr::RET:
+            return is_temp || (is_arg && reg[RiscvReg::A0] != r);
+
+        case RiscvInstr::LABEL:
+        case RiscvInstr::J:
+        case RiscvInstr::BEQZ:
+        case RiscvInstr::BNEZ:
+        case RiscvInstr::BEQ:
+        case RiscvInstr::BNE:
+        case RiscvInstr::BLT:
+        case RiscvInstr::BGE:
+        case RiscvInstr::BLTU:
+        case RiscvInstr::BGEU:
+            return false;
+
+        default:
+            break;
+        }
+    }
+
+    return false;
+}
+
+/* mv r, r  =>  (nothing) */
+static bool removeSelfMove(Window &w) {
+    if (w.i[0]->r0 != w.i[0]->r1)
+        return false;
+
+    w.i[0]->cancelled = true;
+    return true;
+}
+
+/* sw r, x(b); lw r', x(b)  =>  sw r, x(b); mv r', r */
+static bool forwardStore(Window &w) {
+    RiscvInstr *sw = w.i[0], *lw = w.i[1];
+
+    if (sw->r1 != lw->r1 || sw->i != lw->i)
+        return false;
+
+    lw->op_code = RiscvInstr::MOVE;
+    lw->r1 = sw->r0;
+    lw->i = 0;
+    if (lw->r0 == lw->r1)
+        lw->cancelled = true;
+    return true;
+}
+
+/* li t, n; mv r, t  =>  li r, n  (if t is dead) */
+static bool foldLoadImm(Window &w) {
+    RiscvInstr *li = w.i[0], *mv = w.i[1];
+
+    if (mv->r1 != li->r0 || !isDeadAfter(mv, li->r0, w.reg))
+        return false;
+
+    li->r0 = mv->r0;
+    mv->cancelled = true;
+    return true;
+}
+
+/* op t, ...; mv r, t  =>  op r, ...  (if t is dead) */
+static bool foldMove(Window &w) {
+    RiscvInstr *op = w.i[0], *mv = w.i[1];
+
+    if (mv->r1 != op->r0 || !isDeadAfter(mv, op->r0, w.reg))
+        return false;
+
+    op->r0 = mv->r0;
+    mv->cancelled = true;
+    return true;
+}
+
+/* li z, 0; sub d, a, z; seqz/snez r, d  =>  seqz/snez r, a
+ * (the lowering of "a == 0" and "a != 0", if z and d are dead) */
+static bool foldCompareZero(Window &w) {
+    RiscvInstr *li = w.i[0], *sub = w.i[1], *set = w.i[2];
+    RiscvReg *z = li->r0, *d = sub->r0;
+    RiscvReg *a = (sub->r2 == z) ? sub->r1 : sub->r2;
+
+    if (0 != li->i || set->r1 != d || a == z ||
+        (sub->r1 != z && sub->r2 != z))
+        return false;
+    if ((z != set->r0 && !isDeadAfter(set, z, w.reg)) ||
+        (d != set->r0 && !isDeadAfter(set, d, w.reg)))
+        return false;
+
+    set->r1 = a;
+    li->cancelled = true;
+    sub->cancelled = true;
+    return true;
+}
+
+/* j L; L:  =>  L: */
+static bool removeJumpToNext(Window &w) {
+    if (w.i[0]->l != w.i[1]->l)
+        return false;
+
+    w.i[0]->cancelled = true;
+    return true;
+}
+
+// the rule table (the earlier rules are tried first)
+static PeepholeRule rules[] = {
+    {"mv-self", 1, {OPS(MOVE)}, removeSelfMove, 0},
+    {"sw-lw", 2, {OPS(SW), OPS(LW)}, forwardStore, 0},
+    {"li-mv", 2, {OPS(LI), OPS(MOVE)}, foldLoadImm, 0},
+    {"op-mv", 2, {ALU_OPS, OPS(MOVE)}, foldMove, 0},
+    {"li0-sub-setz",
+     3,
+     {OPS(LI), OPS(SUB), OPS(SEQZ) | OPS(SNEZ)},
+     foldCompareZero,
+     0},
+    {"j-next", 2, {OPS(J), OPS(LABEL)}, removeJumpToNext, 0},
+};
+
+#define NUM_RULES ((int)(sizeof(rules) / sizeof(rules[0])))
+
+// the compiled matcher: the rules to try for every first opcode
+// (terminated by -1)
+static int first_index[RiscvInstr::NUM_OPCODES][NUM_RULES + 1];
+static bool compiled = false;
+
+/* Compiles the rule table into the matcher.
+ */
+static void compileRules(void) {
+    for (int op = 0; op < RiscvInstr::NUM_OPCODES; ++op) {
+        int n = 0;
+        for (int k = 0; k < NUM_RULES; ++k)
+            if (rules[k].ops[0] & ((OpSet)1 << op))
+                first_index[op][n++] = k;
+        first_index[op][n] = -1;
+    }
+    compiled = true;
+}
+
+/* Performs a peephole optimization pass to the instruction sequence.
+ *
+ * PARAMETERS:
+ *   iseq  - the instruction sequence to optimize (the code of a whole
+ *           function, including the labels of the basic blocks)
+ * NOTE:
+ *   the rules are applied until none of them matches.
+ */
+void RiscvDesc::simplePeephole(RiscvInstr *iseq) {
+    Window w;
+    bool changed = true;
+
+    if (!compiled)
+        compileRules();
+    w.reg = _reg;
+
+    while (changed) {
+        changed = false;
+        for (RiscvInstr *i = iseq; NULL != i; i = i->next) {
+            if (i->cancelled)
+                continue;
+
+            // fills the window
+            int n = 0;
+            for (RiscvInstr *j = i; NULL != j && n < MAX_WINDOW; j = j->next)
+                if (!j->cancelled)
+                    w.i[n++] = j;
+            for (; n < MAX_WINDOW; ++n)
+                w.i[n] = NULL;
+
+            for (int *k = first_index[i->op_code]; *k >= 0; ++k) {
+                PeepholeRule *r = &rules[*k];
+                bool match = true;
+                for (int p = 1; p < r->length && match; ++p)
+                    match = (NULL != w.i[p] &&
+                             0 != (r->ops[p] & ((OpSet)1 << w.i[p]->op_code)));
+
+                if (match && r->action(w)) {
+                    ++r->hits;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/* Prints how many times every peephole rule has been applied.
+ *
+ * PARAMETERS:
+ *   os    - the output stream
+ */
+void RiscvDesc::dumpPeepholeStats(std::ostream &os) {
+    os << "* PEEPHOLE:" << std::endl;
+    for (int k = 0; k < NUM_RULES; ++k)
+        os << "    " << std::left << std::setw(16) << rules[k].name
+           << rules[k].hits << std::endl;
+}
@@ -0,0 +1,291 @@
+/*****************************************************
+ *  Global Register Allocator of RiscvDesc.
+ *
+ *  When optimization is enabled (-O), the temporary variables are assigned
+ *  registers for the whole function with the linear scan algorithm
+ *  (Poletto & Sarkar, "Linear Scan Register Allocation", TOPLAS 1999),
+ *  so that they don't have to be saved/reloaded at every block boundary.
+ *
+ *  Variables that cannot get a register are left to the per-block allocator
+ *  (see getRegForRead/getRegForWrite in asm/riscv_md.cpp), which works with
+ *  the registers not handed out here and the RiscvStackFrameManager slots.
+ */
+
+#include "asm/riscv_md.hpp"
+#include "3rdparty/vector.hpp"
+#include "config.hpp"
+#include "options.hpp"
+#include "tac/flow_graph.hpp"
+#include "tac/tac.hpp"
+
+#include <algorithm>
+#include <vector>
+
+using namespace mind::assembly;
+using namespace mind::tac;
+using namespace mind::util;
+using namespace mind;
+
+// the registers handed out by the global allocator (in order of preference).
+// t0, t1 and t2 are kept for the per-block allocator to load spilled variables.
+static const int alloc_order[] = {
+    RiscvReg::T3, RiscvReg::T4, RiscvReg::T5, RiscvReg::T6,
+    RiscvReg::S1, RiscvReg::S2, RiscvReg::S3, RiscvReg::S4,
+    RiscvReg::S5, RiscvReg::S6, RiscvReg::S7, RiscvReg::S8,
+    RiscvReg::S9, RiscvReg::S10, RiscvReg::S11};
+
+// the order of preference for variables alive across a call: the
+// callee-saved registers first, so that the caller doesn't have to save them
+static const int alloc_order_across_calls[] = {
+    RiscvReg::S1, RiscvReg::S2, RiscvReg::S3, RiscvReg::S4,
+    RiscvReg::S5, RiscvReg::S6, RiscvReg::S7, RiscvReg::S8,
+    RiscvReg::S9, RiscvReg::S10, RiscvReg::S11,
+    RiscvReg::T3, RiscvReg::T4, RiscvReg::T5, RiscvReg::T6};
+
+#define NUM_ALLOC_REGS ((int)(sizeof(alloc_order) / sizeof(alloc_order[0])))
+
+// with the compressed instructions (-march=...c), a2-a5 (x12-x15, which
+// most 16-bit forms can name) are handed out first, but only to the
+// intervals which overlap no call: neither the passing of the arguments,
+// nor a runtime routine (see asm/riscv_runtime.cpp), nor the entry
+static const int rvc_order[] = {RiscvReg::A2, RiscvReg::A3, RiscvReg::A4,
+                                RiscvReg::A5};
+
+#define NUM_RVC_REGS ((int)(sizeof(rvc_order) / sizeof(rvc_order[0])))
+
+namespace {
+// the live interval of a temporary variable
+struct LiveInterval {
+    Temp var;          // the temporary variable
+    int start;         // the first position where it is alive
+    int end;           // the last position where it is alive
+    bool across_calls; // whether it is alive across some call
+    bool rvc;          // whether it may be assigned a2-a5
+};
+
+// builds the live intervals (numbering the TACs on the fly)
+class IntervalBuilder {
+  public:
+    Vector<LiveInterval> intervals;
+
+    IntervalBuilder(FlowGraph *g) : g(g), where(g->numTemps(), -1) {}
+
+    // marks variable v alive at position pos
+    void cover(Temp v, int pos) {
+        if (NULL != v)
+            cover(v->id, pos);
+    }
+
+    // marks every variable of the set alive at position pos
+    void cover(BitSet *s, int pos) {
+        for (BitSet::iterator it = s->begin(); it != s->end(); ++it)
+            cover(*it, pos);
+    }
+
+  private:
+    FlowGraph *g;
+    std::vector<int> where; // variable id -> index of its interval (or -1)
+
+    void cover(size_t id, int pos) {
+        if (where[id] < 0) {
+            where[id] = intervals.size();
+            intervals.push_back(
+                LiveInterval{g->getTemp(id), pos, pos, false, false});
+        } else {
+            LiveInterval &i = intervals[where[id]];
+            i.start = std::min(i.start, pos);
+            i.end = std::max(i.end, pos);
+        }
+    }
+};
+} // namespace
+
+// whether a register is handed out only to the intervals overlapping no call
+static bool isRvcOnly(int r) {
+    for (int k = 0; k < NUM_RVC_REGS; ++k)
+        if (rvc_order[k] == r)
+            return true;
+
+    return false;
+}
+
+// interval comparators
+static bool start_less(LiveInterval *a, LiveInterval *b) {
+    return a->start < b->start ||
+           (a->start == b->start && a->var->id < b->var->id);
+}
+
+static bool end_less(LiveInterval *a, LiveInterval *b) {
+    return a->end < b->end;
+}
+
+/* Gets the variable defined by a TAC.
+ *
+ * PARAMETERS:
+ *   t     - the TAC
+ * RETURNS:
+ *   the defined variable (NULL if none)
+ */
+static Temp defOf(Tac *t) {
+    switch (t->op_code) {
+    case Tac::PUSH:
+    case Tac::PARAM:
+        return NULL;
+
+    default:
+        return t->op0.var;
+    }
+}
+
+/* Assigns registers to the temporary variables of a function.
+ *
+ * PARAMETERS:
+ *   g     - the control-flow graph (liveness should have been analyzed,
+ *           including the dead operands of every TAC)
+ * NOTE:
+ *   the result is recorded in TempObject::reg (0 means "no register"), and
+ *   the callee-saved registers in use are appended to _saved_regs.
+ *   since a live interval is the hull of all the positions where the variable
+ *   is alive, the allocation is valid whatever the control-flow looks like.
+ */
+void RiscvDesc::allocateRegisters(FlowGraph *g) {
+    IntervalBuilder builder(g);
+    Vector<int> calls;      // the positions of the calls
+    Vector<int> call_seqs;  // the positions where the call sequences start
+    Vector<int> call_seq_ends; // ... and end (the runtime routines included)
+    bool rvc = (0 != (_isa & Option::EXT_C));
+    int pos = 0;
+
+    // the registers handed out here are no longer seen by the local allocator
+    for (int k = 0; k < NUM_ALLOC_REGS; ++k)
+        _reg[alloc_order[k]]->global = true;
+    for (int k = 0; k < NUM_RVC_REGS && rvc; ++k)
+        _reg[rvc_order[k]]->global = true;
+
+    // Step 1. numbers the TACs and builds the intervals. every TAC covers
+    //         both its live-in (so that operands survive until they have
+    //         been read) and its live-out variables.
+    for (FlowGraph::iterator it = g->begin(); it != g->end(); ++it) {
+        BasicBlock *b = *it;
+        LiveCursor cursor(b);
+
+        builder.cover(cursor.live(), pos++);
+        for (Tac *t = b->tac_chain; t != NULL; t = t->next) {
+            builder.cover(cursor.live(), pos);
+            if (Tac::CALL == t->op_code)
+                calls.push_back(pos);
+            if (Tac::PARAM == t->op_code &&
+                (NULL == t->prev || Tac::PARAM != t->prev->op_code))
+                call_seqs.push_back(pos);
+            if (Tac::CALL == t->op_code || needsRuntime(t)) {
+                if (call_seqs.size() == call_seq_ends.size())
+                    call_seqs.push_back(pos); // (no arguments)
+                call_seq_ends.push_back(pos);
+            }
+            cursor.advance(t);
+            builder.cover(cursor.live(), pos);
+            builder.cover(defOf(t), pos);
+            ++pos;
+        }
+        builder.cover(b->LiveOut, pos);
+        if (BasicBlock::BY_JUMP != b->end_kind)
+            builder.cover(b->var, pos);
+        ++pos;
+    }
+
+    // an interval is across a call if the call is strictly inside it
+    // (the result of the call is defined at the very position of the call)
+    Vector<LiveInterval *> order;
+    for (size_t k = 0; k < builder.intervals.size(); ++k) {
+        LiveInterval *i = &builder.intervals[k];
+        Vector<int>::iterator c =
+            std::upper_bound(calls.begin(), calls.end(), i->start);
+        i->across_calls = (c != calls.end() && *c < i->end);
+        // (the result of a call is defined after the call sequence)
+        i->rvc = rvc && i->start > 0;
+        for (size_t s = 0; s < call_seq_ends.size() && i->rvc; ++s)
+            i->rvc = (i->start >= call_seq_ends[s] || i->end < call_seqs[s]);
+        order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), start_less);
+
+    // Step 2. scans the intervals by their start positions
+    Vector<LiveInterval *> active; // sorted by the end positions
+    bool available[RiscvReg::TOTAL_NUM];
+
+    for (int k = 0; k < RiscvReg::TOTAL_NUM; ++k)
+        available[k] = false;
+    for (int k = 0; k < NUM_ALLOC_REGS; ++k) // (t6 may be reserved)
+        available[alloc_order[k]] = _reg[alloc_order[k]]->general;
+    for (int k = 0; k < NUM_RVC_REGS; ++k)
+        available[rvc_order[k]] = rvc;
+
+    for (Vector<LiveInterval *>::iterator it = order.begin(); it != order.end();
+         ++it) {
+        LiveInterval *cur = *it;
+        // the constants are loaded where they are used (see asm/riscv_imm.cpp)
+        if (cur->var->is_const)
+            continue;
+
+        // expires the old intervals
+        while (!active.empty() && active.front()->end < cur->start) {
+            available[active.front()->var->reg] = true;
+            active.erase(active.begin());
+        }
+
+        const int *pref =
+            cur->across_calls ? alloc_order_across_calls : alloc_order;
+        int r = 0;
+        for (int k = 0; k < NUM_RVC_REGS && 0 == r && cur->rvc; ++k)
+            if (available[rvc_order[k]])
+                r = rvc_order[k];
+        for (int k = 0; k < NUM_ALLOC_REGS && 0 == r; ++k)
+            if (available[pref[k]])
+                r = pref[k];
+
+        if (0 == r) {
+            // no free register: spills the interval that ends last (among
+            // those whose register cur may take)
+            Vector<LiveInterval *>::iterator last = active.end();
+            do {
+                --last;
+            } while (last != active.begin() && !cur->rvc &&
+                     isRvcOnly((*last)->var->reg));
+            if ((*last)->end <= cur->end ||
+                (!cur->rvc && isRvcOnly((*last)->var->reg))) {
+                cur->var->reg = 0;
+                continue;
+            }
+            r = (*last)->var->reg;
+            (*last)->var->reg = 0;
+            active.erase(last);
+        }
+
+        cur->var->reg = r;
+        available[r] = false;
+        active.insert(std::upper_bound(active.begin(), active.end(), cur,
+                                       end_less),
+                      cur);
+    }
+
+    // Step 3. collects the callee-saved registers to save in the prologue
+    bool used[RiscvReg::TOTAL_NUM];
+
+    for (int k = 0; k < RiscvReg::TOTAL_NUM; ++k)
+        used[k] = false;
+    for (size_t k = 0; k < builder.intervals.size(); ++k)
+        used[builder.intervals[k].var->reg] = true;
+
+    for (int k = 0; k < NUM_ALLOC_REGS; ++k)
+        if (used[alloc_order_across_calls[k]] &&
+            _reg[alloc_order_across_calls[k]]->callee_saved)
+            _saved_regs.push_back(alloc_order_across_calls[k]);
+}
+
+/* Gets how many registers the variables may be assigned.
+ *
+ * RETURNS:
+ *   the number of registers handed out by the global allocator (the passes
+ *   on TACs use it to estimate when the variables would be spilled)
+ */
+int RiscvDesc::numAllocatableRegs(void) { return NUM_ALLOC_REGS; }
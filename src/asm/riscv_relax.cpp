@@ -0,0 +1,213 @@
+/*****************************************************
+ *  Branch Relaxation of RiscvDesc.
+ *
+ *  A conditional branch reaches only +-4 KiB, and "j" (i.e. jal) +-1 MiB,
+ *  which a very large function may exceed. So the instructions of a
+ *  function are laid out with their sizes, and
+ *    - a conditional branch which doesn't reach its target is inverted to
+ *      skip a "j" to the target:
+ *          beq a, b, far   =>   bne a, b, next
+ *                               j far
+ *                           next:
+ *    - a "j" which doesn't reach is output as "jump" instead (auipc and
+ *      jalr through a7, which never holds a variable across TACs);
+ *    - a compressed jump (see asm/riscv_compress.cpp) which doesn't reach
+ *      is output in 32 bits.
+ *  Every jump starts in its shortest form, and the layout is done again
+ *  after every change until all the jumps reach. Since a jump only grows,
+ *  this comes to an end.
+ *
+ *  The jumps to other functions (the tail calls) and the calls of the
+ *  runtime routines are left to the assembler and the linker.
+ */
+
+#include "asm/riscv_md.hpp"
+#include "config.hpp"
+#include "options.hpp"
+
+#include <iomanip>
+#include <map>
+
+using namespace mind::assembly;
+using namespace mind;
+
+// the statistics (of all the functions)
+static int num_long_branches = 0;
+static int num_long_jumps = 0;
+static int num_layouts = 0;
+
+// gets the inverse of a conditional branch
+static RiscvInstr::OpCode invertBranch(RiscvInstr::OpCode op) {
+    switch (op) {
+    case RiscvInstr::BEQZ:
+        return RiscvInstr::BNEZ;
+
+    case RiscvInstr::BNEZ:
+        return RiscvInstr::BEQZ;
+
+    case RiscvInstr::BEQ:
+        return RiscvInstr::BNE;
+
+    case RiscvInstr::BNE:
+        return RiscvInstr::BEQ;
+
+    case RiscvInstr::BLT:
+        return RiscvInstr::BGE;
+
+    case RiscvInstr::BGE:
+        return RiscvInstr::BLT;
+
+    case RiscvInstr::BLTU:
+        return RiscvInstr::BGEU;
+
+    case RiscvInstr::BGEU:
+        return RiscvInstr::BLTU;
+
+    default:
+        mind_assert(false); // not a conditional branch
+        return op;
+    }
+}
+
+// whether an instruction is a conditional branch
+static bool isBranch(RiscvInstr *i) {
+    switch (i->op_code) {
+    case RiscvInstr::BEQZ:
+    case RiscvInstr::BNEZ:
+    case RiscvInstr::BEQ:
+    case RiscvInstr::BNE:
+    case RiscvInstr::BLT:
+    case RiscvInstr::BGE:
+    case RiscvInstr::BLTU:
+    case RiscvInstr::BGEU:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+/* Gets the size of an instruction.
+ *
+ * PARAMETERS:
+ *   i     - the instruction
+ * RETURNS:
+ *   the size in bytes (that of the expansion of a pseudo one, see
+ *   asm/riscv_encode.cpp)
+ */
+int RiscvDesc::getInstrSize(RiscvInstr *i) {
+    if (i->cancelled)
+        return 0;
+    if (i->compressed)
+        return 2;
+
+    switch (i->op_code) {
+    case RiscvInstr::COMMENT:
+    case RiscvInstr::LABEL:
+        return 0;
+
+    case RiscvInstr::LI:
+        // (lui + addi, or lui alone for a multiple of 4096)
+        return (fitsBits(i->i, 12) || 0 == (i->i & 0xfff)) ? 4 : 8;
+
+    case RiscvInstr::LA:
+    case RiscvInstr::CALL:
+    case RiscvInstr::JUMP:
+        return 8; // (auipc + addi/jalr)
+
+    default:
+        return 4;
+    }
+}
+
+/* Rewrites the jumps of a function which don't reach their targets.
+ *
+ * PARAMETERS:
+ *   i     - the instruction sequence of the function
+ * RETURNS:
+ *   the size of the function in bytes
+ */
+int RiscvDesc::relaxBranches(RiscvInstr *i) {
+    std::map<std::string, int> where; // label -> address
+    bool changed = true;
+    int pc = 0;
+
+    while (changed) {
+        changed = false;
+        ++num_layouts;
+        where.clear();
+        pc = 0;
+        for (RiscvInstr *p = i; NULL != p; p = p->next) {
+            if (RiscvInstr::LABEL == p->op_code && !p->cancelled)
+                where[p->l] = pc;
+            pc += getInstrSize(p);
+        }
+
+        // (every decision is taken on the same layout: since a jump only
+        // gets farther from its target as the code grows, it is never
+        // taken back)
+        pc = 0;
+        for (RiscvInstr *p = i; NULL != p; p = p->next) {
+            int size = getInstrSize(p);
+            if (p->cancelled ||
+                (RiscvInstr::J != p->op_code && !isBranch(p))) {
+                pc += size;
+                continue;
+            }
+
+            std::map<std::string, int>::iterator it = where.find(p->l);
+            int dist = (it == where.end()) ? 0 : it->second - pc;
+            if (p->compressed &&
+                (it == where.end() ||
+                 !fitsBits(dist, (RiscvInstr::J == p->op_code) ? 12 : 9))) {
+                p->compressed = false;
+                changed = true;
+            } else if (it == where.end()) {
+                // (another function)
+            } else if (RiscvInstr::J == p->op_code && !fitsBits(dist, 21)) {
+                p->op_code = RiscvInstr::JUMP;
+                ++num_long_jumps;
+                changed = true;
+            } else if (isBranch(p) && !fitsBits(dist, 13)) {
+                // skips a jump to the target
+                RiscvInstr *j = new RiscvInstr();
+                RiscvInstr *next = new RiscvInstr();
+                j->op_code = RiscvInstr::J;
+                j->l = p->l;
+                next->op_code = RiscvInstr::LABEL;
+                next->l = getNewLabel();
+                next->next = p->next;
+                j->next = next;
+                p->next = j;
+                p->op_code = invertBranch(p->op_code);
+                p->l = next->l;
+                // (both in their shortest forms, if any)
+                if (0 != (_isa & Option::EXT_C)) {
+                    p->compressed = (0 != getRvcForm(p));
+                    j->compressed = (0 != getRvcForm(j));
+                }
+                ++num_long_branches;
+                changed = true;
+                p = next; // (the jump is checked in the next layout)
+            }
+            pc += size;
+        }
+    }
+
+    return pc;
+}
+
+/* Prints the statistics of the branch relaxation (of all the functions).
+ *
+ * PARAMETERS:
+ *   os    - the output stream
+ */
+void RiscvDesc::dumpRelaxStats(std::ostream &os) {
+    os << "* RELAXATION:" << std::endl;
+    os << "    " << std::left << std::setw(16) << "long branches"
+       << num_long_branches << std::endl;
+    os << "    " << std::left << std::setw(16) << "long jumps"
+       << num_long_jumps << std::endl;
+    os << "    " << std::left << std::setw(16) << "layouts" << num_layouts
+       << std::endl;
+}
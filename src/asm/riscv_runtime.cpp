@@ -0,0 +1,219 @@
+/*****************************************************
+ *  Software Multiplication and Division of RiscvDesc.
+ *
+ *  Without the M extension (e.g. -march=rv32i), a MUL, DIV or MOD which is
+ *  not translated into shifts (see asm/riscv_imm.cpp) calls one of the
+ *  runtime routines below, which are appended to the output if called:
+ *    __mind_mul:    a0 = a0 * a1, by shifts and additions;
+ *    __mind_divmod: a0 = a0 / a1 and a1 = a0 % a1, by the restoring
+ *                   division of the magnitudes (with the results of "div"
+ *                   and "rem" for a divisor of 0, and for INT_MIN / -1).
+ *  They have a convention of their own: nothing but a0-a7 is clobbered
+ *  (and ra, by the call). Since a0-a7 never hold a variable across TACs,
+ *  the caller keeps all its registers, so the call is not a call for the
+ *  register allocators or the peephole optimizer (see JAL). Only ra has to
+ *  be saved in the frame (see prepareFrame).
+ */
+
+#include "asm/riscv_md.hpp"
+#include "config.hpp"
+#include "options.hpp"
+#include "tac/tac.hpp"
+
+using namespace mind::assembly;
+using namespace mind::tac;
+using namespace mind;
+
+// the runtime routines (bits of _runtime_used)
+#define RT_MUL 1
+#define RT_DIVMOD 2
+
+#define MUL_NAME "__mind_mul"
+#define DIVMOD_NAME "__mind_divmod"
+
+// gets a local label of a runtime routine
+static std::string localLabel(const char *name, int k) {
+    return std::string(name) + "_" + std::to_string(k);
+}
+
+/* Tests whether a TAC calls a runtime routine.
+ *
+ * PARAMETERS:
+ *   t     - the TAC
+ * RETURNS:
+ *   true if t is a MUL, DIV or MOD and the target has no M extension
+ * NOTE:
+ *   a multiplication by a constant, or a division by a constant other than
+ *   0, is done by shifts and additions instead (see emitMulDivImmTac). it
+ *   relies on findConstants, and so is valid after it only.
+ */
+bool RiscvDesc::needsRuntime(Tac *t) {
+    if (0 != (_isa & Option::EXT_M))
+        return false;
+
+    switch (t->op_code) {
+    case Tac::MUL:
+        return !t->op1.var->is_const && !t->op2.var->is_const;
+
+    case Tac::DIV:
+    case Tac::MOD:
+        return !t->op2.var->is_const || 0 == t->op2.var->value;
+
+    default:
+        return false;
+    }
+}
+
+/* Translates a MUL, DIV or MOD TAC into a call of a runtime routine.
+ *
+ * PARAMETERS:
+ *   t     - the TAC
+ */
+void RiscvDesc::emitRuntimeTac(Tac *t) {
+    // eliminates useless computations
+    if (!_live->contains(t->op0.var->id))
+        return;
+
+    RiscvReg *a0 = _reg[RiscvReg::A0], *a1 = _reg[RiscvReg::A1];
+    // (the operands are kept alive until both of them are in registers)
+    bool live1 = _live->contains(t->op1.var->id);
+    bool live2 = _live->contains(t->op2.var->id);
+    _live->add(t->op1.var->id);
+    _live->add(t->op2.var->id);
+    int r1 = getRegForRead(t->op1.var, 0, _live);
+    int r2 = getRegForRead(t->op2.var, r1, _live);
+    if (!live1)
+        _live->remove(t->op1.var->id);
+    if (!live2)
+        _live->remove(t->op2.var->id);
+
+    addInstr(RiscvInstr::MOVE, a0, _reg[r1], NULL, 0, std::string(), NULL);
+    addInstr(RiscvInstr::MOVE, a1, _reg[r2], NULL, 0, std::string(), NULL);
+    if (Tac::MUL == t->op_code) {
+        _runtime_used |= RT_MUL;
+        addInstr(RiscvInstr::JAL, NULL, a0, a1, 0, MUL_NAME, NULL);
+    } else {
+        _runtime_used |= RT_DIVMOD;
+        addInstr(RiscvInstr::JAL, NULL, a0, a1, 0, DIVMOD_NAME, NULL);
+    }
+
+    int r0 = getRegForWrite(t->op0.var, 0, 0, _live);
+    addInstr(RiscvInstr::MOVE, _reg[r0], (Tac::MOD == t->op_code) ? a1 : a0,
+             NULL, 0, std::string(), NULL);
+}
+
+/* Outputs the runtime routines called.
+ *
+ * NOTE:
+ *   the routines are built as instruction sequences, just like the code of
+ *   a function, and printed (or encoded) the same way.
+ */
+void RiscvDesc::emitRuntime(void) {
+    RiscvReg *zero = _reg[RiscvReg::ZERO];
+    RiscvReg *a0 = _reg[RiscvReg::A0], *a1 = _reg[RiscvReg::A1],
+             *a2 = _reg[RiscvReg::A2], *a3 = _reg[RiscvReg::A3],
+             *a4 = _reg[RiscvReg::A4], *a5 = _reg[RiscvReg::A5],
+             *a6 = _reg[RiscvReg::A6], *a7 = _reg[RiscvReg::A7];
+    std::string none;
+
+    for (int rt = RT_MUL; rt <= RT_DIVMOD; rt <<= 1) {
+        if (0 == (_runtime_used & rt))
+            continue;
+
+        const char *name = (RT_MUL == rt) ? MUL_NAME : DIVMOD_NAME;
+        RiscvInstr leading;
+        _tail = &leading;
+
+        if (RT_MUL == rt) {
+            // a2 = the multiplicand shifted, a1 = the multiplier shifted
+            addInstr(RiscvInstr::MOVE, a2, a0, NULL, 0, none, NULL);
+            addInstr(RiscvInstr::LI, a0, NULL, NULL, 0, none, NULL);
+            addInstr(RiscvInstr::LABEL, NULL, NULL, NULL, 0,
+                     localLabel(name, 1), NULL);
+            addInstr(RiscvInstr::ANDI, a3, a1, NULL, 1, none, NULL);
+            addInstr(RiscvInstr::BEQZ, a3, NULL, NULL, 0, localLabel(name, 2),
+                     NULL);
+            addInstr(RiscvInstr::ADD, a0, a0, a2, 0, none, NULL);
+            addInstr(RiscvInstr::LABEL, NULL, NULL, NULL, 0,
+                     localLabel(name, 2), NULL);
+            addInstr(RiscvInstr::SLLI, a2, a2, NULL, 1, none, NULL);
+            addInstr(RiscvInstr::SRLI, a1, a1, NULL, 1, none, NULL);
+            addInstr(RiscvInstr::BNEZ, a1, NULL, NULL, 0, localLabel(name, 1),
+                     NULL);
+            addInstr(RiscvInstr::RET, NULL, NULL, NULL, 0, none, NULL);
+
+        } else {
+            // the division by 0
+            addInstr(RiscvInstr::BNEZ, a1, NULL, NULL, 0, localLabel(name, 1),
+                     NULL);
+            addInstr(RiscvInstr::MOVE, a1, a0, NULL, 0, none, NULL);
+            addInstr(RiscvInstr::LI, a0, NULL, NULL, -1, none, NULL);
+            addInstr(RiscvInstr::RET, NULL, NULL, NULL, 0, none, NULL);
+            // a2 = the sign of the quotient, a3 = the sign of the remainder
+            addInstr(RiscvInstr::LABEL, NULL, NULL, NULL, 0,
+                     localLabel(name, 1), NULL);
+            addInstr(RiscvInstr::XOR, a2, a0, a1, 0, none, NULL);
+            addInstr(RiscvInstr::MOVE, a3, a0, NULL, 0, none, NULL);
+            addInstr(RiscvInstr::BGE, a0, zero, NULL, 0, localLabel(name, 2),
+                     NULL);
+            addInstr(RiscvInstr::NEG, a0, a0, NULL, 0, none, NULL);
+            addInstr(RiscvInstr::LABEL, NULL, NULL, NULL, 0,
+                     localLabel(name, 2), NULL);
+            addInstr(RiscvInstr::BGE, a1, zero, NULL, 0, localLabel(name, 3),
+                     NULL);
+            addInstr(RiscvInstr::NEG, a1, a1, NULL, 0, none, NULL);
+            // a4 = the quotient, a5 = the remainder (of the magnitudes, one
+            // bit of the dividend at a time, a6 = the bits left)
+            addInstr(RiscvInstr::LABEL, NULL, NULL, NULL, 0,
+                     localLabel(name, 3), NULL);
+            addInstr(RiscvInstr::LI, a4, NULL, NULL, 0, none, NULL);
+            addInstr(RiscvInstr::LI, a5, NULL, NULL, 0, none, NULL);
+            addInstr(RiscvInstr::LI, a6, NULL, NULL, 32, none, NULL);
+            addInstr(RiscvInstr::LABEL, NULL, NULL, NULL, 0,
+                     localLabel(name, 4), NULL);
+            addInstr(RiscvInstr::SRLI, a7, a0, NULL, 31, none, NULL);
+            addInstr(RiscvInstr::SLLI, a5, a5, NULL, 1, none, NULL);
+            addInstr(RiscvInstr::OR, a5, a5, a7, 0, none, NULL);
+            addInstr(RiscvInstr::SLLI, a0, a0, NULL, 1, none, NULL);
+            addInstr(RiscvInstr::SLLI, a4, a4, NULL, 1, none, NULL);
+            addInstr(RiscvInstr::BLTU, a5, a1, NULL, 0, localLabel(name, 5),
+                     NULL);
+            addInstr(RiscvInstr::SUB, a5, a5, a1, 0, none, NULL);
+            addInstr(RiscvInstr::ORI, a4, a4, NULL, 1, none, NULL);
+            addInstr(RiscvInstr::LABEL, NULL, NULL, NULL, 0,
+                     localLabel(name, 5), NULL);
+            addInstr(RiscvInstr::ADDI, a6, a6, NULL, -1, none, NULL);
+            addInstr(RiscvInstr::BNEZ, a6, NULL, NULL, 0, localLabel(name, 4),
+                     NULL);
+            // the signs
+            addInstr(RiscvInstr::MOVE, a0, a4, NULL, 0, none, NULL);
+            addInstr(RiscvInstr::BGE, a2, zero, NULL, 0, localLabel(name, 6),
+                     NULL);
+            addInstr(RiscvInstr::NEG, a0, a0, NULL, 0, none, NULL);
+            addInstr(RiscvInstr::LABEL, NULL, NULL, NULL, 0,
+                     localLabel(name, 6), NULL);
+            addInstr(RiscvInstr::MOVE, a1, a5, NULL, 0, none, NULL);
+            addInstr(RiscvInstr::BGE, a3, zero, NULL, 0, localLabel(name, 7),
+                     NULL);
+            addInstr(RiscvInstr::NEG, a1, a1, NULL, 0, none, NULL);
+            addInstr(RiscvInstr::LABEL, NULL, NULL, NULL, 0,
+                     localLabel(name, 7), NULL);
+            addInstr(RiscvInstr::RET, NULL, NULL, NULL, 0, none, NULL);
+        }
+        _tail = NULL;
+        if (0 != (_isa & Option::EXT_C)) // (the 16-bit instructions)
+            compressInstrs(leading.next, name);
+        else
+            relaxBranches(leading.next);
+        if (NULL != _obj) { // (see asm/riscv_encode.cpp)
+            encodeFuncty(name, leading.next);
+            continue;
+        }
+
+        emit(std::string(), NULL, NULL); // an empty line
+        emit(std::string(), ".text", NULL);
+        emit(name, NULL, "runtime routine");
+        for (RiscvInstr *i = leading.next; NULL != i; i = i->next)
+            emitInstr(i);
+    }
+}
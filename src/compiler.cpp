@@ -14,6 +14,7 @@
 #include "tac/tac.hpp"
 
 #include "tac/flow_graph.hpp"
+#include "tac/inliner.hpp"
 
 using namespace mind;
 using namespace mind::assembly;
@@ -95,6 +96,10 @@ void MindCompiler::compile(const char *input, std::ostream &result) {
         result.flush();
         return;
     }
+    // inlining the calls (on the whole program, before the functions are
+    // translated one by one)
+    if (Option::doOptimize())
+        ir = tac::Inliner(ir).inlineCalls();
     // translating to assembly code (now let's go to MipsDesc::emitPieces)
     //把程序描绘为许多串，每个串都是piece
     //3.后端
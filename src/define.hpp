@@ -129,6 +129,12 @@ class TransHelper;
 }
 #endif
 
+#ifndef MIND_INLINER_DEFINED
+namespace tac {
+class Inliner;
+}
+#endif
+
 #ifndef MIND_FLOWGRAPH_DEFINED
 namespace tac {
 struct BasicBlock;
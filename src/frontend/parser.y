@@ -167,7 +167,7 @@ ParameterList : Type IDENTIFIER
                 { $$ = new ast::VarList();
                   $$->append(new ast::VarDecl($2, $1, POS(@1))); }
             |   Type IDENTIFIER COMMA ParameterList
-                { $4->append(new ast::VarDecl($2, $1, POS(@1))); 
+                { $4->addAtHead(new ast::VarDecl($2, $1, POS(@1))); 
                   $$ = $4;
                 }
 
@@ -254,7 +254,7 @@ ExprList    : Expr
                   $$->append($1);
                 }
             | Expr COMMA ExprList
-                { $3->append($1);
+                { $3->addAtHead($1);
                   $$ = $3;
                 }
             ;
@@ -38,7 +38,8 @@ int main(int argc, char **argv) {
         c->compile(Option::getInput(), std::cout);
         std::cout.flush();
     } else {
-        std::ofstream fout(Option::getOutput());
+        // (binary, for the object files)
+        std::ofstream fout(Option::getOutput(), std::ios::binary);
         c->compile(Option::getInput(), fout);
         fout.flush();
         fout.close();
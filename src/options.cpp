@@ -30,6 +30,15 @@ const char *Option::output = NULL;
 // Whether to do extra optimization
 bool Option::optimize = false;
 
+// Whether to print the statistics of the optimizer
+bool Option::statistics = false;
+
+// The ISA extensions of the target (-1 until "-march" is resolved)
+int Option::extensions = -1;
+
+// The type of the output file
+Option::file_t Option::filetype = FILE_ASM;
+
 /* Gets the current developing level.
  *
  * RETURNS:
@@ -51,6 +60,27 @@ Option::opt_t Option::getArch(void) { return arch; }
  */
 bool Option::doOptimize(void) { return optimize; }
 
+/* Gets whether the statistics of the optimizer will be printed.
+ *
+ * RETURNS:
+ *   whether to print the statistics (to stderr)
+ */
+bool Option::showStatistics(void) { return statistics; }
+
+/* Gets the ISA extensions of the target.
+ *
+ * RETURNS:
+ *   the extensions available (a bit set of ext_t)
+ */
+int Option::getExtensions(void) { return extensions; }
+
+/* Gets the type of the output file.
+ *
+ * RETURNS:
+ *   assembly code, an object file or the disassembly of it
+ */
+Option::file_t Option::getFileType(void) { return filetype; }
+
 /* Gets the input file name.
  *
  * RETURNS:
@@ -71,7 +101,8 @@ const char *Option::getOutput(void) { return output; }
 static void showUsage(void) {
     std::cout
         << std::endl
-        << "Usage: mdc [-l LEVEL] [-m ARCH] [-o OUTPUT] [-O] SOURCE"
+        << "Usage: mdc [-l LEVEL] [-m ARCH] [-march=ISA] [-c] [-filetype=TYPE] "
+           "[-o OUTPUT] [-O] [-s] SOURCE"
         << std::endl
         << "Options:" << std::endl
         << "  -l  Specifying the developing level, where LEVEL is one of:"
@@ -84,12 +115,77 @@ static void showUsage(void) {
         << "  -m  Specifying the target architecture, where ARCH is one of:"
         << std::endl
         << "      riscv(DEFAULT), mips, x86, ppc" << std::endl
+        << "  -march=ISA  Specifying the RISC-V extensions, where ISA is"
+        << std::endl
+        << "      rv32i or rv32g, followed by the letters of m, a, f, d, c,"
+        << std::endl
+        << "      and then _zba, _zbb, _zicond (DEFAULT: rv32im)" << std::endl
+        << "  -c  Output an ELF relocatable object (same as -filetype=obj)."
+        << std::endl
+        << "  -filetype=TYPE  Specifying the output, where TYPE is one of:"
+        << std::endl
+        << "      asm (assembly code. DEFAULT), obj (ELF relocatable object),"
+        << std::endl
+        << "      dis (disassembly of the object code)" << std::endl
         << "  -o  Specifying the name of the output file (DEFAULT: stdout)."
         << std::endl
         << "  -O  Turn on compiler optimization (DEFAULT: off)." << std::endl
+        << "  -s  Print the statistics of the optimizer to stderr." << std::endl
         << "" << std::endl;
 }
 
+/* Parses an ISA string (the argument of "-march").
+ *
+ * PARAMETERS:
+ *   isa   - the ISA string, e.g. "rv32imc_zba_zbb"
+ * RETURNS:
+ *   the extensions (a bit set of ext_t), or -1 if it is malformed
+ * NOTE:
+ *   the extensions the compiler never uses (a, f and d) are accepted, but
+ *   not recorded.
+ */
+static int parseIsa(const char *isa) {
+    const char *single = "mafdc"; // (in the canonical order)
+    int ext = 0;
+
+    if (strncmp(isa, "rv32", 4) != 0)
+        return -1;
+    isa += 4;
+    if ('g' == *isa) { // (imafd)
+        ext |= Option::EXT_M;
+        single = "c";
+    } else if ('i' != *isa)
+        return -1;
+    ++isa;
+
+    for (; '\0' != *isa && '_' != *isa; ++isa) {
+        const char *p = strchr(single, *isa);
+        if (NULL == p)
+            return -1;
+        single = p + 1;
+        if ('m' == *isa)
+            ext |= Option::EXT_M;
+        else if ('c' == *isa)
+            ext |= Option::EXT_C;
+    }
+
+    while ('_' == *isa) {
+        const char *end = strchr(isa + 1, '_');
+        size_t n = (NULL == end) ? strlen(isa + 1) : (size_t)(end - isa - 1);
+        if (3 == n && strncmp(isa + 1, "zba", n) == 0)
+            ext |= Option::EXT_ZBA;
+        else if (3 == n && strncmp(isa + 1, "zbb", n) == 0)
+            ext |= Option::EXT_ZBB;
+        else if (6 == n && strncmp(isa + 1, "zicond", n) == 0)
+            ext |= Option::EXT_ZICOND;
+        else
+            return -1;
+        isa += n + 1;
+    }
+
+    return ('\0' == *isa) ? ext : -1;
+}
+
 /* Parses the command line.
  *
  * RETURNS:
@@ -129,6 +225,28 @@ void Option::parse(int argc, char **argv) {
             if (arch == UNKNOWN)
                 goto bad_option;
 
+        } else if (strncmp(argv[i], "-march=", 7) == 0) {
+            if (extensions >= 0)
+                goto dup_option;
+
+            extensions = parseIsa(argv[i] + 7);
+
+            if (extensions < 0)
+                goto bad_option;
+
+        } else if (strcmp(argv[i], "-c") == 0) {
+            filetype = FILE_OBJ;
+
+        } else if (strncmp(argv[i], "-filetype=", 10) == 0) {
+            if (strcmp(argv[i] + 10, "asm") == 0)
+                filetype = FILE_ASM;
+            else if (strcmp(argv[i] + 10, "obj") == 0)
+                filetype = FILE_OBJ;
+            else if (strcmp(argv[i] + 10, "dis") == 0)
+                filetype = FILE_DIS;
+            else
+                goto bad_option;
+
         } else if (strcmp(argv[i], "-o") == 0) {
             if (i >= argc)
                 goto bad_option;
@@ -142,6 +260,9 @@ void Option::parse(int argc, char **argv) {
         } else if (strcmp(argv[i], "-O") == 0) {
             optimize = true;
 
+        } else if (strcmp(argv[i], "-s") == 0) {
+            statistics = true;
+
         } else if (argv[i][0] == '-') {
             std::cerr << "Unknown option: '" << argv[0] << "'" << std::endl;
             showUsage();
@@ -165,6 +286,9 @@ void Option::parse(int argc, char **argv) {
     if (arch == UNKNOWN)
         arch = RISCV;
 
+    if (extensions < 0)
+        extensions = EXT_M; // rv32im
+
     return;
 
 dup_option:
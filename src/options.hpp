@@ -30,9 +30,28 @@ class Option {
         PPC
     } opt_t;
 
+    /* ISA extensions (a bit set, see "-march") */
+    typedef enum {
+        EXT_M = 1,      // integer multiplication and division
+        EXT_C = 2,      // compressed instructions
+        EXT_ZBA = 4,    // address generation (sh1add, ...)
+        EXT_ZBB = 8,    // basic bit manipulation (min, max, ...)
+        EXT_ZICOND = 16 // conditional zero (czero.eqz, czero.nez)
+    } ext_t;
+
+    /* Output file types (see "-filetype") */
+    typedef enum {
+        FILE_ASM, // assembly code
+        FILE_OBJ, // ELF relocatable object
+        FILE_DIS  // disassembly of the object code
+    } file_t;
+
     static opt_t getLevel(void);  // Gets the current developing level
     static opt_t getArch(void);   // Gets the target architecture
     static bool doOptimize(void); // Gets whether optimization will be done
+    static bool showStatistics(void); // Gets whether to print the statistics
+    static int getExtensions(void); // Gets the ISA extensions of the target
+    static file_t getFileType(void); // Gets the type of the output file
     static const char *getInput(void);
     static const char *getOutput(void);
     static void parse(int argc, char **argv); // Parses the command line
@@ -41,6 +60,9 @@ class Option {
     static opt_t level;        // Current developing level
     static opt_t arch;         // Target architecture
     static bool optimize;      // Whether optimization will be done
+    static bool statistics;    // Whether to print the optimizer statistics
+    static int extensions;     // ISA extensions of the target (ext_t bits)
+    static file_t filetype;    // Type of the output file
     static const char *input;  // Input file name
     static const char *output; // Output file name
 
@@ -1,10 +1,15 @@
 /*****************************************************
  *  Variable Liveness Analysis.
  *
- *  This file contains the implementation of the following 3 functions:
+ *  This file contains the implementation of the following 4 functions:
  *  1. BasicBlock::computeDefAndLiveUse
  *  2. FlowGraph::analyzeLiveness
  *  3. BasicBlock::analysisLiveness
+ *  4. LiveCursor (rebuilding the LiveOut set of every TAC on demand)
+ *
+ *  In SSA form, a PHI defines its variable at the entry of its block, and
+ *  every argument of it is used at the exit of the predecessor it comes
+ *  from (rather than in the block of the PHI).
  * 
  *  Of course, if you add some new Tacs, 
  *  you are supposed to update the codes at line 38 and line 176.
@@ -15,18 +20,20 @@
 #include "tac/flow_graph.hpp"
 #include "tac/tac.hpp"
 
+#include <deque>
+
 using namespace mind;
 using namespace mind::tac;
 using namespace mind::util;
 
 void BasicBlock::updateLU(Temp v) {
-    if (NULL != v && !Def->contains(v))
-        LiveUse->add(v);
+    if (NULL != v && !Def->contains(v->id))
+        LiveUse->add(v->id);
 }
 
 void BasicBlock::updateDEF(Temp v) {
     if (NULL != v)
-        Def->add(v);
+        Def->add(v->id);
 }
 
 /* Computes the DEF set and the LiveUse set of this basic block.
@@ -64,6 +71,10 @@ void BasicBlock::computeDefAndLiveUse(void) {
         case Tac::GEQ:
         case Tac::LAND:
         case Tac::LOR:
+        case Tac::MIN:
+        case Tac::MAX:
+        case Tac::KEEP_NZ:
+        case Tac::KEEP_Z:
             updateLU(t->op1.var);
             updateLU(t->op2.var);
             updateDEF(t->op0.var);
@@ -72,15 +83,19 @@ void BasicBlock::computeDefAndLiveUse(void) {
         case Tac::POP:
         case Tac::LOAD_IMM4:
         case Tac::LOAD_SYMBOL:
+        case Tac::CALL:
             updateDEF(t->op0.var);
             break;
 
         case Tac::PUSH:
         case Tac::PARAM:
-        case Tac::CALL:
             updateLU(t->op0.var);
             break;
 
+        case Tac::PHI:
+            updateDEF(t->op0.var); // (the arguments, see usePhiArgs)
+            break;
+
         default:
             mind_assert(false); // MARK, MEMO, JUMP, JZERO and RETURN will not
                                 // appear inside
@@ -103,64 +118,139 @@ void BasicBlock::computeDefAndLiveUse(void) {
     }
 }
 
+// adds the arguments of the PHIs of a block which come from a predecessor
+static void usePhiArgs(BasicBlock *b, int pred, BitSet *live) {
+    for (Tac *t = b->tac_chain; t != NULL && Tac::PHI == t->op_code;
+         t = t->next)
+        for (PhiArg a = t->args; NULL != a; a = a->next)
+            if (a->pred == pred)
+                live->add(a->var->id);
+}
+
 /* Computes the LiveIn set and LiveOut set of every basic block.
  *
  * HINT: please make sure that you understand this algorithm (and how it is
  * performed), or you might regret in your final exam...
+ *
+ * NOTE: the sets are bit-vectors indexed by the variable ids, and they are
+ *       updated in place (no set is allocated while iterating).
+ *
+ * NOTE: instead of sweeping the whole graph until nothing changes, the blocks
+ *       are taken from a worklist, which starts in postorder (successors
+ *       first) and into which only the predecessors of a block whose LiveIn
+ *       has changed are put again.
+ *
+ * RETURNS:
+ *   how many blocks have been visited (also shown in FlowGraph::dump)
  */
-void FlowGraph::analyzeLiveness(void) {
-    bool changed = false;
+int FlowGraph::analyzeLiveness(void) {
     BasicBlock *b1 = NULL, *b2 = NULL, *b = NULL;
-    Set<Temp> *newin = NULL;
+    size_t n = numTemps();
+    BitSet *newin = new BitSet(n);
+    Vector<Vector<int> > pred; // the predecessors of every block
+    Vector<int> order;         // the initial worklist
+    Vector<int> queued;        // whether a block is in the worklist
+    std::deque<int> worklist;
 
     // Step 1. computes Def and LiveUse
     for (int i = 0; i < _n; ++i) {
-        getBlock(i)->computeDefAndLiveUse();
+        b = getBlock(i);
+        b->Def = new BitSet(n);
+        b->LiveUse = new BitSet(n);
+        b->LiveIn = new BitSet(n);
+        b->LiveOut = new BitSet(n);
+        b->computeDefAndLiveUse();
     }
 
-    // Step 2. iterates
+    // Step 2. builds the predecessor lists and the worklist
+    pred.resize(_n);
+    queued.resize(_n, 0);
+    for (int i = 0; i < _n; ++i) {
+        b = getBlock(i);
+        switch (b->end_kind) {
+        case BasicBlock::BY_JZERO:
+            if (b->next[1] != b->next[0])
+                pred[b->next[1]].push_back(i);
+            // falls through
+
+        case BasicBlock::BY_JUMP:
+            pred[b->next[0]].push_back(i);
+            break;
 
-    changed = true;
-    while (changed) {
-        changed = false;
+        default:
+            break;
+        }
+    }
 
-        for (reverse_iterator rit = rbegin(); rit != rend(); ++rit) {
-            b = *rit;
+    getPostorder(order);
+    for (size_t k = 0; k < order.size(); ++k) {
+        worklist.push_back(order[k]);
+        queued[order[k]] = 1;
+    }
+    for (int i = _n - 1; i >= 0; --i) // unreachable blocks (if not simplified)
+        if (!queued[i]) {
+            worklist.push_back(i);
+            queued[i] = 1;
+        }
 
-            // updates LiveOut
-            switch (b->end_kind) {
-            case BasicBlock::BY_JUMP:
-                b1 = getBlock(b->next[0]);
-                b->LiveOut = b1->LiveIn;
-                break;
+    // Step 3. iterates
+    _liveness_visits = 0;
+    while (!worklist.empty()) {
+        b = getBlock(worklist.front());
+        worklist.pop_front();
+        queued[b->bb_num] = 0;
+        ++_liveness_visits;
+
+        // updates LiveOut
+        switch (b->end_kind) {
+        case BasicBlock::BY_JUMP:
+            b1 = getBlock(b->next[0]);
+            b->LiveOut->copyFrom(b1->LiveIn);
+            usePhiArgs(b1, b->bb_num, b->LiveOut);
+            break;
 
-            case BasicBlock::BY_JZERO:
-                b1 = getBlock(b->next[0]);
-                b2 = getBlock(b->next[1]);
-                b->LiveOut = b1->LiveIn->unionWith(b2->LiveIn);
-                break;
+        case BasicBlock::BY_JZERO:
+            b1 = getBlock(b->next[0]);
+            b2 = getBlock(b->next[1]);
+            b->LiveOut->copyFrom(b1->LiveIn);
+            b->LiveOut->unite(b2->LiveIn);
+            usePhiArgs(b1, b->bb_num, b->LiveOut);
+            usePhiArgs(b2, b->bb_num, b->LiveOut);
+            break;
 
-            case BasicBlock::BY_RETURN:
-                break;
+        case BasicBlock::BY_RETURN:
+            break;
 
-            default:
-                mind_assert(false); // unreachable
-            }
+        default:
+            mind_assert(false); // unreachable
+        }
 
-            // updates LiveIn
-            newin = b->LiveOut->differenceFrom(b->Def)->unionWith(b->LiveUse);
-            if (!newin->equal(b->LiveIn)) {
-                changed = true;
-                b->LiveIn = newin;
+        // updates LiveIn
+        newin->copyFrom(b->LiveOut);
+        newin->subtract(b->Def);
+        newin->unite(b->LiveUse);
+        if (!newin->equal(b->LiveIn)) {
+            b->LiveIn->copyFrom(newin);
+
+            for (size_t k = 0; k < pred[b->bb_num].size(); ++k) {
+                int p = pred[b->bb_num][k];
+                if (!queued[p]) {
+                    worklist.push_back(p);
+                    queued[p] = 1;
+                }
             }
         }
     }
+
+    return _liveness_visits;
 }
 
-/* Computes the LiveOut set of every contained TAC.
+/* Computes which operands of every contained TAC are dead after it.
  *
  * It is the same algorithm as that for CFG liveness analysis, except that
- * this "graph" is only a linked list.
+ * this "graph" is only a linked list. Only one set is kept while walking
+ * backwards: the LiveOut set of every TAC is not stored, but can be rebuilt
+ * from the block LiveIn set and the Tac::dead flags (see LiveCursor).
  *
  * NOTE: if it is an END-BY-JZERO or END-BY-RETURN block, don't miss
  *       the last use site (i.e. this->var).
@@ -173,7 +263,8 @@ void FlowGraph::analyzeLiveness(void) {
 void BasicBlock::analyzeLiveness(void) {
     // it should not begin until FlowGraph::anayzeLiveness() is done
 
-    Tac *t, *t_next;
+    Tac *t;
+    BitSet *live;
 
     // Step 1. if tac_chain is empty, we do nothing
     if (NULL == tac_chain)
@@ -184,23 +275,28 @@ void BasicBlock::analyzeLiveness(void) {
         ;
 
     // Step 2. begins with LiveOut of the block
-    t->LiveOut = LiveOut->clone();
+    live = LiveOut->clone();
     if (end_kind == BY_JZERO || end_kind == BY_RETURN)
-        t->LiveOut->add(var);
+        live->add(var->id);
+
+    for (; t != NULL; t = t->prev) {
+        // here "live" is the LiveOut set of t
+        Temp v[3] = {t->op0.var, t->op1.var, t->op2.var};
 
-    for (t = t->prev; t != NULL; t = t->prev) {
-        t->LiveOut = t->next->LiveOut->clone();
-        t_next = t->next;
+        t->dead = 0;
+        for (int k = 0; k < 3; ++k)
+            if (NULL != v[k] && !live->contains(v[k]->id))
+                t->dead |= (1 << k);
 
-        switch (t->next->op_code) {
+        switch (t->op_code) {
         case Tac::ASSIGN:
         case Tac::NEG:
         case Tac::LNOT:
         case Tac::BNOT:
         case Tac::LOAD:
-            if (NULL != t_next->op0.var)
-                t->LiveOut->remove(t_next->op0.var);
-            t->LiveOut->add(t_next->op1.var);
+            if (NULL != t->op0.var)
+                live->remove(t->op0.var->id);
+            live->add(t->op1.var->id);
             break;
 
         case Tac::ADD:
@@ -216,23 +312,31 @@ void BasicBlock::analyzeLiveness(void) {
         case Tac::GEQ:
         case Tac::LAND:
         case Tac::LOR:
-            if (NULL != t_next->op0.var)
-                t->LiveOut->remove(t_next->op0.var);
-            t->LiveOut->add(t_next->op1.var);
-            t->LiveOut->add(t_next->op2.var);
+        case Tac::MIN:
+        case Tac::MAX:
+        case Tac::KEEP_NZ:
+        case Tac::KEEP_Z:
+            if (NULL != t->op0.var)
+                live->remove(t->op0.var->id);
+            live->add(t->op1.var->id);
+            live->add(t->op2.var->id);
             break;
 
         case Tac::POP:
         case Tac::LOAD_IMM4:
         case Tac::LOAD_SYMBOL:
-            if (NULL != t_next->op0.var)
-                t->LiveOut->remove(t_next->op0.var);
+        case Tac::CALL:
+            if (NULL != t->op0.var)
+                live->remove(t->op0.var->id);
             break;
 
         case Tac::PUSH:
         case Tac::PARAM:
-        case Tac::CALL:
-            t->LiveOut->add(t_next->op0.var);
+            live->add(t->op0.var->id);
+            break;
+
+        case Tac::PHI:
+            live->remove(t->op0.var->id);
             break;
 
         default:
@@ -242,3 +346,33 @@ void BasicBlock::analyzeLiveness(void) {
         }
     }
 }
+
+/* Constructor of LiveCursor.
+ *
+ * PARAMETERS:
+ *   b     - the basic block to walk through (liveness should have been
+ *           analyzed)
+ */
+LiveCursor::LiveCursor(BasicBlock *b) { _live = b->LiveIn->clone(); }
+
+/* Steps over a TAC.
+ *
+ * PARAMETERS:
+ *   t     - the TAC at the current position
+ * NOTE:
+ *   a variable which is neither used nor defined by t keeps its liveness,
+ *   while the liveness of the operands after t is given by t->dead.
+ */
+void LiveCursor::advance(Tac *t) {
+    Temp v[3] = {t->op0.var, t->op1.var, t->op2.var};
+
+    for (int k = 0; k < 3; ++k) {
+        if (NULL == v[k])
+            continue;
+
+        if (t->dead & (1 << k))
+            _live->remove(v[k]->id);
+        else
+            _live->add(v[k]->id);
+    }
+}
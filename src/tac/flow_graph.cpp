@@ -7,17 +7,14 @@
 #include "3rdparty/map.hpp"
 #include "config.hpp"
 #include "tac/tac.hpp"
+#include <iomanip>
+#include <sstream>
 #include <unordered_map>
 
 using namespace mind;
 using namespace mind::tac;
 using namespace mind::util;
 
-// temp variable comparator
-struct temp_less {
-    bool operator()(Temp t1, Temp t2) { return (t1->id < t2->id); }
-};
-
 /* Auxilliary function for printing variable sets.
  *
  * PARAMETERS:
@@ -26,17 +23,16 @@ struct temp_less {
  * RETURNS:
  *   the output stream
  */
-std::ostream &mind::operator<<(std::ostream &os, Set<Temp> *s) {
+std::ostream &mind::operator<<(std::ostream &os, BitSet *s) {
     os << "[";
 
-    if (NULL != s && !s->empty()) {
-        size_t sz = s->size();
-        Temp *buf = new Temp[sz];
-        std::copy(s->begin(), s->end(), buf);
-        std::sort(buf, buf + sz, temp_less());
-        os << buf[0];
-        for (size_t i = 1; i < sz; ++i)
-            os << " " << buf[i];
+    if (NULL != s) {
+        // the elements are the variable ids in ascending order
+        for (BitSet::iterator it = s->begin(); it != s->end(); ++it) {
+            if (it != s->begin())
+                os << " ";
+            os << "T" << *it;
+        }
     }
     os << "]";
 
@@ -57,10 +53,9 @@ BasicBlock::BasicBlock(void) {
     next[0] = next[1] = -1;
     cancelled = false;
 
-    Def = new Set<Temp>();     // empty set
-    LiveUse = new Set<Temp>(); // empty set
-    LiveIn = new Set<Temp>();  // empty set
-    LiveOut = new Set<Temp>(); // empty set
+    // allocated by FlowGraph::analyzeLiveness (when the number of
+    // variables is known)
+    Def = LiveUse = LiveIn = LiveOut = NULL;
 }
 
 /* Prints the basic block.
@@ -79,9 +74,21 @@ void BasicBlock::dump(std::ostream &os) {
 
     os << "^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^" << std::endl;
 
-    // prints the tacs
-    for (Tac *t = tac_chain; t != NULL; t = t->next)
-        os << "| " << t;
+    // prints the tacs (and the LiveOut set of every TAC, if analyzed)
+    if (NULL == LiveIn) {
+        for (Tac *t = tac_chain; t != NULL; t = t->next)
+            os << "| " << t;
+    } else {
+        LiveCursor cursor(this);
+
+        for (Tac *t = tac_chain; t != NULL; t = t->next) {
+            std::ostringstream oss;
+            t->dump(oss);
+            cursor.advance(t);
+            os << "| " << std::left << std::setw(32) << oss.str() << "| "
+               << cursor.live() << std::endl;
+        }
+    }
 
     os << "^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^" << std::endl;
 
@@ -125,6 +132,26 @@ static void deleteMemo(Functy f) {
     }
 }
 
+/* Collects the temporary variables used in a function.
+ *
+ * PARAMETERS:
+ *   t     - a TAC sequence
+ *   temps - (output) the variables, indexed by their ids
+ */
+static void collectTemps(Tac *t, Vector<Temp> &temps) {
+    for (; NULL != t; t = t->next) {
+        Temp v[3] = {t->op0.var, t->op1.var, t->op2.var};
+
+        for (int i = 0; i < 3; ++i) {
+            if (NULL == v[i])
+                continue;
+            if ((size_t)v[i]->id >= temps.size())
+                temps.resize(v[i]->id + 1, NULL);
+            temps[v[i]->id] = v[i];
+        }
+    }
+}
+
 /* Marks which TAC belongs to which block (the 1st pass of building CFG).
  *
  * PARAMETERS:
@@ -269,6 +296,9 @@ FlowGraph *FlowGraph::makeGraph(Functy f) {
     deleteMemo(f);
 
     g = new FlowGraph();
+    g->_liveness_visits = 0;
+    g->_cfa_valid = false;
+    collectTemps(f->code, g->_temps);
     g->_n = markBasicBlocks(f->code);
     g->_bbs.resize(g->_n);
 
@@ -277,6 +307,28 @@ FlowGraph *FlowGraph::makeGraph(Functy f) {
     return g;
 }
 
+/* Tests whether a block is on a cycle of empty END-BY-JUMP blocks.
+ *
+ * PARAMETERS:
+ *   bbs   - the basic blocks
+ *   i     - the block number
+ * RETURNS:
+ *   true if following the empty jumps from block i leads back to it
+ */
+static bool isEmptyCycle(Vector<BasicBlock *> &bbs, int i) {
+    BasicBlock *b = bbs[i];
+
+    for (size_t k = 0; k < bbs.size(); ++k) {
+        b = bbs[b->next[0]];
+        if (b->bb_num == i)
+            return true;
+        if (b->end_kind != BasicBlock::BY_JUMP || NULL != b->tac_chain)
+            return false;
+    }
+
+    return false;
+}
+
 /* Simplifies (optimizes) a control-flow graph.
  *
  * NOTE:
@@ -309,10 +361,22 @@ void FlowGraph::simplify(void) {
     }
 
     // cancels all unreachable blocks and all empty END-BY-JUMP blocks
+    // (except the entrance, and the empty blocks jumping around in a cycle,
+    // e.g. "while (1);", which have nowhere to be forwarded)
+    Vector<int> order;
+    Vector<int> reachable;
+
+    getPostorder(order);
+    reachable.resize(_n, 0);
+    for (size_t k = 0; k < order.size(); ++k)
+        reachable[order[k]] = 1;
+
     for (int i = 0; i < _n; ++i) {
         b = _bbs[i];
-        if (b->in_degree <= 0 ||
-            (b->end_kind == BasicBlock::BY_JUMP && NULL == b->tac_chain)) {
+        if (!reachable[i]) {
+            b->cancelled = true;
+        } else if (i > 0 && b->end_kind == BasicBlock::BY_JUMP &&
+                   NULL == b->tac_chain && !isEmptyCycle(_bbs, i)) {
             b->cancelled = true;
         }
     }
@@ -340,6 +404,7 @@ void FlowGraph::simplify(void) {
             if (b->next[0] == b->next[1]) {
                 b->end_kind =
                     BasicBlock::BY_JUMP; // reduce END-BY-JZERO into END-BY-JUMP
+                b->var = NULL;
             }
         } else
             b->next[1] = b->next[0];
@@ -371,6 +436,7 @@ void FlowGraph::simplify(void) {
             _bbs[i]->next[1] = new_num[_bbs[i]->next[1]];
         }
     }
+    invalidateControlFlow();
 }
 
 /* Gets a specified basic block.
@@ -393,6 +459,82 @@ BasicBlock *FlowGraph::getBlock(int i) {
  */
 size_t FlowGraph::size(void) { return _n; }
 
+/* Gets the block numbers in postorder (depth-first from the entry).
+ *
+ * PARAMETERS:
+ *   order - (output) the block numbers
+ * NOTE:
+ *   a block comes after all its successors except along back edges, so the
+ *   reverse of it (i.e. the reverse postorder) suits forward problems, while
+ *   the postorder itself suits backward problems such as liveness.
+ */
+void FlowGraph::getPostorder(Vector<int> &order) {
+    Vector<int> visited; // whether a block has been visited
+    Vector<int> stack;   // the blocks on the current path
+    Vector<int> child;   // which successor to visit next (per path entry)
+
+    order.clear();
+    if (0 == _n)
+        return;
+
+    visited.resize(_n, 0);
+    visited[0] = 1;
+    stack.push_back(0);
+    child.push_back(0);
+
+    while (!stack.empty()) {
+        BasicBlock *b = _bbs[stack.back()];
+        int k = child.back()++;
+        int num_succ = 0;
+
+        switch (b->end_kind) {
+        case BasicBlock::BY_JUMP:
+            num_succ = 1;
+            break;
+
+        case BasicBlock::BY_JZERO:
+            num_succ = 2;
+            break;
+
+        default:
+            break;
+        }
+
+        if (k < num_succ) {
+            int s = b->next[k];
+            if (!visited[s]) {
+                visited[s] = 1;
+                stack.push_back(s);
+                child.push_back(0);
+            }
+        } else {
+            order.push_back(b->bb_num);
+            stack.pop_back();
+            child.pop_back();
+        }
+    }
+}
+
+/* Gets a temporary variable by its id.
+ *
+ * PARAMETERS:
+ *   id    - the variable id
+ * RETURNS:
+ *   the variable (NULL if it doesn't appear in this function)
+ */
+Temp FlowGraph::getTemp(int id) {
+    mind_assert(id >= 0 && (size_t)id < _temps.size());
+
+    return _temps[id];
+}
+
+/* Gets the number of temporary variables.
+ *
+ * RETURNS:
+ *   the upper bound of the variable ids in this function
+ */
+size_t FlowGraph::numTemps(void) { return _temps.size(); }
+
 /* Gets a begin iterator.
  *
  * RETURNS:
@@ -427,6 +569,8 @@ FlowGraph::reverse_iterator FlowGraph::rend(void) { return _bbs.rend(); }
  *   os    - the output stream
  */
 void FlowGraph::dump(std::ostream &os) {
+    os << "* LIVENESS: " << _liveness_visits << " block visits for " << _n
+       << " blocks" << std::endl;
     for (int i = 0; i < _n; i++) {
         _bbs[i]->dump(os);
         os << std::endl;
@@ -10,7 +10,7 @@
 #ifndef __MIND_FLOWGRAPH__
 #define __MIND_FLOWGRAPH__
 
-#include "3rdparty/set.hpp"
+#include "3rdparty/bitset.hpp"
 #include "3rdparty/vector.hpp"
 #include "asm/mach_desc.hpp"
 #include "define.hpp"
@@ -56,17 +56,19 @@ struct BasicBlock {
     assembly::Instr *instr_chain; // for ASM code generation: the associated assembly code sequence
     const char *entry_label; // for ASM code generation: the associated entry label in assembly code
 
-    util::Set<Temp> *Def; // the DEF set: ALL variables defined in this block
-    util::Set<Temp> *LiveUse; // the LiveUSE set: all used-before-defined variables
-    util::Set<Temp> *LiveIn; // the LiveIn set: all variables alive at the entry
-    util::Set<Temp> *LiveOut; // the LiveOut set: all variables alive at the exit
+    // NOTE: the following sets are bit-vectors indexed by TempObject::id
+    //       (allocated by FlowGraph::analyzeLiveness)
+    util::BitSet *Def; // the DEF set: ALL variables defined in this block
+    util::BitSet *LiveUse; // the LiveUSE set: all used-before-defined variables
+    util::BitSet *LiveIn; // the LiveIn set: all variables alive at the entry
+    util::BitSet *LiveOut; // the LiveOut set: all variables alive at the exit
 
     // constructor
     BasicBlock();
     // computes the DEF set and LiveUse set
     void computeDefAndLiveUse(void); // in tac/dataflow.cpp
-    // computes the LiveOut set of every TAC inside (see also:
-    // FlowGraph::analyzeLiveness)
+    // computes which operands of every TAC inside are dead after it (see
+    // also: FlowGraph::analyzeLiveness and LiveCursor)
     void analyzeLiveness(void); // in tac/dataflow.cpp
     // prints this basic block
     void dump(std::ostream &);
@@ -75,6 +77,27 @@ struct BasicBlock {
     void updateDEF(Temp);
 };
 
+/**
+ * Liveness Cursor.
+ *
+ * Instead of keeping a LiveOut set for every TAC, only the dead operands
+ * of every TAC are recorded (see Tac::dead). A cursor walks through a
+ * basic block and rebuilds the liveness at every position on demand,
+ * with a single variable set.
+ */
+class LiveCursor {
+  private:
+    util::BitSet *_live; // variables alive at the current position
+
+  public:
+    // starts at the entry of a basic block (i.e. with its LiveIn set)
+    LiveCursor(BasicBlock *); // in tac/dataflow.cpp
+    // steps over a TAC, after which live() is the LiveOut set of that TAC
+    void advance(Tac *); // in tac/dataflow.cpp
+    // gets the variables alive at the current position
+    util::BitSet *live(void) { return _live; }
+};
+
 /**
  * Control-flow Graph (CFG).
  *
@@ -85,10 +108,41 @@ class FlowGraph {
   private:
     util::Vector<BasicBlock *> _bbs; // basic blocks
     int _n;                          // number of basic blocks
+    util::Vector<Temp> _temps; // temporary variables (indexed by their ids)
+    int _liveness_visits; // how many blocks the liveness solver has visited
+    util::Vector<int> _origin; // the variable every SSA version comes from
+
+    // the control-flow analysis (computed on demand, see tac/loops.cpp)
+    bool _cfa_valid;          // whether the following are up to date
+    util::Vector<int> _order; // the reachable blocks in postorder
+    util::Vector<int> _po_num; // the position in _order (-1 if unreachable)
+    util::Vector<util::Vector<int> > _preds; // the reachable predecessors
+    util::Vector<int> _idom;   // the immediate dominators
+    util::Vector<util::Vector<int> > _dom_children; // the dominator tree
+    util::Vector<int> _dom_pre;  // the preorder number in the dominator tree
+    util::Vector<int> _dom_post; // the postorder number in the dominator tree
+    util::Vector<int> _loop_header; // the innermost loop containing a block
+    util::Vector<int> _loop_parent; // the loop enclosing a loop (by header)
+    util::Vector<int> _loop_depth;  // how many loops contain a block
 
     FlowGraph() { /* don't invoke me */
     }
 
+    // creates a new version of a variable
+    Temp newVersion(Temp); // in tac/ssa.cpp
+    // adds an empty block jumping to the specified one
+    BasicBlock *newBlock(int); // in tac/ssa.cpp
+    // renames the SSA versions back into their variables (where possible)
+    void coalesceVersions(void); // in tac/ssa.cpp
+    // removes the pure TACs whose results are never used
+    int removeDeadTacs(void); // in tac/sccp.cpp
+    // replaces every use of the variables with their leaders
+    void replaceVariables(util::Vector<Temp> &); // in tac/gvn.cpp
+    // gives a loop a preheader (returns its block number)
+    int makePreheader(int); // in tac/licm.cpp
+    // computes the dominators and the natural loops (if out of date)
+    void analyzeControlFlow(void); // in tac/loops.cpp
+
   public:
     typedef util::Vector<BasicBlock *>::iterator iterator;
     typedef util::Vector<BasicBlock *>::reverse_iterator reverse_iterator;
@@ -97,10 +151,45 @@ class FlowGraph {
     static FlowGraph *makeGraph(Functy);
     // simplifies (optimizes) a control-flow graph
     void simplify(void);
+    // translates this graph into SSA form (with PHI tacs)
+    void buildSSA(void); // in tac/ssa.cpp
+    // translates this graph out of SSA form (before simplify)
+    void destroySSA(void); // in tac/ssa.cpp
+    // folds the constants and the branches on them (before simplify)
+    void propagateConstants(void); // in tac/sccp.cpp
+    // prints the statistics of propagateConstants (of all the functions)
+    static void dumpConstantStats(std::ostream &); // in tac/sccp.cpp
+    // replaces the redundant computations with the values computed before
+    // (in SSA form)
+    void numberValues(void); // in tac/gvn.cpp
+    // prints the statistics of numberValues (of all the functions)
+    static void dumpValueStats(std::ostream &); // in tac/gvn.cpp
+    // replaces the branches which only choose between two values with the
+    // computation of the value (in SSA form, with the forms the machine has:
+    // "min" and "max", and the conditional zero)
+    void convertBranches(bool, bool); // in tac/ifconv.cpp
+    // prints the statistics of convertBranches (of all the functions)
+    static void dumpBranchStats(std::ostream &); // in tac/ifconv.cpp
+    // moves the loop-invariant computations out of the loops (in SSA form,
+    // with the number of registers available)
+    void hoistInvariants(int); // in tac/licm.cpp
+    // prints the statistics of hoistInvariants (of all the functions)
+    static void dumpInvariantStats(std::ostream &); // in tac/licm.cpp
+    // replaces the multiplications of the induction variables with
+    // additions, and removes the induction variables no longer needed (in
+    // SSA form, after hoistInvariants)
+    void reduceStrength(void); // in tac/induction.cpp
+    // prints the statistics of reduceStrength (of all the functions)
+    static void dumpInductionStats(std::ostream &); // in tac/induction.cpp
     // gets the specified basic block
     BasicBlock *getBlock(int);
     // gets the size of this control-flow graph
     size_t size(void);
+    // gets the temporary variable of the specified id (NULL if not used)
+    Temp getTemp(int);
+    // gets the number of temporary variables (i.e. the universe of the
+    // variable sets)
+    size_t numTemps(void);
     // gets the begin iterator (pointing to the first block)
     iterator begin(void);
     // gets the end iterator (pointing beyond the last block)
@@ -109,8 +198,34 @@ class FlowGraph {
     reverse_iterator rbegin(void);
     // gets the end reverse iterator (pointing beyond the first block)
     reverse_iterator rend(void);
+    // gets the block numbers in postorder (excluding the unreachable blocks)
+    void getPostorder(util::Vector<int> &);
+    // marks the dominators and the loops out of date (after the edges have
+    // been changed)
+    void invalidateControlFlow(void); // in tac/loops.cpp
+    // gets the reachable predecessors of a block (each of them once)
+    util::Vector<int> &getPredecessors(int); // in tac/loops.cpp
+    // gets the immediate dominator of a block (the entry block is its own,
+    // and an unreachable block has -1)
+    int getIdom(int); // in tac/loops.cpp
+    // gets the children of a block in the dominator tree
+    util::Vector<int> &getDomChildren(int); // in tac/loops.cpp
+    // tests whether a block dominates another (reachable) one
+    bool dominates(int, int); // in tac/loops.cpp
+    // gets the nearest common dominator of two reachable blocks
+    int commonDominator(int, int); // in tac/loops.cpp
+    // gets the header of the innermost loop containing a block (-1 if none)
+    int getLoopHeader(int); // in tac/loops.cpp
+    // gets the header of the loop enclosing a loop (-1 if outermost)
+    int getParentLoop(int); // in tac/loops.cpp
+    // tests whether a block is inside the loop of a header (or a loop
+    // nested in it)
+    bool inLoop(int, int); // in tac/loops.cpp
+    // gets how many natural loops contain a block
+    int getLoopDepth(int); // in tac/loops.cpp
     // computes the LiveIn set and the LiveOut set of every basic block
-    void analyzeLiveness(void); // in tac/dataflow.cpp
+    // (returns how many blocks have been visited before convergence)
+    int analyzeLiveness(void); // in tac/dataflow.cpp
     // prints this graph
     void dump(std::ostream &);
 };
@@ -118,7 +233,7 @@ class FlowGraph {
 } // namespace tac
 
 // an auxilliary function for printing variable set
-std::ostream &operator<<(std::ostream &, util::Set<tac::Temp> *);
+std::ostream &operator<<(std::ostream &, util::BitSet *);
 } // namespace mind
 
 #endif // __MIND_FLOWGRAPH__
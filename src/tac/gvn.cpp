@@ -0,0 +1,349 @@
+/*****************************************************
+ *  Global Value Numbering.
+ *
+ *  (see "Value Numbering", Briggs, Cooper and Simpson, Software: Practice
+ *  and Experience 1997, the dominator-based algorithm.) The TACs are in SSA
+ *  form (see tac/ssa.cpp), and the blocks are visited in preorder of the
+ *  dominator tree with a scoped table of the expressions computed so far,
+ *  so that an expression found in the table has been computed in a block
+ *  dominating the current one. Then its result replaces every use of the
+ *  redundant one, which is removed.
+ *
+ *  The value number of a variable is the variable holding the same value
+ *  first (copies are looked through, and all the constants of the same
+ *  value share a number, though the LOAD_IMM4s themselves are kept for the
+ *  immediate operands). The operands of the commutative operations are
+ *  sorted, and "a > b" ("a >= b") is numbered as "b < a" ("b <= a").
+ *
+ *  A LOAD is numbered together with the state of the memory, which changes
+ *  at every call (MiniDecaf has no store yet, but a callee may get one), and
+ *  is passed from a block to another only along the edge from the immediate
+ *  dominator to its only successor. A PHI whose arguments all have the same
+ *  value number (other than itself) is replaced with that variable.
+ */
+
+#include "3rdparty/vector.hpp"
+#include "config.hpp"
+#include "tac/flow_graph.hpp"
+#include "tac/tac.hpp"
+
+#include <iomanip>
+#include <map>
+
+using namespace mind;
+using namespace mind::tac;
+using namespace mind::util;
+
+// the statistics (of all the functions)
+static int num_removed_exprs = 0;
+static int num_removed_loads = 0;
+static int num_removed_phis = 0;
+static int num_removed_tacs = 0;
+
+namespace {
+// an expression (the key of the table)
+struct ValueKey {
+    int op;           // the operation
+    int a;            // the value number of the first operand
+    int b;            // the value number of the second operand (or the
+                      // offset of a LOAD)
+    int mem;          // the state of the memory (for LOAD only)
+    std::string name; // the symbol (for LOAD_SYMBOL only)
+
+    bool operator<(const ValueKey &o) const {
+        if (op != o.op)
+            return op < o.op;
+        if (a != o.a)
+            return a < o.a;
+        if (b != o.b)
+            return b < o.b;
+        if (mem != o.mem)
+            return mem < o.mem;
+        return name < o.name;
+    }
+};
+} // namespace
+
+/* Builds the key of the expression computed by a TAC.
+ *
+ * PARAMETERS:
+ *   t     - the TAC
+ *   vn    - the value numbers of the variables
+ *   mem   - the current state of the memory
+ *   key   - (output) the key
+ * RETURNS:
+ *   false if the TAC is not numbered as an expression
+ */
+static bool makeKey(Tac *t, Vector<int> &vn, int mem, ValueKey &key) {
+    key.op = t->op_code;
+    key.a = key.b = key.mem = 0;
+
+    switch (t->op_code) {
+    case Tac::ADD:
+    case Tac::MUL:
+    case Tac::EQU:
+    case Tac::NEQ:
+    case Tac::LAND:
+    case Tac::LOR:
+        key.a = vn[t->op1.var->id];
+        key.b = vn[t->op2.var->id];
+        if (key.a > key.b)
+            std::swap(key.a, key.b);
+        return true;
+
+    case Tac::SUB:
+    case Tac::DIV:
+    case Tac::MOD:
+    case Tac::LES:
+    case Tac::LEQ:
+        key.a = vn[t->op1.var->id];
+        key.b = vn[t->op2.var->id];
+        return true;
+
+    case Tac::GTR:
+    case Tac::GEQ:
+        key.op = (Tac::GTR == t->op_code) ? Tac::LES : Tac::LEQ;
+        key.a = vn[t->op2.var->id];
+        key.b = vn[t->op1.var->id];
+        return true;
+
+    case Tac::NEG:
+    case Tac::LNOT:
+    case Tac::BNOT:
+        key.a = vn[t->op1.var->id];
+        return true;
+
+    case Tac::LOAD_SYMBOL:
+        key.name = t->op1.name;
+        return true;
+
+    case Tac::LOAD:
+        key.a = vn[t->op1.var->id];
+        key.b = t->op1.offset;
+        key.mem = mem;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+// whether an expression is computed by a single instruction, so that it is
+// cheaper to compute it again in another block, or after a call, than to
+// keep its value alive until there (a comparison computed again may also be
+// fused with a branch)
+static bool isCheap(Tac::Kind op) {
+    switch (op) {
+    case Tac::MUL:
+    case Tac::DIV:
+    case Tac::MOD:
+    case Tac::LOAD:
+        return false;
+
+    default:
+        return true;
+    }
+}
+
+// follows the replacements of a variable
+static Temp findLeader(Vector<Temp> &leader, Temp v) {
+    while (leader[v->id] != v)
+        v = leader[v->id];
+
+    return v;
+}
+
+// removes a TAC from its block
+static void unlinkTac(BasicBlock *b, Tac *t) {
+    if (NULL != t->prev)
+        t->prev->next = t->next;
+    else
+        b->tac_chain = t->next;
+    if (NULL != t->next)
+        t->next->prev = t->prev;
+}
+
+/* Performs global value numbering on this graph.
+ *
+ * NOTE:
+ *   it should be done in SSA form (after propagateConstants, so that the
+ *   constants are already folded).
+ */
+void FlowGraph::numberValues(void) {
+    int n = (int)numTemps();
+    Vector<Temp> leader; // the variable replacing every variable
+    Vector<int> vn;      // the value number of every variable
+    Vector<int> mem_out; // the state of the memory leaving every block
+    std::map<int, int> consts;       // the value number of every constant
+    std::map<ValueKey, Temp> table;  // the expressions (in scope)
+    Vector<std::pair<ValueKey, Temp> > scope; // the entries replaced (or
+                                              // added, with NULL)
+    Vector<int> scope_at;            // the size of "scope" entering a block
+    Vector<int> is_const;            // whether a value number is a constant
+    Vector<int> def_block;           // the block defining every expression
+    Vector<int> def_mem;             // the state of the memory there
+    Vector<int> worklist;
+    int num_mems = 0;
+
+    leader.resize(n, NULL);
+    vn.resize(n);
+    for (int k = 0; k < n; ++k) {
+        leader[k] = _temps[k];
+        vn[k] = k;
+    }
+    is_const.resize(n, 0);
+    def_block.resize(n, -1);
+    def_mem.resize(n, -1);
+    mem_out.resize(_n, 0);
+    scope_at.resize(_n, 0);
+
+    // Step 1. visits the blocks in preorder of the dominator tree
+    //         (iteratively, where ~b stands for leaving block b)
+    worklist.push_back(0);
+    while (!worklist.empty()) {
+        int x = worklist.back();
+        worklist.pop_back();
+
+        if (x < 0) {
+            for (x = ~x; (int)scope.size() > scope_at[x]; scope.pop_back()) {
+                if (NULL == scope.back().second)
+                    table.erase(scope.back().first);
+                else
+                    table[scope.back().first] = scope.back().second;
+            }
+            continue;
+        }
+
+        BasicBlock *b = _bbs[x];
+        Vector<int> &preds = getPredecessors(x);
+        int mem = (1 == preds.size() && preds[0] == getIdom(x))
+                      ? mem_out[preds[0]]
+                      : ++num_mems;
+
+        scope_at[x] = scope.size();
+        worklist.push_back(~x);
+        Vector<int> &children = getDomChildren(x);
+        for (size_t k = children.size(); k > 0; --k)
+            worklist.push_back(children[k - 1]);
+
+        for (Tac *t = b->tac_chain, *next; t != NULL; t = next) {
+            next = t->next;
+            Temp d = t->getDef();
+            ValueKey key;
+
+            switch (t->op_code) {
+            case Tac::ASSIGN:
+                vn[d->id] = vn[t->op1.var->id];
+                continue;
+
+            case Tac::LOAD_IMM4:
+                if (consts.count(t->op1.ival))
+                    vn[d->id] = consts[t->op1.ival];
+                else
+                    consts[t->op1.ival] = d->id;
+                is_const[vn[d->id]] = 1;
+                continue;
+
+            case Tac::CALL:
+                mem = ++num_mems;
+                continue;
+
+            case Tac::PHI: {
+                // (the arguments from unreachable blocks don't count, and a
+                // constant number may not stand for a variable)
+                int same = -1;
+                bool trivial = true;
+                for (PhiArg a = t->args; NULL != a && trivial; a = a->next) {
+                    if (getIdom(a->pred) < 0 || vn[a->var->id] == d->id)
+                        continue;
+                    trivial = (same < 0 || same == vn[a->var->id]);
+                    same = vn[a->var->id];
+                }
+                if (!trivial || same < 0 || is_const[same])
+                    continue;
+
+                leader[d->id] = _temps[same];
+                vn[d->id] = same;
+                unlinkTac(b, t);
+                ++num_removed_phis;
+                continue;
+            }
+
+            default:
+                break;
+            }
+
+            if (NULL == d || !makeKey(t, vn, mem, key))
+                continue;
+
+            std::map<ValueKey, Temp>::iterator it = table.find(key);
+            if (it == table.end() ||
+                (isCheap(t->op_code) && (def_block[it->second->id] != x ||
+                                         def_mem[it->second->id] != mem))) {
+                scope.push_back(std::make_pair(
+                    key, it == table.end() ? (Temp)NULL : it->second));
+                table[key] = d;
+                def_block[d->id] = x;
+                def_mem[d->id] = mem;
+                continue;
+            }
+
+            leader[d->id] = it->second;
+            vn[d->id] = vn[it->second->id];
+            unlinkTac(b, t);
+            if (Tac::LOAD == t->op_code)
+                ++num_removed_loads;
+            else
+                ++num_removed_exprs;
+        }
+
+        mem_out[x] = mem;
+    }
+
+    // Step 2. replaces the variables removed
+    replaceVariables(leader);
+
+    // Step 3. removes the operands no longer used (e.g. the constants)
+    num_removed_tacs += removeDeadTacs();
+}
+
+/* Replaces every use of the variables with their leaders.
+ *
+ * PARAMETERS:
+ *   leader - the variable replacing every variable (itself if kept), where
+ *            a leader may be replaced in turn
+ */
+void FlowGraph::replaceVariables(Vector<Temp> &leader) {
+    Temp *v[2];
+
+    mind_assert(leader.size() == numTemps());
+    for (int i = 0; i < _n; ++i) {
+        BasicBlock *b = _bbs[i];
+        for (Tac *t = b->tac_chain; t != NULL; t = t->next) {
+            int k = t->getUses(v);
+            for (int j = 0; j < k; ++j)
+                *v[j] = findLeader(leader, *v[j]);
+            for (PhiArg a = t->args; NULL != a; a = a->next)
+                a->var = findLeader(leader, a->var);
+        }
+        if (BasicBlock::BY_JUMP != b->end_kind && NULL != b->var)
+            b->var = findLeader(leader, b->var);
+    }
+}
+
+/* Prints the statistics of the value numbering (of all the functions).
+ *
+ * PARAMETERS:
+ *   os    - the output stream
+ */
+void FlowGraph::dumpValueStats(std::ostream &os) {
+    os << "* GVN:" << std::endl;
+    os << "    " << std::left << std::setw(16) << "removed exprs"
+       << num_removed_exprs << std::endl;
+    os << "    " << std::left << std::setw(16) << "removed loads"
+       << num_removed_loads << std::endl;
+    os << "    " << std::left << std::setw(16) << "removed PHIs"
+       << num_removed_phis << std::endl;
+    os << "    " << std::left << std::setw(16) << "removed TACs"
+       << num_removed_tacs << std::endl;
+}
@@ -0,0 +1,311 @@
+/*****************************************************
+ *  If-conversion.
+ *
+ *  A branch which does nothing but choose between two values is replaced
+ *  with a computation of the value chosen, so that the block where it
+ *  happens simply jumps on. Such branches come in two shapes (in SSA form,
+ *  see tac/ssa.cpp): a "diamond", where both successors of the branch are
+ *  empty blocks (but for copies and constants) jumping to the same block,
+ *  and a "triangle", where one of them is, and it jumps to the other. The
+ *  PHIs of the block where the ways meet are then
+ *    - min(x, y) or max(x, y), if the branch tests x < y (or x <= y, etc.)
+ *      and the values chosen are x and y, on a machine with "min" and "max";
+ *    - (p if c != 0) + (q if c == 0), where c is the condition, on a machine
+ *      with the conditional zero instructions (and one of the halves is
+ *      enough if the other value is 0, and c itself if the values are 1
+ *      and 0 and c is a comparison).
+ *  A branch is converted only if all the PHIs are, and the copies and the
+ *  constants of the empty blocks are moved before the jump.
+ */
+
+#include "3rdparty/vector.hpp"
+#include "config.hpp"
+#include "tac/flow_graph.hpp"
+#include "tac/tac.hpp"
+
+#include <iomanip>
+
+using namespace mind;
+using namespace mind::tac;
+using namespace mind::util;
+
+// the statistics (of all the functions)
+static int num_min_max = 0;
+static int num_selects = 0;
+static int num_removed_branches = 0;
+
+/* Tests whether a block may be removed by the conversion of a branch.
+ *
+ * PARAMETERS:
+ *   g     - the control-flow graph
+ *   a     - the block
+ *   b     - the block ending with the branch
+ * RETURNS:
+ *   true if a is entered from b only, and does nothing but copies and
+ *   constants before it jumps on
+ */
+static bool isEmptyArm(FlowGraph *g, int a, int b) {
+    BasicBlock *x = g->getBlock(a);
+
+    if (a == b || BasicBlock::BY_JUMP != x->end_kind)
+        return false;
+    Vector<int> &preds = g->getPredecessors(a);
+    if (1 != preds.size() || b != preds[0])
+        return false;
+
+    for (Tac *t = x->tac_chain; t != NULL; t = t->next)
+        if (Tac::ASSIGN != t->op_code && Tac::LOAD_IMM4 != t->op_code)
+            return false;
+
+    return true;
+}
+
+// whether two variables hold the same value (the same constants included)
+static bool sameValue(Vector<Tac *> &def_tac, Temp x, Temp y) {
+    Tac *dx = def_tac[x->id], *dy = def_tac[y->id];
+
+    return x == y || (NULL != dx && NULL != dy &&
+                      Tac::LOAD_IMM4 == dx->op_code &&
+                      Tac::LOAD_IMM4 == dy->op_code &&
+                      dx->op1.ival == dy->op1.ival);
+}
+
+// whether a variable is the constant 0
+static bool isZero(Vector<Tac *> &def_tac, Temp x) {
+    Tac *d = def_tac[x->id];
+
+    return NULL != d && Tac::LOAD_IMM4 == d->op_code && 0 == d->op1.ival;
+}
+
+// whether a variable is the constant 1
+static bool isOne(Vector<Tac *> &def_tac, Temp x) {
+    Tac *d = def_tac[x->id];
+
+    return NULL != d && Tac::LOAD_IMM4 == d->op_code && 1 == d->op1.ival;
+}
+
+// appends a TAC to a basic block
+static void appendTac(BasicBlock *b, Tac *t) {
+    Tac *tail = b->tac_chain;
+
+    while (NULL != tail && NULL != tail->next)
+        tail = tail->next;
+    t->prev = tail;
+    t->next = NULL;
+    t->bb_num = b->bb_num;
+    if (NULL == tail)
+        b->tac_chain = t;
+    else
+        tail->next = t;
+}
+
+/* Converts the branches which only choose between two values.
+ *
+ * PARAMETERS:
+ *   min_max - whether the machine has "min" and "max"
+ *   select  - whether the machine has the conditional zero instructions
+ * NOTE:
+ *   it should be done in SSA form. the blocks removed are left empty and
+ *   unreachable (see simplify).
+ */
+void FlowGraph::convertBranches(bool min_max, bool select) {
+    if (!min_max && !select)
+        return;
+
+    Vector<Tac *> def_tac;
+    def_tac.resize(numTemps(), NULL);
+    for (int i = 0; i < _n; ++i)
+        for (Tac *t = _bbs[i]->tac_chain; t != NULL; t = t->next)
+            if (NULL != t->getDef())
+                def_tac[t->getDef()->id] = t;
+
+    int converted = 0;
+    bool changed = true;
+    while (changed) { // (an inner branch may leave an outer one empty)
+        changed = false;
+        for (int i = 0; i < _n; ++i) {
+            BasicBlock *b = _bbs[i];
+            if (BasicBlock::BY_JZERO != b->end_kind ||
+                b->next[0] == b->next[1] || getIdom(i) < 0)
+                continue;
+
+            // Step 1. finds the shape (arm[s] is the empty block taken if
+            //         the condition is s, or -1 if the branch goes to the
+            //         join directly)
+            int arm[2] = {-1, -1}, join;
+            bool empty0 = isEmptyArm(this, b->next[0], i);
+            bool empty1 = isEmptyArm(this, b->next[1], i);
+            if (empty0 && empty1 &&
+                _bbs[b->next[0]]->next[0] == _bbs[b->next[1]]->next[0]) {
+                arm[0] = b->next[0];
+                arm[1] = b->next[1];
+                join = _bbs[arm[0]]->next[0];
+            } else if (empty0 && _bbs[b->next[0]]->next[0] == b->next[1]) {
+                arm[0] = b->next[0];
+                join = b->next[1];
+            } else if (empty1 && _bbs[b->next[1]]->next[0] == b->next[0]) {
+                arm[1] = b->next[1];
+                join = b->next[0];
+            } else {
+                continue;
+            }
+            if (join == i || 2 != getPredecessors(join).size())
+                continue;
+
+            // Step 2. decides how every PHI is computed (the values are
+            //         looked up through the copies of the arms)
+            Tac *cmp = b->tac_chain;
+            while (NULL != cmp && NULL != cmp->next)
+                cmp = cmp->next;
+            if (NULL != cmp && cmp->op0.var != b->var)
+                cmp = NULL;
+            Temp c = b->var;
+            Vector<Tac *> phis;
+            Vector<Temp> value[2];
+            Vector<int> kind; // (Tac::ASSIGN, MIN, MAX or KEEP_NZ)
+            bool ok = true;
+
+            for (Tac *t = _bbs[join]->tac_chain;
+                 t != NULL && Tac::PHI == t->op_code && ok; t = t->next) {
+                Temp v[2] = {NULL, NULL};
+                for (int s = 0; s < 2; ++s) {
+                    int pred = (arm[s] >= 0) ? arm[s] : i;
+                    for (PhiArg a = t->args; NULL != a; a = a->next)
+                        if (a->pred == pred)
+                            v[s] = a->var;
+                    if (NULL == v[s])
+                        break;
+                    Tac *d = def_tac[v[s]->id];
+                    while (NULL != d && Tac::ASSIGN == d->op_code &&
+                           d->bb_num == arm[s]) {
+                        v[s] = d->op1.var;
+                        d = def_tac[v[s]->id];
+                    }
+                }
+
+                int k = -1;
+                if (NULL == v[0] || NULL == v[1]) {
+                    ok = false;
+                    break;
+                } else if (sameValue(def_tac, v[0], v[1])) {
+                    k = Tac::ASSIGN;
+                } else if (min_max && NULL != cmp &&
+                           Tac::LES <= cmp->op_code &&
+                           cmp->op_code <= Tac::GEQ) {
+                    // (x < y ? x : y is the smaller, x > y ? x : y the
+                    // greater, and the other way round the other)
+                    bool less = (Tac::LES == cmp->op_code ||
+                                 Tac::LEQ == cmp->op_code);
+                    Temp x = cmp->op1.var, y = cmp->op2.var;
+                    if (sameValue(def_tac, v[1], x) &&
+                        sameValue(def_tac, v[0], y))
+                        k = less ? Tac::MIN : Tac::MAX;
+                    else if (sameValue(def_tac, v[1], y) &&
+                             sameValue(def_tac, v[0], x))
+                        k = less ? Tac::MAX : Tac::MIN;
+                }
+                if (k < 0 && select)
+                    k = Tac::KEEP_NZ;
+                if (k < 0) {
+                    ok = false;
+                    break;
+                }
+                phis.push_back(t);
+                value[0].push_back(v[0]);
+                value[1].push_back(v[1]);
+                kind.push_back(k);
+            }
+            if (!ok)
+                continue;
+
+            // Step 3. moves the arms up, and computes the PHIs instead
+            for (int s = 0; s < 2; ++s) {
+                if (arm[s] < 0)
+                    continue;
+                for (Tac *t = _bbs[arm[s]]->tac_chain, *next; t != NULL;
+                     t = next) {
+                    next = t->next;
+                    appendTac(b, t);
+                }
+                _bbs[arm[s]]->tac_chain = NULL;
+            }
+
+            for (size_t k = 0; k < phis.size(); ++k) {
+                Tac *phi = phis[k];
+                Temp r = phi->op0.var, p = value[1][k], q = value[0][k];
+                Tac *t = NULL;
+                if (phi->prev != NULL)
+                    phi->prev->next = phi->next;
+                else
+                    _bbs[join]->tac_chain = phi->next;
+                if (phi->next != NULL)
+                    phi->next->prev = phi->prev;
+
+                switch (kind[k]) {
+                case Tac::ASSIGN:
+                    appendTac(b, t = Tac::Assign(r, p));
+                    break;
+
+                case Tac::MIN:
+                    appendTac(b, t = Tac::Min(r, cmp->op1.var, cmp->op2.var));
+                    ++num_min_max;
+                    break;
+
+                case Tac::MAX:
+                    appendTac(b, t = Tac::Max(r, cmp->op1.var, cmp->op2.var));
+                    ++num_min_max;
+                    break;
+
+                default:
+                    if (isZero(def_tac, q) && isOne(def_tac, p) &&
+                        NULL != cmp && Tac::EQU <= cmp->op_code &&
+                        cmp->op_code <= Tac::GEQ) {
+                        // (c is 0 or 1 already)
+                        appendTac(b, t = Tac::Assign(r, c));
+                    } else if (isZero(def_tac, q)) {
+                        appendTac(b, t = Tac::KeepNz(r, p, c));
+                    } else if (isZero(def_tac, p)) {
+                        appendTac(b, t = Tac::KeepZ(r, q, c));
+                    } else {
+                        Temp x = newVersion(r), y = newVersion(r);
+                        _origin[x->id] = x->id; // (variables of their own)
+                        _origin[y->id] = y->id;
+                        appendTac(b, Tac::KeepNz(x, p, c));
+                        appendTac(b, Tac::KeepZ(y, q, c));
+                        appendTac(b, t = Tac::Add(r, x, y));
+                    }
+                    ++num_selects;
+                    break;
+                }
+                def_tac.resize(numTemps(), NULL);
+                def_tac[r->id] = t;
+            }
+
+            b->end_kind = BasicBlock::BY_JUMP;
+            b->var = NULL; // (c is used by the selects now, if at all)
+            b->next[0] = b->next[1] = join;
+            invalidateControlFlow();
+            ++converted;
+            changed = true;
+        }
+    }
+
+    num_removed_branches += converted;
+    if (converted > 0)
+        removeDeadTacs(); // (the comparisons no longer needed)
+}
+
+/* Prints the statistics of the if-conversion (of all the functions).
+ *
+ * PARAMETERS:
+ *   os    - the output stream
+ */
+void FlowGraph::dumpBranchStats(std::ostream &os) {
+    os << "* IF-CONVERSION:" << std::endl;
+    os << "    " << std::left << std::setw(16) << "branches"
+       << num_removed_branches << std::endl;
+    os << "    " << std::left << std::setw(16) << "min/max" << num_min_max
+       << std::endl;
+    os << "    " << std::left << std::setw(16) << "selects" << num_selects
+       << std::endl;
+}
@@ -0,0 +1,597 @@
+/*****************************************************
+ *  Induction-variable Strength Reduction.
+ *
+ *  (see "Engineering a Compiler", Cooper and Torczon, 10.7.2.) The TACs are
+ *  in SSA form (see tac/ssa.cpp), and every loop has a preheader (see
+ *  tac/licm.cpp). A basic induction variable is a PHI at a loop header
+ *  whose argument from the preheader is its initial value, and whose
+ *  arguments from the back edges are all "i + c" (or "i - c") of the same
+ *  constant step c. Then, innermost loops first:
+ *
+ *    - two basic induction variables of the same loop with the same initial
+ *      value and the same step always hold the same value, so the second is
+ *      replaced with the first;
+ *    - a derived induction variable "i * k" (k invariant in the loop) is
+ *      replaced with a new basic induction variable starting at "init * k"
+ *      and stepping by "c * k" right after every increment of i;
+ *    - a branch leaving the loop on "i < n" (n a constant) is rewritten as
+ *      "i * k < n * k" on such a new variable, if k is a positive constant
+ *      and no value compared may overflow (the initial value is a constant
+ *      too, i moves towards n, and the branch is reached on every
+ *      iteration, so that i never steps past n untested);
+ *    - a basic induction variable used by nothing but its own increments is
+ *      removed.
+ *
+ *  MiniDecaf has no arrays yet, so the multiplications are only those
+ *  written in the source; the same transformation will take the address
+ *  computations of a loop.
+ */
+
+#include "3rdparty/vector.hpp"
+#include "config.hpp"
+#include "tac/flow_graph.hpp"
+#include "tac/tac.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <iomanip>
+#include <map>
+
+using namespace mind;
+using namespace mind::tac;
+using namespace mind::util;
+
+// the statistics (of all the functions)
+static int num_reduced_muls = 0;
+static int num_merged_ivs = 0;
+static int num_rewritten_tests = 0;
+static int num_removed_ivs = 0;
+
+namespace {
+// a basic induction variable
+struct BasicIv {
+    Tac *phi;             // the PHI defining it (at the loop header)
+    Temp init;            // the value entering the loop
+    int step;             // the value added on every iteration
+    Vector<Tac *> incs;   // the increments (reaching the back edges)
+    Vector<Tac *> copies; // the copies of the increments (to the PHI)
+};
+
+// a derived induction variable "i * k", turned into a basic one
+struct DerivedIv {
+    int iv;         // the basic induction variable (index)
+    Temp var;       // the PHI of the new variable
+    int factor;     // the constant k (if "var_factor" is NULL)
+    Temp var_factor; // the invariant k (NULL if a constant)
+    Vector<Temp> at; // the new variable after every increment of i
+};
+} // namespace
+
+// gets the constant a variable is loaded with (false if not a constant)
+static bool getConstant(Vector<Tac *> &def_tac, Temp v, int &c) {
+    Tac *d = def_tac[v->id];
+    if (NULL == d || Tac::LOAD_IMM4 != d->op_code)
+        return false;
+
+    c = d->op1.ival;
+    return true;
+}
+
+// follows the copies back to the variable copied
+static Temp lookThrough(Vector<Tac *> &def_tac, Temp v) {
+    while (NULL != def_tac[v->id] && Tac::ASSIGN == def_tac[v->id]->op_code)
+        v = def_tac[v->id]->op1.var;
+
+    return v;
+}
+
+// whether a value fits in 32 bits
+static bool fits(long long x) { return x >= INT_MIN && x <= INT_MAX; }
+
+// multiplies two integers with the 32-bit wrap-around
+static int wrapMul(int a, int b) { return (int)((unsigned)a * (unsigned)b); }
+
+// inserts a TAC into a basic block (at the beginning if "after" is NULL)
+static void insertTac(BasicBlock *b, Tac *after, Tac *t) {
+    t->prev = after;
+    t->next = (NULL == after) ? b->tac_chain : after->next;
+    t->bb_num = b->bb_num;
+    if (NULL != t->next)
+        t->next->prev = t;
+    if (NULL == after)
+        b->tac_chain = t;
+    else
+        after->next = t;
+}
+
+// appends a TAC to a basic block
+static void appendTac(BasicBlock *b, Tac *t) {
+    Tac *tail = b->tac_chain;
+
+    while (NULL != tail && NULL != tail->next)
+        tail = tail->next;
+    insertTac(b, tail, t);
+}
+
+// removes a TAC from its block
+static void unlinkTac(BasicBlock *b, Tac *t) {
+    if (NULL != t->prev)
+        t->prev->next = t->next;
+    else
+        b->tac_chain = t->next;
+    if (NULL != t->next)
+        t->next->prev = t->prev;
+}
+
+/* Gets the step of an increment of an induction variable.
+ *
+ * PARAMETERS:
+ *   t     - the TAC
+ *   i     - the induction variable (the PHI)
+ *   def_tac - the TAC defining every variable
+ *   step  - (output) the step
+ * RETURNS:
+ *   false if the TAC is not "i + c", "c + i" or "i - c" of a constant c
+ */
+static bool getStep(Tac *t, Temp i, Vector<Tac *> &def_tac, int &step) {
+    switch (t->op_code) {
+    case Tac::ADD:
+        if (t->op1.var == i)
+            return getConstant(def_tac, t->op2.var, step);
+        return t->op2.var == i && getConstant(def_tac, t->op1.var, step);
+
+    case Tac::SUB:
+        if (t->op1.var != i || !getConstant(def_tac, t->op2.var, step) ||
+            INT_MIN == step)
+            return false;
+        step = -step;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+/* Gets the relation "i op n" of a comparison the other way around.
+ *
+ * PARAMETERS:
+ *   op    - the comparison
+ *   swap  - whether the operands are exchanged ("n op i")
+ *   negate - whether the relation is negated
+ * RETURNS:
+ *   the relation of "i" to "n"
+ */
+static Tac::Kind normalize(Tac::Kind op, bool swap, bool negate) {
+    if (swap)
+        op = (Tac::LES == op)   ? Tac::GTR
+             : (Tac::LEQ == op) ? Tac::GEQ
+             : (Tac::GTR == op) ? Tac::LES
+                                : Tac::LEQ;
+    if (negate)
+        op = (Tac::LES == op)   ? Tac::GEQ
+             : (Tac::LEQ == op) ? Tac::GTR
+             : (Tac::GTR == op) ? Tac::LEQ
+                                : Tac::LES;
+
+    return op;
+}
+
+/* Tests whether a block is reached on every iteration of a loop.
+ *
+ * PARAMETERS:
+ *   g     - the flow graph
+ *   b     - the block number
+ *   h     - the loop header
+ * RETURNS:
+ *   true if b dominates the sources of all the back edges to h
+ */
+static bool onEveryIteration(FlowGraph *g, int b, int h) {
+    Vector<int> &preds = g->getPredecessors(h);
+
+    for (size_t k = 0; k < preds.size(); ++k)
+        if (g->dominates(h, preds[k]) && !g->dominates(b, preds[k]))
+            return false;
+
+    return true;
+}
+
+/* Finds the basic induction variables of a loop.
+ *
+ * PARAMETERS:
+ *   g     - the flow graph
+ *   h     - the loop header
+ *   ph    - the preheader
+ *   def_tac - the TAC defining every variable
+ *   ivs   - (output) the induction variables
+ */
+static void findBasicIvs(FlowGraph *g, int h, int ph, Vector<Tac *> &def_tac,
+                         Vector<BasicIv> &ivs) {
+    for (Tac *t = g->getBlock(h)->tac_chain;
+         t != NULL && Tac::PHI == t->op_code; t = t->next) {
+        BasicIv iv;
+        bool ok = true;
+
+        iv.phi = t;
+        iv.init = NULL;
+        iv.step = 0;
+        for (PhiArg a = t->args; NULL != a && ok; a = a->next) {
+            if (g->getIdom(a->pred) < 0)
+                continue;
+            if (a->pred == ph) {
+                iv.init = a->var;
+                continue;
+            }
+
+            Temp v = a->var;
+            while (NULL != def_tac[v->id] &&
+                   Tac::ASSIGN == def_tac[v->id]->op_code) {
+                Tac *c = def_tac[v->id];
+                if (std::find(iv.copies.begin(), iv.copies.end(), c) ==
+                    iv.copies.end())
+                    iv.copies.push_back(c);
+                v = c->op1.var;
+            }
+            Tac *inc = def_tac[v->id];
+            int step = 0;
+            ok = NULL != inc && g->inLoop(inc->bb_num, h) &&
+                 getStep(inc, t->op0.var, def_tac, step) && 0 != step &&
+                 (0 == iv.step || iv.step == step);
+            iv.step = step;
+            if (ok && std::find(iv.incs.begin(), iv.incs.end(), inc) ==
+                          iv.incs.end())
+                iv.incs.push_back(inc);
+        }
+
+        if (ok && NULL != iv.init && !iv.incs.empty())
+            ivs.push_back(iv);
+    }
+}
+
+/* Removes a basic induction variable if it is only used by itself.
+ *
+ * PARAMETERS:
+ *   g     - the flow graph
+ *   iv    - the induction variable
+ * RETURNS:
+ *   true if it has been removed
+ */
+static bool removeIfDead(FlowGraph *g, BasicIv &iv) {
+    Vector<Tac *> family;
+    Vector<int> in_family;
+    Temp *v[2];
+
+    family.push_back(iv.phi);
+    family.insert(family.end(), iv.incs.begin(), iv.incs.end());
+    family.insert(family.end(), iv.copies.begin(), iv.copies.end());
+    in_family.resize(g->numTemps(), 0);
+    for (size_t k = 0; k < family.size(); ++k)
+        in_family[family[k]->getDef()->id] = 1;
+
+    for (size_t i = 0; i < g->size(); ++i) {
+        BasicBlock *b = g->getBlock(i);
+        if (g->getIdom(i) < 0)
+            continue;
+        for (Tac *t = b->tac_chain; t != NULL; t = t->next) {
+            if (NULL != t->getDef() && in_family[t->getDef()->id])
+                continue;
+            int n = t->getUses(v);
+            for (int j = 0; j < n; ++j)
+                if (in_family[(*v[j])->id])
+                    return false;
+            for (PhiArg a = t->args; NULL != a; a = a->next)
+                if (in_family[a->var->id])
+                    return false;
+        }
+        if (BasicBlock::BY_JUMP != b->end_kind && in_family[b->var->id])
+            return false;
+    }
+
+    for (size_t k = 0; k < family.size(); ++k)
+        unlinkTac(g->getBlock(family[k]->bb_num), family[k]);
+    return true;
+}
+
+/* Reduces the strength of the induction variables of every loop.
+ *
+ * NOTE:
+ *   it should be done in SSA form, after hoistInvariants (so that the
+ *   invariant operands are already out of the loops).
+ */
+void FlowGraph::reduceStrength(void) {
+    Vector<int> headers;
+    int max_depth = 0;
+
+    for (int i = 0; i < _n; ++i)
+        max_depth = std::max(max_depth, getLoopDepth(i));
+    if (0 == max_depth)
+        return;
+    for (int d = max_depth; d > 0; --d)
+        for (int i = 0; i < _n; ++i)
+            if (getLoopHeader(i) == i && getLoopDepth(i) == d)
+                headers.push_back(i);
+
+    for (size_t l = 0; l < headers.size(); ++l) {
+        int h = headers[l], ph = makePreheader(h);
+        BasicBlock *pb = _bbs[ph];
+        Vector<Tac *> def_tac;
+        Vector<Temp> leader;
+        Vector<int> order, blocks;
+        Vector<BasicIv> ivs;
+        Vector<DerivedIv> derived;
+        Vector<int> merged;
+
+        // Step 1. finds the basic induction variables
+        def_tac.resize(numTemps(), NULL);
+        for (int i = 0; i < _n; ++i)
+            for (Tac *t = _bbs[i]->tac_chain; t != NULL; t = t->next)
+                if (NULL != t->getDef())
+                    def_tac[t->getDef()->id] = t;
+        getPostorder(order);
+        for (int j = (int)order.size() - 1; j >= 0; --j)
+            if (inLoop(order[j], h))
+                blocks.push_back(order[j]);
+
+        findBasicIvs(this, h, ph, def_tac, ivs);
+        if (ivs.empty())
+            continue;
+
+        // Step 2. merges the induction variables moving in lockstep
+        int ic, jc;
+
+        leader.resize(numTemps(), NULL);
+        for (size_t k = 0; k < leader.size(); ++k)
+            leader[k] = _temps[k];
+        merged.resize(ivs.size(), 0);
+        for (size_t i = 0; i < ivs.size(); ++i)
+            for (size_t j = i + 1; j < ivs.size() && !merged[i]; ++j) {
+                if (merged[j] || ivs[i].step != ivs[j].step)
+                    continue;
+                if (ivs[i].init != ivs[j].init &&
+                    !(getConstant(def_tac, ivs[i].init, ic) &&
+                      getConstant(def_tac, ivs[j].init, jc) && ic == jc))
+                    continue;
+                leader[ivs[j].phi->op0.var->id] = ivs[i].phi->op0.var;
+                merged[j] = 1;
+                ++num_merged_ivs;
+            }
+        if (std::find(merged.begin(), merged.end(), 1) != merged.end())
+            replaceVariables(leader);
+
+        // Step 3. replaces "i * k" with a new induction variable
+        //         (one for every k of every i)
+        std::map<std::pair<int, int>, int> by_const, by_var; // (i, k) ->
+                                                             // derived
+        Vector<std::pair<Temp, Temp> > replaced;
+
+        for (size_t j = 0; j < blocks.size(); ++j) {
+            BasicBlock *b = _bbs[blocks[j]];
+            for (Tac *t = b->tac_chain, *next; t != NULL; t = next) {
+                next = t->next;
+                if (Tac::MUL != t->op_code)
+                    continue;
+
+                // finds "i * k" (or "k * i"), where i may be incremented
+                int iv = -1, inc = -1, kc = 0;
+                Temp k = NULL;
+                for (int o = 0; o < 2 && iv < 0; ++o) {
+                    Temp x = lookThrough(def_tac, o ? t->op2.var : t->op1.var);
+                    Temp y = o ? t->op1.var : t->op2.var;
+                    Tac *d = def_tac[y->id];
+                    bool is_const = getConstant(def_tac, y, kc);
+                    if ((is_const && 0 == kc) ||
+                        (!is_const && NULL != d && inLoop(d->bb_num, h)))
+                        continue;
+                    for (size_t i = 0; i < ivs.size() && iv < 0; ++i) {
+                        if (merged[i])
+                            continue;
+                        if (ivs[i].phi->op0.var == x)
+                            iv = i;
+                        for (size_t n = 0; n < ivs[i].incs.size(); ++n)
+                            if (ivs[i].incs[n]->op0.var == x) {
+                                iv = i;
+                                inc = n;
+                            }
+                    }
+                    k = is_const ? NULL : y;
+                }
+                if (iv < 0)
+                    continue;
+
+                std::map<std::pair<int, int>, int> &which =
+                    (NULL == k) ? by_const : by_var;
+                std::pair<int, int> key(iv, (NULL == k) ? kc : k->id);
+
+                if (!which.count(key)) {
+                    // creates the new variable: "s = PHI(init * k, s + c * k
+                    // after every increment)"
+                    BasicIv &bi = ivs[iv];
+                    DerivedIv di;
+                    Temp s = newVersion(t->op0.var);
+                    _origin[s->id] = s->id; // (a variable of its own)
+                    di.iv = iv;
+                    di.var = s;
+                    di.factor = kc;
+                    di.var_factor = k;
+
+                    Temp s0 = newVersion(s), kt = k, st = k;
+                    if (NULL == k) {
+                        if (getConstant(def_tac, bi.init, ic)) {
+                            appendTac(pb, Tac::LoadImm4(s0, wrapMul(ic, kc)));
+                        } else {
+                            kt = newVersion(s);
+                            _origin[kt->id] = kt->id;
+                            appendTac(pb, Tac::LoadImm4(kt, kc));
+                            appendTac(pb, Tac::Mul(s0, bi.init, kt));
+                        }
+                    } else {
+                        if (getConstant(def_tac, bi.init, ic) && 0 == ic)
+                            appendTac(pb, Tac::LoadImm4(s0, 0));
+                        else
+                            appendTac(pb, Tac::Mul(s0, bi.init, k));
+                        if (1 != bi.step) {
+                            Temp c = newVersion(s);
+                            _origin[c->id] = c->id;
+                            st = newVersion(s);
+                            _origin[st->id] = st->id;
+                            appendTac(pb, Tac::LoadImm4(c, bi.step));
+                            appendTac(pb, Tac::Mul(st, c, k));
+                        }
+                    }
+
+                    for (size_t n = 0; n < bi.incs.size(); ++n) {
+                        Tac *at = bi.incs[n];
+                        BasicBlock *ab = _bbs[at->bb_num];
+                        Temp sn = newVersion(s);
+                        if (NULL == k) {
+                            st = newVersion(s);
+                            _origin[st->id] = st->id;
+                            insertTac(ab, at,
+                                      Tac::LoadImm4(st, wrapMul(bi.step, kc)));
+                            at = at->next;
+                        }
+                        insertTac(ab, at, Tac::Add(sn, s, st));
+                        di.at.push_back(sn);
+                    }
+
+                    Tac *phi = Tac::Phi(s);
+                    PhiArg *tail = &phi->args;
+                    for (PhiArg a = bi.phi->args; NULL != a; a = a->next) {
+                        PhiArg sa = new PhiArgObject();
+                        sa->pred = a->pred;
+                        sa->next = NULL;
+                        sa->var = s;
+                        if (a->pred == ph) {
+                            sa->var = s0;
+                        } else if (getIdom(a->pred) >= 0) {
+                            Temp x = lookThrough(def_tac, a->var);
+                            for (size_t n = 0; n < bi.incs.size(); ++n)
+                                if (bi.incs[n]->op0.var == x)
+                                    sa->var = di.at[n];
+                        }
+                        *tail = sa;
+                        tail = &sa->next;
+                    }
+                    insertTac(_bbs[h], NULL, phi);
+
+                    which[key] = derived.size();
+                    derived.push_back(di);
+                }
+
+                DerivedIv &di = derived[which[key]];
+                replaced.push_back(std::make_pair(
+                    t->op0.var, (inc < 0) ? di.var : di.at[inc]));
+                unlinkTac(b, t);
+                ++num_reduced_muls;
+            }
+        }
+
+        leader.clear();
+        for (size_t n = 0; n < numTemps(); ++n)
+            leader.push_back(_temps[n]);
+        for (size_t n = 0; n < replaced.size(); ++n)
+            leader[replaced[n].first->id] = replaced[n].second;
+        replaceVariables(leader);
+        def_tac.resize(numTemps(), NULL);
+        for (int i = 0; i < _n; ++i)
+            for (Tac *t = _bbs[i]->tac_chain; t != NULL; t = t->next)
+                if (NULL != t->getDef())
+                    def_tac[t->getDef()->id] = t;
+
+        // Step 4. rewrites the exit tests on the new variables
+        for (size_t j = 0; j < blocks.size(); ++j) {
+            BasicBlock *b = _bbs[blocks[j]];
+            if (BasicBlock::BY_JZERO != b->end_kind)
+                continue;
+            bool stay0 = inLoop(b->next[0], h);
+            bool stay1 = inLoop(b->next[1], h);
+            Tac *t = def_tac[b->var->id];
+            if (stay0 == stay1 || NULL == t || !inLoop(t->bb_num, h) ||
+                !onEveryIteration(this, b->bb_num, h) ||
+                (Tac::LES != t->op_code && Tac::LEQ != t->op_code &&
+                 Tac::GTR != t->op_code && Tac::GEQ != t->op_code))
+                continue;
+
+            for (size_t d = 0; d < derived.size(); ++d) {
+                DerivedIv &di = derived[d];
+                BasicIv &bi = ivs[di.iv];
+                int n, init;
+                if (NULL != di.var_factor || di.factor <= 0 ||
+                    !getConstant(def_tac, bi.init, init))
+                    continue;
+
+                // finds "i op n" (or "n op i")
+                bool swap = false;
+                Temp x = lookThrough(def_tac, t->op1.var), s = NULL;
+                if (!getConstant(def_tac, t->op2.var, n)) {
+                    swap = true;
+                    x = lookThrough(def_tac, t->op2.var);
+                    if (!getConstant(def_tac, t->op1.var, n))
+                        continue;
+                }
+                if (bi.phi->op0.var == x)
+                    s = di.var;
+                for (size_t m = 0; m < bi.incs.size(); ++m)
+                    if (bi.incs[m]->op0.var == x)
+                        s = di.at[m];
+                if (NULL == s)
+                    continue;
+
+                // i moves from "init" towards "n" by a step on every
+                // iteration (while the loop goes on), and is compared on
+                // every iteration, so that every value compared is between
+                // "init" and "n + step"
+                Tac::Kind op = normalize(t->op_code, swap, stay0);
+                bool up = (Tac::LES == op || Tac::LEQ == op);
+                if (up != (bi.step > 0))
+                    continue;
+                long long ends[4] = {init, (long long)init + bi.step, n,
+                                     (long long)n + bi.step};
+                bool safe = true;
+                for (int e = 0; e < 4 && safe; ++e)
+                    safe = fits(ends[e]) && fits(ends[e] * di.factor);
+                if (!safe)
+                    continue;
+
+                Temp c = newVersion(s);
+                _origin[c->id] = c->id;
+                insertTac(_bbs[t->bb_num], t->prev,
+                          Tac::LoadImm4(c, n * di.factor));
+                def_tac.resize(numTemps(), NULL);
+                def_tac[c->id] = t->prev;
+                if (swap) {
+                    t->op1.var = c;
+                    t->op2.var = s;
+                } else {
+                    t->op1.var = s;
+                    t->op2.var = c;
+                }
+                ++num_rewritten_tests;
+                break;
+            }
+        }
+
+        // Step 5. removes the basic induction variables no longer used
+        for (size_t i = 0; i < ivs.size(); ++i)
+            if (removeIfDead(this, ivs[i]))
+                ++num_removed_ivs;
+    }
+
+    removeDeadTacs();
+}
+
+/* Prints the statistics of the strength reduction (of all the functions).
+ *
+ * PARAMETERS:
+ *   os    - the output stream
+ */
+void FlowGraph::dumpInductionStats(std::ostream &os) {
+    os << "* IVSR:" << std::endl;
+    os << "    " << std::left << std::setw(16) << "reduced MULs"
+       << num_reduced_muls << std::endl;
+    os << "    " << std::left << std::setw(16) << "merged IVs"
+       << num_merged_ivs << std::endl;
+    os << "    " << std::left << std::setw(16) << "rewritten tests"
+       << num_rewritten_tests << std::endl;
+    os << "    " << std::left << std::setw(16) << "removed IVs"
+       << num_removed_ivs << std::endl;
+}
@@ -0,0 +1,537 @@
+/*****************************************************
+ *  Implementation of the "Inliner" class.
+ *
+ *  The cost of a function is the number of its TACs (the MARKs and the
+ *  MEMOs aside), and the benefit of inlining a call is the call sequence
+ *  removed (a PARAM for every argument, the CALL, and the entry and exit
+ *  of the callee). Under -O:
+ *
+ *    - a callee costing about as much as its call sequence is always
+ *      inlined (the small helpers);
+ *    - a callee called only once (and not recursive) is always inlined, and
+ *      then removed, since nothing calls it any more;
+ *    - a callee up to INLINE_MAX TACs is inlined as long as the caller stays
+ *      within CALLER_BUDGET TACs;
+ *    - a call inside a cycle of the call graph is not inlined, except that a
+ *      small function calling itself is inlined into itself RECURSION_LIMIT
+ *      levels deep.
+ *
+ *  Before all that, a function calling itself and returning the result at
+ *  once (a tail recursion, e.g. "return gcd(b, a % b);") jumps back to its
+ *  beginning instead, with the arguments assigned to the parameters. Such a
+ *  function is then a loop, and no longer recursive.
+ */
+
+#include "tac/inliner.hpp"
+#include "config.hpp"
+#include "tac/tac.hpp"
+
+#include <algorithm>
+#include <iomanip>
+
+using namespace mind;
+using namespace mind::tac;
+using namespace mind::util;
+
+#define WORD_SIZE 4
+
+// the benefit over which a callee is always inlined (in TACs)
+#define INLINE_ALWAYS 8
+// the size of the largest callee inlined (in TACs)
+#define INLINE_MAX 60
+// the size of the largest caller inlined into (in TACs)
+#define CALLER_BUDGET 600
+// how many levels deep a function is inlined into itself
+#define RECURSION_LIMIT 1
+
+// the statistics (of the whole program)
+static int num_inlined_calls = 0;
+static int num_removed_functions = 0;
+static int num_tail_recursions = 0;
+
+// gets the number of TACs of a TAC sequence (the MARKs and the MEMOs aside)
+static int countTacs(Tac *t) {
+    int n = 0;
+
+    for (; NULL != t; t = t->next)
+        if (Tac::MARK != t->op_code && Tac::MEMO != t->op_code)
+            ++n;
+
+    return n;
+}
+
+// gets the upper bound of the variable ids of a TAC sequence
+static int countTemps(Tac *t) {
+    int n = 0;
+
+    for (; NULL != t; t = t->next) {
+        Temp v[3] = {t->op0.var, t->op1.var, t->op2.var};
+        for (int i = 0; i < 3; ++i)
+            if (NULL != v[i] && v[i]->id >= n)
+                n = v[i]->id + 1;
+    }
+
+    return n;
+}
+
+// creates a new variable (of the same size as another)
+static Temp newTemp(Temp v, int &num_temps) {
+    Temp c = new TempObject();
+    c->id = num_temps++;
+    c->size = v->size;
+    c->offset = 0;
+    c->is_offset_fixed = false;
+    c->reg = 0;
+    c->is_const = false;
+    c->value = 0;
+
+    return c;
+}
+
+// gets the copy of a variable of the callee (created on the first use)
+static Temp mapTemp(std::map<Temp, Temp> &temps, Temp v, int &num_temps) {
+    if (NULL == v)
+        return NULL;
+
+    std::map<Temp, Temp>::iterator it = temps.find(v);
+    if (it != temps.end())
+        return it->second;
+
+    Temp c = newTemp(v, num_temps);
+    temps[v] = c;
+    return c;
+}
+
+// appends a TAC to a TAC sequence (given its last TAC)
+static void chainUp(Tac *&tail, Tac *t) {
+    t->prev = tail;
+    t->next = NULL;
+    tail->next = t;
+    tail = t;
+}
+
+/* Constructor.
+ *
+ * PARAMETERS:
+ *   ps    - the Piece list of the program
+ */
+Inliner::Inliner(Piece *ps) {
+    _ps = ps;
+    _index = _num_sccs = 0;
+    _label_count = 0;
+}
+
+/* Builds the call graph of the program.
+ *
+ * NOTE:
+ *   the calls of the functions without a body (if any) are left alone.
+ */
+void Inliner::buildCallGraph(void) {
+    for (Piece *p = _ps; NULL != p; p = p->next) {
+        if (Piece::FUNCTY != p->kind)
+            continue;
+
+        Node n;
+        n.f = p->as.functy;
+        n.piece = p;
+        n.size = countTacs(n.f->code);
+        n.num_temps = countTemps(n.f->code);
+        n.num_calls = 0;
+        n.was_called = n.recursive = n.on_stack = false;
+        n.scc = n.index = n.low = -1;
+        _by_name[n.f->entry->str_form] = _nodes.size();
+        _nodes.push_back(n);
+
+        for (Tac *t = n.f->code; NULL != t; t = t->next)
+            if (Tac::MARK == t->op_code && t->op0.label->id >= _label_count)
+                _label_count = t->op0.label->id + 1;
+    }
+
+    for (size_t k = 0; k < _nodes.size(); ++k)
+        removeTailRecursion(k);
+
+    for (size_t k = 0; k < _nodes.size(); ++k)
+        for (Tac *t = _nodes[k].f->code; NULL != t; t = t->next) {
+            if (Tac::CALL != t->op_code ||
+                !_by_name.count(t->op1.label->str_form))
+                continue;
+            int callee = _by_name[t->op1.label->str_form];
+            _nodes[k].calls.push_back(callee);
+            ++_nodes[callee].num_calls;
+            _nodes[callee].was_called = true;
+            _nodes[callee].recursive |= (callee == (int)k);
+        }
+
+    for (size_t k = 0; k < _nodes.size(); ++k)
+        if (_nodes[k].index < 0)
+            findComponents(k);
+}
+
+/* Turns the tail recursions of a function into jumps back to its beginning.
+ *
+ * PARAMETERS:
+ *   k     - the function
+ * NOTE:
+ *   "PARAM a1; ...; PARAM an; r = CALL f; RETURN r" in f becomes
+ *   "p1 = a1; ...; pn = an; JUMP loop", where "loop" is marked right after
+ *   the entry label. an argument which is another parameter (as the "b" of
+ *   "gcd(b, a % b)") is copied into a new variable first, since that
+ *   parameter may have been assigned already.
+ */
+void Inliner::removeTailRecursion(int k) {
+    Node &n = _nodes[k];
+    Vector<Temp> params; // the parameters by position (NULL if unused)
+    Vector<Tac *> calls;
+    Tac *entry = NULL;
+
+    for (Tac *t = n.f->code; NULL != t; t = t->next) {
+        Temp v[3] = {t->op0.var, t->op1.var, t->op2.var};
+        for (int i = 0; i < 3; ++i) {
+            if (NULL == v[i] || !v[i]->is_offset_fixed)
+                continue;
+            size_t pos = v[i]->offset / WORD_SIZE;
+            if (pos >= params.size())
+                params.resize(pos + 1, NULL);
+            params[pos] = v[i];
+        }
+
+        if (Tac::MARK == t->op_code && t->op0.label == n.f->entry)
+            entry = t;
+        if (Tac::CALL == t->op_code &&
+            t->op1.label->str_form == n.f->entry->str_form &&
+            NULL != t->next && Tac::RETURN == t->next->op_code &&
+            t->next->op0.var == t->op0.var)
+            calls.push_back(t);
+    }
+    if (calls.empty())
+        return;
+
+    Label loop = new LabelObject();
+    loop->id = _label_count++;
+    loop->target = false;
+    Tac *mark = Tac::Mark(loop);
+    mind_assert(NULL != entry);
+    mark->prev = entry;
+    mark->next = entry->next;
+    if (NULL != entry->next)
+        entry->next->prev = mark;
+    entry->next = mark;
+
+    for (size_t j = 0; j < calls.size(); ++j) {
+        Tac *call = calls[j], *first = call, head, *tail = &head;
+        Vector<Temp> copies;
+
+        while (NULL != first->prev && Tac::PARAM == first->prev->op_code)
+            first = first->prev;
+        for (Tac *p = first; p != call; p = p->next) {
+            size_t pos = copies.size();
+            copies.push_back(p->op0.var);
+            if (pos >= params.size() || NULL == params[pos] ||
+                params[pos] == p->op0.var) {
+                copies[pos] = NULL; // (unused, or passed on as it is)
+            } else if (p->op0.var->is_offset_fixed) {
+                copies[pos] = newTemp(p->op0.var, n.num_temps);
+                chainUp(tail, Tac::Assign(copies[pos], p->op0.var));
+            }
+        }
+        for (size_t pos = 0; pos < copies.size(); ++pos)
+            if (NULL != copies[pos])
+                chainUp(tail, Tac::Assign(params[pos], copies[pos]));
+        chainUp(tail, Tac::Jump(loop));
+
+        // (the RETURN after the CALL goes as well)
+        Tac *after = call->next->next;
+        head.next->prev = first->prev;
+        first->prev->next = head.next;
+        tail->next = after;
+        if (NULL != after)
+            after->prev = tail;
+        ++num_tail_recursions;
+    }
+    n.size = countTacs(n.f->code);
+}
+
+/* Finds the strongly connected components of the call graph.
+ *
+ * PARAMETERS:
+ *   v     - the function to start from
+ * NOTE:
+ *   Tarjan's algorithm, which completes a component after all the components
+ *   it reaches, so that "_order" has the callees first.
+ */
+void Inliner::findComponents(int v) {
+    Node &n = _nodes[v];
+
+    n.index = n.low = _index++;
+    _stack.push_back(v);
+    n.on_stack = true;
+
+    for (size_t k = 0; k < n.calls.size(); ++k) {
+        int w = n.calls[k];
+        if (_nodes[w].index < 0) {
+            findComponents(w);
+            _nodes[v].low = std::min(_nodes[v].low, _nodes[w].low);
+        } else if (_nodes[w].on_stack) {
+            _nodes[v].low = std::min(_nodes[v].low, _nodes[w].index);
+        }
+    }
+
+    if (_nodes[v].low != _nodes[v].index)
+        return;
+
+    size_t start = _stack.size();
+    do {
+        --start;
+    } while (_stack[start] != v);
+    for (size_t k = start; k < _stack.size(); ++k) {
+        Node &m = _nodes[_stack[k]];
+        m.on_stack = false;
+        m.scc = _num_sccs;
+        m.recursive |= (_stack.size() - start > 1);
+        _order.push_back(_stack[k]);
+    }
+    _stack.resize(start);
+    ++_num_sccs;
+}
+
+/* Decides whether to inline a call.
+ *
+ * PARAMETERS:
+ *   caller - the function calling
+ *   callee - the function called
+ *   size   - the size of the callee (in TACs)
+ *   num_args - the number of arguments
+ * RETURNS:
+ *   true if the call should be inlined
+ */
+bool Inliner::shouldInline(int caller, int callee, int size, int num_args) {
+    Node &g = _nodes[caller], &f = _nodes[callee];
+
+    if (caller == callee)
+        return size - num_args - 2 <= INLINE_ALWAYS &&
+               g.size + size <= CALLER_BUDGET;
+    if (g.scc == f.scc)
+        return false; // (the calls between them would never end)
+    if (1 == f.num_calls && !f.recursive)
+        return true;
+    if (size - num_args - 2 <= INLINE_ALWAYS)
+        return true;
+
+    return size <= INLINE_MAX && g.size + size <= CALLER_BUDGET;
+}
+
+/* Copies the TACs of a function.
+ *
+ * PARAMETERS:
+ *   k     - the function
+ * RETURNS:
+ *   the copy (with the same variables and labels)
+ */
+Tac *Inliner::copyBody(int k) {
+    Tac head, *tail = &head;
+
+    head.next = NULL;
+    for (Tac *t = _nodes[k].f->code; NULL != t; t = t->next)
+        chainUp(tail, new Tac(*t));
+    if (NULL != head.next)
+        head.next->prev = NULL;
+
+    return head.next;
+}
+
+/* Replaces a call with a copy of the callee.
+ *
+ * PARAMETERS:
+ *   caller - the function calling
+ *   call   - the CALL tac (after its PARAMs)
+ *   callee - the function called
+ *   body   - the TACs of the callee to copy
+ *   calls  - (output) the CALLs copied
+ */
+void Inliner::inlineCall(int caller, Tac *call, int callee, Tac *body,
+                         Vector<Tac *> &calls) {
+    Node &g = _nodes[caller];
+    Vector<Temp> args; // the arguments in order
+    std::map<Temp, Temp> temps;
+    std::map<Label, Label> labels;
+    Tac *first = call, head, *tail = &head;
+
+    while (NULL != first->prev && Tac::PARAM == first->prev->op_code)
+        first = first->prev;
+    for (Tac *p = first; p != call; p = p->next)
+        args.push_back(p->op0.var);
+
+    // Step 1. assigns the arguments to (the copies of) the parameters
+    //         (whose offset tells their position)
+    for (Tac *t = body; NULL != t; t = t->next) {
+        Temp v[3] = {t->op0.var, t->op1.var, t->op2.var};
+        for (int i = 0; i < 3; ++i) {
+            if (NULL == v[i] || !v[i]->is_offset_fixed || temps.count(v[i]))
+                continue;
+            size_t k = v[i]->offset / WORD_SIZE;
+            mind_assert(k < args.size());
+            chainUp(tail, Tac::Assign(mapTemp(temps, v[i], g.num_temps),
+                                      args[k]));
+        }
+    }
+
+    // Step 2. copies the body, where a return assigns the result and jumps
+    //         to the end (or simply returns, if the caller returns the
+    //         result at once, so that the tail calls of the callee remain)
+    bool returns = (NULL != call->next && Tac::RETURN == call->next->op_code &&
+                    call->next->op0.var == call->op0.var);
+    Label end = new LabelObject();
+    end->id = _label_count++;
+    end->target = false;
+
+    for (Tac *t = body; NULL != t; t = t->next)
+        if (Tac::MARK == t->op_code && t->op0.label != _nodes[callee].f->entry) {
+            Label l = new LabelObject();
+            l->id = _label_count++;
+            l->target = false;
+            labels[t->op0.label] = l;
+        }
+
+    for (Tac *t = body; NULL != t; t = t->next) {
+        switch (t->op_code) {
+        case Tac::MEMO:
+            break;
+
+        case Tac::MARK:
+            if (labels.count(t->op0.label))
+                chainUp(tail, Tac::Mark(labels[t->op0.label]));
+            break;
+
+        case Tac::JUMP:
+            chainUp(tail, Tac::Jump(labels[t->op0.label]));
+            break;
+
+        case Tac::JZERO:
+            chainUp(tail, Tac::JZero(labels[t->op0.label],
+                                     mapTemp(temps, t->op1.var, g.num_temps)));
+            break;
+
+        case Tac::RETURN:
+            if (returns) {
+                chainUp(tail, Tac::Return(mapTemp(temps, t->op0.var,
+                                                  g.num_temps)));
+                break;
+            }
+            chainUp(tail,
+                    Tac::Assign(call->op0.var,
+                                mapTemp(temps, t->op0.var, g.num_temps)));
+            chainUp(tail, Tac::Jump(end));
+            break;
+
+        default: {
+            Tac *c = new Tac(*t);
+            c->op0.var = mapTemp(temps, t->op0.var, g.num_temps);
+            c->op1.var = mapTemp(temps, t->op1.var, g.num_temps);
+            c->op2.var = mapTemp(temps, t->op2.var, g.num_temps);
+            chainUp(tail, c);
+            if (Tac::CALL == t->op_code &&
+                _by_name.count(t->op1.label->str_form)) {
+                ++_nodes[_by_name[t->op1.label->str_form]].num_calls;
+                calls.push_back(c);
+            }
+            break;
+        }
+        }
+    }
+    chainUp(tail, Tac::Mark(end));
+
+    // Step 3. puts the copy in place of the PARAMs and the CALL
+    head.next->prev = first->prev;
+    first->prev->next = head.next; // (the entry label comes first)
+    tail->next = call->next;
+    if (NULL != call->next)
+        call->next->prev = tail;
+
+    g.size += countTacs(head.next) - args.size() - 1;
+    --_nodes[callee].num_calls;
+    ++num_inlined_calls;
+}
+
+/* Inlines the calls chosen by the cost model.
+ *
+ * RETURNS:
+ *   the Piece list, without the functions no longer called
+ */
+Piece *Inliner::inlineCalls(void) {
+    buildCallGraph();
+
+    for (size_t j = 0; j < _order.size(); ++j) {
+        int k = _order[j];
+        Vector<Tac *> sites, calls;
+        Tac *self = NULL; // (the body before inlining, if recursive)
+        int self_size = _nodes[k].size;
+
+        for (Tac *t = _nodes[k].f->code; NULL != t; t = t->next)
+            if (Tac::CALL == t->op_code &&
+                _by_name.count(t->op1.label->str_form))
+                sites.push_back(t);
+
+        // (the calls copied from another callee have been decided on, and
+        // those of this function itself are copied one level deeper)
+        for (int level = 0; !sites.empty(); ++level) {
+            for (size_t s = 0; s < sites.size(); ++s) {
+                Tac *call = sites[s];
+                int callee = _by_name[call->op1.label->str_form], n = 0;
+                for (Tac *p = call->prev; NULL != p && Tac::PARAM == p->op_code;
+                     p = p->prev)
+                    ++n;
+                if ((level > 0 && callee != k) ||
+                    (callee == k && level >= RECURSION_LIMIT) ||
+                    !shouldInline(k, callee,
+                                  (callee == k) ? self_size
+                                                : _nodes[callee].size,
+                                  n))
+                    continue;
+
+                Tac *body = _nodes[callee].f->code;
+                if (callee == k) {
+                    if (NULL == self)
+                        self = copyBody(k);
+                    body = self;
+                }
+                inlineCall(k, call, callee, body, calls);
+            }
+            sites.clear();
+            std::swap(sites, calls);
+        }
+    }
+
+    // removes the functions no longer called (but those never called)
+    Piece head, *p = &head;
+
+    head.next = _ps;
+    while (NULL != p->next) {
+        if (Piece::FUNCTY == p->next->kind) {
+            Node &n = _nodes[_by_name[p->next->as.functy->entry->str_form]];
+            if (n.was_called && 0 == n.num_calls &&
+                n.f->entry->str_form != "main") {
+                p->next = p->next->next;
+                ++num_removed_functions;
+                continue;
+            }
+        }
+        p = p->next;
+    }
+
+    return head.next;
+}
+
+/* Prints the statistics of the inliner (of the whole program).
+ *
+ * PARAMETERS:
+ *   os    - the output stream
+ */
+void Inliner::dumpStats(std::ostream &os) {
+    os << "* INLINER:" << std::endl;
+    os << "    " << std::left << std::setw(16) << "inlined calls"
+       << num_inlined_calls << std::endl;
+    os << "    " << std::left << std::setw(16) << "removed funcs"
+       << num_removed_functions << std::endl;
+    os << "    " << std::left << std::setw(16) << "tail recursions"
+       << num_tail_recursions << std::endl;
+}
@@ -0,0 +1,92 @@
+/*****************************************************
+ *  Function Inliner.
+ *
+ *  NOTE: the inliner works on the TAC sequences of the whole program (the
+ *        Piece list), before any function is translated into a FlowGraph.
+ *
+ */
+
+#ifndef __MIND_INLINER__
+#define __MIND_INLINER__
+
+#include "3rdparty/vector.hpp"
+#include "define.hpp"
+#include "tac/tac.hpp"
+
+#include <iostream>
+#include <map>
+#include <string>
+
+namespace mind {
+
+#define MIND_INLINER_DEFINED
+namespace tac {
+
+/** Function Inliner.
+ *
+ *  A call is replaced with a copy of the callee (with its own variables and
+ *  labels), where the parameters are assigned the arguments, and every
+ *  return is an assignment to the result of the call. The functions are
+ *  visited callees first (by the strongly connected components of the call
+ *  graph), so that a callee is inlined with its own calls already inlined.
+ *  A function returning the result of a call to itself loops instead.
+ */
+class Inliner {
+  public:
+    // constructor
+    Inliner(Piece *);
+    // inlines the calls chosen by the cost model (returns the Piece list
+    // without the functions no longer called)
+    Piece *inlineCalls(void);
+    // prints the statistics of the inliner (of the whole program)
+    static void dumpStats(std::ostream &);
+
+  private:
+    // a function of the call graph
+    struct Node {
+        Functy f;                // the function
+        Piece *piece;            // its node in the Piece list
+        util::Vector<int> calls; // the functions called (with repetition)
+        int size;                // how many TACs it has
+        int num_temps;           // the upper bound of its variable ids
+        int num_calls;           // how many calls of it there are
+        bool was_called;         // whether it was called before inlining
+        bool recursive;          // whether it is on a cycle of calls
+        int scc;                 // its strongly connected component
+        int index, low;          // (for Tarjan's algorithm)
+        bool on_stack;           // (for Tarjan's algorithm)
+    };
+
+    // the Piece list
+    Piece *_ps;
+    // the functions (and their numbers by name)
+    util::Vector<Node> _nodes;
+    std::map<std::string, int> _by_name;
+    // the functions in the order of visit (callees first)
+    util::Vector<int> _order;
+    // counters for Tarjan's algorithm
+    int _index, _num_sccs;
+    util::Vector<int> _stack;
+    // the next label id (unique in the whole program)
+    int _label_count;
+
+    // builds the call graph
+    void buildCallGraph(void);
+    // turns the tail recursions of a function into loops
+    void removeTailRecursion(int);
+    // finds the strongly connected components of the call graph
+    void findComponents(int);
+    // decides whether to inline a call (of a callee of the given size)
+    bool shouldInline(int caller, int callee, int size, int num_args);
+    // replaces a call with a copy of the callee (from the given TACs, and
+    // collects the calls copied)
+    void inlineCall(int caller, Tac *call, int callee, Tac *body,
+                    util::Vector<Tac *> &calls);
+    // copies the TACs of a function
+    Tac *copyBody(int);
+};
+
+} // namespace tac
+} // namespace mind
+
+#endif // __MIND_INLINER__
@@ -0,0 +1,314 @@
+/*****************************************************
+ *  Loop-invariant Code Motion.
+ *
+ *  Every natural loop (see tac/loops.cpp) gets a preheader: a block which
+ *  the loop is entered from, and nothing else. Then the TACs of a loop whose
+ *  operands are all defined outside it are moved to the end of its
+ *  preheader, the innermost loops first, so that an expression invariant in
+ *  a whole loop nest goes up level by level.
+ *
+ *  The TACs are in SSA form (see tac/ssa.cpp), so that a TAC is invariant
+ *  if the definitions of its operands are not in the loop. A constant
+ *  operand defined in the loop is loaded again in the preheader (the
+ *  LOAD_IMM4 in the loop stays, so that its other uses may still take it as
+ *  an immediate). Only the TACs without side effects are moved:
+ *    - a LOAD only if there is no call in the loop (which might change the
+ *      memory);
+ *    - a DIV or a MOD only if the divisor is a constant other than 0 and -1,
+ *      or the TAC is executed on every way out of the loop, since the
+ *      division might trap where the loop would not have executed it.
+ *
+ *  A moved TAC keeps its result alive throughout the loop, so the register
+ *  pressure of a loop (the most variables alive at a point inside) is kept
+ *  under the number of registers, and a loop already using them all is left
+ *  alone.
+ */
+
+#include "3rdparty/vector.hpp"
+#include "config.hpp"
+#include "tac/flow_graph.hpp"
+#include "tac/tac.hpp"
+
+#include <algorithm>
+#include <iomanip>
+
+using namespace mind;
+using namespace mind::tac;
+using namespace mind::util;
+
+// the statistics (of all the functions)
+static int num_preheaders = 0;
+static int num_hoisted_tacs = 0;
+
+// whether a TAC might be moved (if its operands are invariant)
+static bool isMovable(Tac *t) {
+    switch (t->op_code) {
+    case Tac::ADD:
+    case Tac::SUB:
+    case Tac::MUL:
+    case Tac::DIV:
+    case Tac::MOD:
+    case Tac::EQU:
+    case Tac::NEQ:
+    case Tac::LES:
+    case Tac::LEQ:
+    case Tac::GTR:
+    case Tac::GEQ:
+    case Tac::NEG:
+    case Tac::LAND:
+    case Tac::LOR:
+    case Tac::MIN:
+    case Tac::MAX:
+    case Tac::KEEP_NZ:
+    case Tac::KEEP_Z:
+    case Tac::LNOT:
+    case Tac::BNOT:
+    case Tac::LOAD_SYMBOL:
+    case Tac::LOAD:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+// appends a TAC to a basic block
+static void appendTac(BasicBlock *b, Tac *t) {
+    Tac *tail = b->tac_chain;
+
+    while (NULL != tail && NULL != tail->next)
+        tail = tail->next;
+    t->prev = tail;
+    t->next = NULL;
+    t->bb_num = b->bb_num;
+    if (NULL == tail)
+        b->tac_chain = t;
+    else
+        tail->next = t;
+}
+
+/* Gives a loop a preheader.
+ *
+ * PARAMETERS:
+ *   h     - the loop header (not the entry block)
+ * RETURNS:
+ *   the block number of the preheader
+ * NOTE:
+ *   the only block entering the loop is taken if it has no other successor.
+ *   otherwise a new block is put in between, and the arguments of the PHIs
+ *   coming from outside are merged there (by new PHIs, if they differ).
+ */
+int FlowGraph::makePreheader(int h) {
+    Vector<int> outside; // the predecessors outside the loop
+    Vector<int> &preds = getPredecessors(h);
+
+    for (size_t k = 0; k < preds.size(); ++k)
+        if (!dominates(h, preds[k]))
+            outside.push_back(preds[k]);
+    mind_assert(!outside.empty());
+
+    if (1 == outside.size() &&
+        BasicBlock::BY_JUMP == _bbs[outside[0]]->end_kind)
+        return outside[0];
+
+    BasicBlock *ph = newBlock(h);
+    ++num_preheaders;
+    for (size_t k = 0; k < outside.size(); ++k) {
+        BasicBlock *p = _bbs[outside[k]];
+        for (int s = 0; s < 2; ++s)
+            if (p->next[s] == h)
+                p->next[s] = ph->bb_num;
+    }
+
+    for (Tac *t = _bbs[h]->tac_chain; t != NULL && Tac::PHI == t->op_code;
+         t = t->next) {
+        PhiArg *link = &t->args, moved = NULL, *tail = &moved;
+        bool same = true;
+
+        while (NULL != *link) {
+            PhiArg a = *link;
+            if (std::find(outside.begin(), outside.end(), a->pred) ==
+                outside.end()) {
+                link = &a->next;
+                continue;
+            }
+            *link = a->next;
+            same = (NULL == moved || moved->var == a->var) && same;
+            a->next = NULL;
+            *tail = a;
+            tail = &a->next;
+        }
+        if (NULL == moved)
+            continue; // (only from the unreachable blocks)
+
+        PhiArg a = new PhiArgObject();
+        a->pred = ph->bb_num;
+        a->next = t->args;
+        t->args = a;
+        if (same) {
+            a->var = moved->var;
+        } else {
+            Tac *phi = Tac::Phi(newVersion(t->op0.var));
+            phi->args = moved;
+            appendTac(ph, phi);
+            a->var = phi->op0.var;
+        }
+    }
+
+    return ph->bb_num;
+}
+
+/* Moves the loop-invariant TACs out of the loops.
+ *
+ * PARAMETERS:
+ *   num_regs - how many registers the variables may be allocated
+ * NOTE:
+ *   it should be done in SSA form.
+ */
+void FlowGraph::hoistInvariants(int num_regs) {
+    // Step 1. gives every loop a preheader (the innermost loops first)
+    Vector<int> headers, preheader;
+    int max_depth = 0;
+
+    for (int i = 0; i < _n; ++i)
+        max_depth = std::max(max_depth, getLoopDepth(i));
+    if (0 == max_depth)
+        return;
+    for (int d = max_depth; d > 0; --d)
+        for (int i = 0; i < _n; ++i)
+            if (getLoopHeader(i) == i && getLoopDepth(i) == d)
+                headers.push_back(i);
+
+    preheader.resize(_n, -1);
+    for (size_t k = 0; k < headers.size(); ++k)
+        preheader[headers[k]] = makePreheader(headers[k]);
+
+    // Step 2. estimates the register pressure of every loop
+    Vector<int> pressure; // (the blocks first, and then the loops)
+    Vector<Tac *> def_tac;
+    Vector<int> order;
+
+    analyzeLiveness();
+    pressure.resize(_n, 0);
+    def_tac.resize(numTemps(), NULL);
+    for (int i = 0; i < _n; ++i) {
+        BasicBlock *b = _bbs[i];
+        b->analyzeLiveness();
+        LiveCursor c(b);
+        int most = b->LiveIn->size();
+        for (Tac *t = b->tac_chain; t != NULL; t = t->next) {
+            c.advance(t);
+            most = std::max(most, (int)c.live()->size());
+            if (NULL != t->getDef())
+                def_tac[t->getDef()->id] = t;
+        }
+        pressure[i] = most;
+    }
+    getPostorder(order);
+    for (int k = (int)order.size() - 1; k >= 0; --k) {
+        int b = order[k];
+        for (int h = getLoopHeader(b); h >= 0; h = getParentLoop(h))
+            if (h != b)
+                pressure[h] = std::max(pressure[h], pressure[b]);
+    }
+
+    // Step 3. moves the invariant TACs (in reverse postorder of every loop,
+    //         so that the operands are visited first)
+    for (size_t k = 0; k < headers.size(); ++k) {
+        int h = headers[k];
+        BasicBlock *ph = _bbs[preheader[h]];
+        Vector<int> blocks, exits;
+        bool has_call = false;
+
+        for (int j = (int)order.size() - 1; j >= 0; --j) {
+            int b = order[j];
+            if (!inLoop(b, h))
+                continue;
+            blocks.push_back(b);
+            for (int s = 0; s < 2; ++s)
+                if (BasicBlock::BY_RETURN == _bbs[b]->end_kind ||
+                    !inLoop(_bbs[b]->next[s], h)) {
+                    exits.push_back(b);
+                    break;
+                }
+            for (Tac *t = _bbs[b]->tac_chain; t != NULL; t = t->next)
+                has_call |= (Tac::CALL == t->op_code);
+        }
+
+        for (size_t j = 0; j < blocks.size() && pressure[h] < num_regs; ++j) {
+            BasicBlock *b = _bbs[blocks[j]];
+            for (Tac *t = b->tac_chain, *next; t != NULL; t = next) {
+                next = t->next;
+                if (!isMovable(t) || (Tac::LOAD == t->op_code && has_call))
+                    continue;
+
+                // finds the operands defined in the loop
+                Temp *v[2];
+                int n = t->getUses(v);
+                bool invariant = true;
+                for (int i = 0; i < n && invariant; ++i) {
+                    Tac *d = def_tac[(*v[i])->id];
+                    invariant = (NULL == d || !inLoop(d->bb_num, h) ||
+                                 Tac::LOAD_IMM4 == d->op_code);
+                }
+                if (!invariant)
+                    continue;
+
+                if (Tac::DIV == t->op_code || Tac::MOD == t->op_code) {
+                    Tac *d = def_tac[t->op2.var->id];
+                    bool safe = !exits.empty();
+                    for (size_t e = 0; e < exits.size() && safe; ++e)
+                        safe = dominates(b->bb_num, exits[e]);
+                    if (!safe && (NULL == d || Tac::LOAD_IMM4 != d->op_code ||
+                                  0 == d->op1.ival || -1 == d->op1.ival))
+                        continue;
+                }
+
+                // moves it (loading the constants again, into new variables)
+                for (int i = 0; i < n; ++i) {
+                    Tac *d = def_tac[(*v[i])->id];
+                    if (NULL == d || Tac::LOAD_IMM4 != d->op_code ||
+                        !inLoop(d->bb_num, h))
+                        continue;
+                    Temp c = newVersion(*v[i]);
+                    _origin[c->id] = c->id; // (a variable of its own)
+                    Tac *load = Tac::LoadImm4(c, d->op1.ival);
+                    appendTac(ph, load);
+                    def_tac.push_back(load);
+                    *v[i] = c;
+                }
+                if (NULL != t->prev)
+                    t->prev->next = t->next;
+                else
+                    b->tac_chain = t->next;
+                if (NULL != t->next)
+                    t->next->prev = t->prev;
+                appendTac(ph, t);
+                ++num_hoisted_tacs;
+
+                for (int x = h; x >= 0; x = getParentLoop(x))
+                    ++pressure[x];
+                if (pressure[h] >= num_regs)
+                    break;
+            }
+        }
+    }
+
+    // (the liveness is no longer valid)
+    for (int i = 0; i < _n; ++i)
+        _bbs[i]->Def = _bbs[i]->LiveUse = _bbs[i]->LiveIn = _bbs[i]->LiveOut =
+            NULL;
+}
+
+/* Prints the statistics of the code motion (of all the functions).
+ *
+ * PARAMETERS:
+ *   os    - the output stream
+ */
+void FlowGraph::dumpInvariantStats(std::ostream &os) {
+    os << "* LICM:" << std::endl;
+    os << "    " << std::left << std::setw(16) << "preheaders"
+       << num_preheaders << std::endl;
+    os << "    " << std::left << std::setw(16) << "hoisted TACs"
+       << num_hoisted_tacs << std::endl;
+}
@@ -0,0 +1,331 @@
+/*****************************************************
+ *  Dominators and Natural Loops.
+ *
+ *  The predecessors, the dominator tree and the loop nest of a FlowGraph
+ *  are computed together on the first query, and kept until the edges are
+ *  changed (see invalidateControlFlow, which every transformation moving
+ *  the edges should call).
+ *
+ *  The dominators are computed as in "A Simple, Fast Dominance Algorithm"
+ *  (Cooper, Harvey and Kennedy). Then the dominator tree is numbered in
+ *  preorder and postorder, so that "a dominates b" is tested in constant
+ *  time.
+ *
+ *  An edge u->h is a back edge if h dominates u, and the natural loop of h
+ *  is made of h and the blocks reaching the sources of its back edges
+ *  without passing h (the loops of a header are merged). The headers are
+ *  visited innermost first, so that a loop found inside another is simply
+ *  linked to it (see "Compilers: Principles, Techniques, and Tools", 9.6).
+ *  Only reducible loops are found this way, which is all that MiniDecaf
+ *  generates.
+ */
+
+#include "3rdparty/vector.hpp"
+#include "config.hpp"
+#include "tac/flow_graph.hpp"
+#include "tac/tac.hpp"
+
+using namespace mind;
+using namespace mind::tac;
+using namespace mind::util;
+
+// walks up the dominator tree from two blocks until they meet (a block comes
+// after its dominators in postorder)
+static int intersect(Vector<int> &idom, Vector<int> &po_num, int a, int b) {
+    while (a != b) {
+        while (po_num[a] < po_num[b])
+            a = idom[a];
+        while (po_num[b] < po_num[a])
+            b = idom[b];
+    }
+
+    return a;
+}
+
+/* Computes the dominators and the natural loops of this graph.
+ *
+ * NOTE:
+ *   nothing is done if the results are still up to date.
+ */
+void FlowGraph::analyzeControlFlow(void) {
+    if (_cfa_valid)
+        return;
+
+    // Step 1. numbers the reachable blocks and collects the predecessors
+    getPostorder(_order);
+    _po_num.clear();
+    _po_num.resize(_n, -1);
+    for (size_t k = 0; k < _order.size(); ++k)
+        _po_num[_order[k]] = k;
+
+    _preds.clear();
+    _preds.resize(_n);
+    for (size_t k = 0; k < _order.size(); ++k) {
+        BasicBlock *b = _bbs[_order[k]];
+        switch (b->end_kind) {
+        case BasicBlock::BY_JZERO:
+            if (b->next[1] != b->next[0])
+                _preds[b->next[1]].push_back(b->bb_num);
+            // falls through
+
+        case BasicBlock::BY_JUMP:
+            _preds[b->next[0]].push_back(b->bb_num);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    // Step 2. computes the immediate dominators (in reverse postorder until
+    //         nothing changes, which takes a couple of passes)
+    _idom.clear();
+    _idom.resize(_n, -1);
+    _idom[0] = 0;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (int k = (int)_order.size() - 2; k >= 0; --k) {
+            int b = _order[k], new_idom = -1;
+            for (size_t p = 0; p < _preds[b].size(); ++p) {
+                int q = _preds[b][p];
+                if (_idom[q] < 0)
+                    continue; // not processed yet
+                new_idom = (new_idom < 0) ? q : intersect(_idom, _po_num, q,
+                                                          new_idom);
+            }
+            if (_idom[b] != new_idom) {
+                _idom[b] = new_idom;
+                changed = true;
+            }
+        }
+    }
+
+    // Step 3. numbers the dominator tree (iteratively, so that a deep tree
+    //         doesn't overflow the stack)
+    Vector<int> stack, child;
+    int pre = 0, post = 0;
+
+    _dom_children.clear();
+    _dom_children.resize(_n);
+    for (int k = (int)_order.size() - 2; k >= 0; --k)
+        _dom_children[_idom[_order[k]]].push_back(_order[k]);
+    _dom_pre.clear();
+    _dom_pre.resize(_n, -1);
+    _dom_post.clear();
+    _dom_post.resize(_n, -1);
+
+    _dom_pre[0] = pre++;
+    stack.push_back(0);
+    child.push_back(0);
+    while (!stack.empty()) {
+        int x = stack.back();
+        size_t k = child.back()++;
+        if (k < _dom_children[x].size()) {
+            int y = _dom_children[x][k];
+            _dom_pre[y] = pre++;
+            stack.push_back(y);
+            child.push_back(0);
+        } else {
+            _dom_post[x] = post++;
+            stack.pop_back();
+            child.pop_back();
+        }
+    }
+    _cfa_valid = true; // (dominates() is used below)
+
+    // Step 4. finds the natural loops (innermost first, since a header
+    //         comes after the headers dominating it in postorder)
+    _loop_header.clear();
+    _loop_header.resize(_n, -1);
+    _loop_parent.clear();
+    _loop_parent.resize(_n, -1);
+    _loop_depth.clear();
+    _loop_depth.resize(_n, 0);
+
+    for (size_t k = 0; k < _order.size(); ++k) {
+        int h = _order[k];
+
+        stack.clear();
+        for (size_t p = 0; p < _preds[h].size(); ++p)
+            if (dominates(h, _preds[h][p]))
+                stack.push_back(_preds[h][p]);
+        if (stack.empty())
+            continue; // not a loop header
+
+        _loop_header[h] = h;
+        while (!stack.empty()) {
+            int b = stack.back();
+            stack.pop_back();
+            if (_loop_header[b] < 0) {
+                _loop_header[b] = h;
+            } else {
+                // b is already in a loop: links the outermost loop found so
+                // far around b to this one, and goes on from its header
+                b = _loop_header[b];
+                while (_loop_parent[b] >= 0)
+                    b = _loop_parent[b];
+                if (b == h)
+                    continue;
+                _loop_parent[b] = h;
+            }
+            for (size_t p = 0; p < _preds[b].size(); ++p)
+                stack.push_back(_preds[b][p]);
+        }
+    }
+
+    // Step 5. computes the loop depths (in reverse postorder, so that the
+    //         header of a loop comes before the blocks inside)
+    for (int k = (int)_order.size() - 1; k >= 0; --k) {
+        int b = _order[k], h = _loop_header[b];
+        if (h < 0)
+            continue;
+        if (h != b)
+            _loop_depth[b] = _loop_depth[h];
+        else if (_loop_parent[h] < 0)
+            _loop_depth[b] = 1;
+        else
+            _loop_depth[b] = _loop_depth[_loop_parent[h]] + 1;
+    }
+}
+
+/* Marks the dominators and the loops out of date.
+ *
+ * NOTE:
+ *   they are computed again on the next query.
+ */
+void FlowGraph::invalidateControlFlow(void) { _cfa_valid = false; }
+
+/* Gets the predecessors of a basic block.
+ *
+ * PARAMETERS:
+ *   b     - the block number
+ * RETURNS:
+ *   the reachable predecessors (each of them once)
+ */
+Vector<int> &FlowGraph::getPredecessors(int b) {
+    mind_assert(b >= 0 && b < _n);
+
+    analyzeControlFlow();
+    return _preds[b];
+}
+
+/* Gets the immediate dominator of a basic block.
+ *
+ * PARAMETERS:
+ *   b     - the block number
+ * RETURNS:
+ *   the immediate dominator (the entry block is its own, and an unreachable
+ *   block has -1)
+ */
+int FlowGraph::getIdom(int b) {
+    mind_assert(b >= 0 && b < _n);
+
+    analyzeControlFlow();
+    return _idom[b];
+}
+
+/* Gets the children of a basic block in the dominator tree.
+ *
+ * PARAMETERS:
+ *   b     - the block number
+ * RETURNS:
+ *   the blocks immediately dominated by b (in reverse postorder)
+ */
+Vector<int> &FlowGraph::getDomChildren(int b) {
+    mind_assert(b >= 0 && b < _n);
+
+    analyzeControlFlow();
+    return _dom_children[b];
+}
+
+/* Tests whether a basic block dominates another.
+ *
+ * PARAMETERS:
+ *   a     - the block number of the dominator
+ *   b     - the block number of the other (reachable) block
+ * RETURNS:
+ *   true if every path from the entry to b passes a (a dominates itself)
+ */
+bool FlowGraph::dominates(int a, int b) {
+    mind_assert(a >= 0 && a < _n && b >= 0 && b < _n);
+
+    analyzeControlFlow();
+    return _dom_pre[a] >= 0 && _dom_pre[a] <= _dom_pre[b] &&
+           _dom_post[b] <= _dom_post[a];
+}
+
+/* Gets the nearest common dominator of two basic blocks.
+ *
+ * PARAMETERS:
+ *   a     - the block number of a reachable block
+ *   b     - the block number of another reachable block
+ * RETURNS:
+ *   the block number of the nearest block dominating both
+ */
+int FlowGraph::commonDominator(int a, int b) {
+    mind_assert(a >= 0 && a < _n && b >= 0 && b < _n);
+
+    analyzeControlFlow();
+    mind_assert(_idom[a] >= 0 && _idom[b] >= 0);
+    return intersect(_idom, _po_num, a, b);
+}
+
+/* Gets the innermost natural loop containing a basic block.
+ *
+ * PARAMETERS:
+ *   b     - the block number
+ * RETURNS:
+ *   the block number of the loop header (b itself if it is a header, and
+ *   -1 if b is not inside any loop)
+ */
+int FlowGraph::getLoopHeader(int b) {
+    mind_assert(b >= 0 && b < _n);
+
+    analyzeControlFlow();
+    return _loop_header[b];
+}
+
+/* Gets the natural loop enclosing another.
+ *
+ * PARAMETERS:
+ *   h     - the block number of a loop header
+ * RETURNS:
+ *   the header of the innermost loop containing that loop (-1 if none)
+ */
+int FlowGraph::getParentLoop(int h) {
+    mind_assert(h >= 0 && h < _n);
+
+    analyzeControlFlow();
+    mind_assert(_loop_header[h] == h);
+    return _loop_parent[h];
+}
+
+/* Tests whether a basic block is inside a natural loop.
+ *
+ * PARAMETERS:
+ *   b     - the block number
+ *   h     - the block number of the loop header
+ * RETURNS:
+ *   true if b is in the loop of h or in a loop nested in it
+ */
+bool FlowGraph::inLoop(int b, int h) {
+    for (int x = getLoopHeader(b); x >= 0; x = getParentLoop(x))
+        if (x == h)
+            return true;
+
+    return false;
+}
+
+/* Gets the loop depth of a basic block.
+ *
+ * PARAMETERS:
+ *   b     - the block number
+ * RETURNS:
+ *   how many natural loops contain b (0 if unreachable)
+ */
+int FlowGraph::getLoopDepth(int b) {
+    mind_assert(b >= 0 && b < _n);
+
+    analyzeControlFlow();
+    return _loop_depth[b];
+}
@@ -0,0 +1,470 @@
+/*****************************************************
+ *  Sparse Conditional Constant Propagation.
+ *
+ *  (see "Constant Propagation with Conditional Branches", Wegman and
+ *  Zadeck, TOPLAS 1991.) The value of every variable is lowered in the
+ *  lattice TOP (unknown yet) > CONST c > BOTTOM (not a constant), and only
+ *  the blocks found executable are visited, so that the code skipped by a
+ *  constant condition doesn't spoil the values.
+ *
+ *  The TACs are in SSA form (see tac/ssa.cpp), so every variable is defined
+ *  once (the parameters never, and they are BOTTOM from the start), and the
+ *  value of a PHI is the meet of the arguments coming along the executable
+ *  edges only.
+ *
+ *  Then, every TAC computing a constant becomes a LOAD_IMM4, every JZERO on
+ *  a constant becomes a jump (FlowGraph::simplify removes the blocks which
+ *  are no longer reachable), and the pure TACs whose results are never used
+ *  are removed.
+ */
+
+#include "3rdparty/vector.hpp"
+#include "config.hpp"
+#include "tac/flow_graph.hpp"
+#include "tac/tac.hpp"
+
+#include <climits>
+#include <iomanip>
+
+using namespace mind;
+using namespace mind::tac;
+using namespace mind::util;
+
+// the statistics (of all the functions)
+static int num_folded_tacs = 0;
+static int num_folded_branches = 0;
+static int num_removed_tacs = 0;
+static int num_removed_blocks = 0;
+
+namespace {
+// the value of a variable in the lattice
+struct LatticeValue {
+    enum { TOP, CONST, BOTTOM } kind;
+    int c; // the value of a CONST
+};
+} // namespace
+
+// tests whether a TAC does nothing but define its result
+static bool isPure(Tac *t) {
+    switch (t->op_code) {
+    case Tac::CALL:
+    case Tac::PUSH:
+    case Tac::POP:
+    case Tac::PARAM:
+        return false;
+
+    default:
+        return true;
+    }
+}
+
+/* Evaluates an operation on constants (with the 32-bit wrap-around).
+ *
+ * PARAMETERS:
+ *   op    - the operation
+ *   a     - the first operand
+ *   b     - the second operand (if any)
+ *   r     - (output) the result
+ * RETURNS:
+ *   false if the result is left to the run time (division by zero, etc.)
+ */
+static bool evaluate(Tac::Kind op, int a, int b, int &r) {
+    unsigned ua = (unsigned)a, ub = (unsigned)b;
+
+    switch (op) {
+    case Tac::ASSIGN:
+        r = a;
+        break;
+
+    case Tac::NEG:
+        r = (int)(0u - ua);
+        break;
+
+    case Tac::BNOT:
+        r = ~a;
+        break;
+
+    case Tac::LNOT:
+        r = !a;
+        break;
+
+    case Tac::ADD:
+        r = (int)(ua + ub);
+        break;
+
+    case Tac::SUB:
+        r = (int)(ua - ub);
+        break;
+
+    case Tac::MUL:
+        r = (int)(ua * ub);
+        break;
+
+    case Tac::DIV:
+    case Tac::MOD:
+        if (0 == b || (INT_MIN == a && -1 == b))
+            return false;
+        r = (Tac::DIV == op) ? a / b : a % b;
+        break;
+
+    case Tac::EQU:
+        r = (a == b);
+        break;
+
+    case Tac::NEQ:
+        r = (a != b);
+        break;
+
+    case Tac::LES:
+        r = (a < b);
+        break;
+
+    case Tac::LEQ:
+        r = (a <= b);
+        break;
+
+    case Tac::GTR:
+        r = (a > b);
+        break;
+
+    case Tac::GEQ:
+        r = (a >= b);
+        break;
+
+    case Tac::LAND:
+        r = (a && b);
+        break;
+
+    case Tac::LOR:
+        r = (a || b);
+        break;
+
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+namespace {
+// the propagation (the state of the lattice and the worklists)
+class Propagator {
+  public:
+    Vector<LatticeValue> values; // the value of every variable
+    Vector<int> executable;      // whether every block is executable
+
+    Propagator(FlowGraph *g);
+    // runs until nothing changes
+    void run(void);
+
+  private:
+    FlowGraph *g;
+    Vector<Vector<Tac *> > uses; // the TACs reading every variable
+    Vector<Vector<int> > ends;   // the blocks testing/returning it
+    Vector<int> edges;      // the executable edges out of every block (bit k
+                            // for next[k])
+    Vector<int> block_list; // the blocks newly found executable
+    Vector<int> var_list;   // the variables whose values are lowered
+
+    void markEdge(BasicBlock *, int);
+    void lower(Temp, LatticeValue);
+    void visitTac(Tac *);
+    void visitEnd(BasicBlock *);
+};
+} // namespace
+
+/* Constructor (every variable defined starts at TOP).
+ *
+ * PARAMETERS:
+ *   g     - the control-flow graph
+ */
+Propagator::Propagator(FlowGraph *g) : g(g) {
+    int n = (int)g->numTemps();
+    Vector<int> defs; // how many times every variable is defined
+    Temp *v[2];
+
+    defs.resize(n, 0);
+    uses.resize(n);
+    ends.resize(n);
+    executable.resize(g->size(), 0);
+    edges.resize(g->size(), 0);
+
+    for (FlowGraph::iterator it = g->begin(); it != g->end(); ++it) {
+        BasicBlock *b = *it;
+        for (Tac *t = b->tac_chain; t != NULL; t = t->next) {
+            int k = t->getUses(v);
+            for (int i = 0; i < k; ++i)
+                uses[(*v[i])->id].push_back(t);
+            for (PhiArg a = t->args; NULL != a; a = a->next)
+                uses[a->var->id].push_back(t);
+            if (NULL != t->getDef())
+                ++defs[t->getDef()->id];
+        }
+        if (BasicBlock::BY_JUMP != b->end_kind)
+            ends[b->var->id].push_back(b->bb_num);
+    }
+
+    // (the parameters are never defined, and a variable still defined more
+    // than once is not tracked)
+    LatticeValue top = {LatticeValue::TOP, 0};
+    LatticeValue bottom = {LatticeValue::BOTTOM, 0};
+    values.resize(n, bottom);
+    for (int k = 0; k < n; ++k)
+        if (1 == defs[k])
+            values[k] = top;
+}
+
+// marks the edge from a block to its k-th successor as executable
+void Propagator::markEdge(BasicBlock *b, int k) {
+    if (0 != (edges[b->bb_num] & (1 << k)))
+        return;
+
+    edges[b->bb_num] |= (1 << k);
+    BasicBlock *s = g->getBlock(b->next[k]);
+    if (!executable[s->bb_num]) {
+        executable[s->bb_num] = 1;
+        block_list.push_back(s->bb_num);
+    } else {
+        // a new argument for the PHIs
+        for (Tac *t = s->tac_chain; t != NULL; t = t->next)
+            if (Tac::PHI == t->op_code)
+                visitTac(t);
+    }
+}
+
+// lowers the value of a variable (if the new value is lower)
+void Propagator::lower(Temp v, LatticeValue x) {
+    LatticeValue &old = values[v->id];
+
+    if (x.kind > old.kind) {
+        old = x;
+        var_list.push_back(v->id);
+    }
+}
+
+// evaluates a TAC with the current values of its operands
+void Propagator::visitTac(Tac *t) {
+    Temp d = t->getDef(), *v[2];
+    LatticeValue x = {LatticeValue::BOTTOM, 0};
+
+    if (NULL == d || LatticeValue::BOTTOM == values[d->id].kind)
+        return;
+
+    int k = t->getUses(v);
+    if (Tac::LOAD_IMM4 == t->op_code) {
+        x.kind = LatticeValue::CONST;
+        x.c = t->op1.ival;
+
+    } else if (Tac::PHI == t->op_code) {
+        // the meet of the arguments along the executable edges
+        x.kind = LatticeValue::TOP;
+        for (PhiArg a = t->args; NULL != a; a = a->next) {
+            BasicBlock *p = g->getBlock(a->pred);
+            if (!((p->next[0] == t->bb_num && (edges[p->bb_num] & 1)) ||
+                  (p->next[1] == t->bb_num && (edges[p->bb_num] & 2))))
+                continue;
+
+            LatticeValue y = values[a->var->id];
+            if (LatticeValue::TOP == y.kind)
+                continue;
+            if (LatticeValue::TOP == x.kind)
+                x = y;
+            else if (LatticeValue::BOTTOM == y.kind || x.c != y.c)
+                x.kind = LatticeValue::BOTTOM;
+        }
+
+    } else if (k > 0 && Tac::LOAD != t->op_code) {
+        LatticeValue a = values[(*v[0])->id];
+        LatticeValue b = (k > 1) ? values[(*v[1])->id] : a;
+
+        if (LatticeValue::BOTTOM == a.kind || LatticeValue::BOTTOM == b.kind)
+            x.kind = LatticeValue::BOTTOM;
+        else if (LatticeValue::TOP == a.kind || LatticeValue::TOP == b.kind)
+            x.kind = LatticeValue::TOP;
+        else if (evaluate(t->op_code, a.c, b.c, x.c))
+            x.kind = LatticeValue::CONST;
+    }
+
+    lower(d, x);
+}
+
+// follows the control-flow out of an executable block
+void Propagator::visitEnd(BasicBlock *b) {
+    switch (b->end_kind) {
+    case BasicBlock::BY_JUMP:
+        markEdge(b, 0);
+        break;
+
+    case BasicBlock::BY_JZERO: {
+        LatticeValue x = values[b->var->id];
+        if (LatticeValue::CONST == x.kind) {
+            markEdge(b, 0 == x.c ? 0 : 1);
+        } else if (LatticeValue::BOTTOM == x.kind) {
+            markEdge(b, 0);
+            markEdge(b, 1);
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+/* Propagates the values until nothing changes.
+ */
+void Propagator::run(void) {
+    executable[0] = 1;
+    block_list.push_back(0);
+
+    while (!block_list.empty() || !var_list.empty()) {
+        if (!block_list.empty()) {
+            BasicBlock *b = g->getBlock(block_list.back());
+            block_list.pop_back();
+            for (Tac *t = b->tac_chain; t != NULL; t = t->next)
+                visitTac(t);
+            visitEnd(b);
+            continue;
+        }
+
+        int id = var_list.back();
+        var_list.pop_back();
+        for (size_t k = 0; k < uses[id].size(); ++k)
+            if (executable[uses[id][k]->bb_num])
+                visitTac(uses[id][k]);
+        for (size_t k = 0; k < ends[id].size(); ++k)
+            if (executable[ends[id][k]])
+                visitEnd(g->getBlock(ends[id][k]));
+    }
+}
+
+// counts (or discounts) the variables read by a TAC
+static void countUses(Tac *t, Vector<int> &num_uses, int delta) {
+    Temp *v[2];
+    int k = t->getUses(v);
+
+    for (int i = 0; i < k; ++i)
+        num_uses[(*v[i])->id] += delta;
+    for (PhiArg a = t->args; NULL != a; a = a->next)
+        num_uses[a->var->id] += delta;
+}
+
+/* Removes the pure TACs whose results are never used.
+ *
+ * RETURNS:
+ *   how many TACs have been removed
+ * NOTE:
+ *   only the reachable blocks are considered (the others should be removed
+ *   by simplify).
+ */
+int FlowGraph::removeDeadTacs(void) {
+    Vector<int> num_uses; // how many times every variable is read
+    int removed = 0;
+    bool changed = true;
+
+    num_uses.resize(numTemps(), 0);
+    for (int i = 0; i < _n; ++i) {
+        BasicBlock *b = _bbs[i];
+        if (getIdom(i) < 0)
+            continue;
+        for (Tac *t = b->tac_chain; t != NULL; t = t->next)
+            countUses(t, num_uses, 1);
+        if (BasicBlock::BY_JUMP != b->end_kind)
+            ++num_uses[b->var->id];
+    }
+
+    // (backwards, so that a chain of dead TACs mostly goes in one sweep)
+    while (changed) {
+        changed = false;
+        for (int i = _n - 1; i >= 0; --i) {
+            BasicBlock *b = _bbs[i];
+            if (getIdom(i) < 0 || NULL == b->tac_chain)
+                continue;
+
+            Tac *last = b->tac_chain;
+            while (NULL != last->next)
+                last = last->next;
+
+            for (Tac *t = last, *prev; t != NULL; t = prev) {
+                prev = t->prev;
+                Temp d = t->getDef();
+                if (!isPure(t) || NULL == d || num_uses[d->id] > 0)
+                    continue;
+
+                countUses(t, num_uses, -1);
+                if (NULL != prev)
+                    prev->next = t->next;
+                else
+                    b->tac_chain = t->next;
+                if (NULL != t->next)
+                    t->next->prev = prev;
+                ++removed;
+                changed = true;
+            }
+        }
+    }
+
+    return removed;
+}
+
+/* Performs sparse conditional constant propagation on this graph.
+ *
+ * NOTE:
+ *   it should be followed by simplify (to remove the unreachable blocks),
+ *   since the branches on constants are turned into jumps here.
+ */
+void FlowGraph::propagateConstants(void) {
+    Propagator p(this);
+
+    p.run();
+
+    for (int i = 0; i < _n; ++i) {
+        BasicBlock *b = _bbs[i];
+        if (!p.executable[i]) {
+            ++num_removed_blocks;
+            continue;
+        }
+
+        for (Tac *t = b->tac_chain; t != NULL; t = t->next) {
+            Temp d = t->getDef();
+            if (NULL == d || Tac::LOAD_IMM4 == t->op_code ||
+                LatticeValue::CONST != p.values[d->id].kind)
+                continue;
+
+            t->op_code = Tac::LOAD_IMM4;
+            t->op1.var = t->op2.var = NULL;
+            t->op1.ival = p.values[d->id].c;
+            t->args = NULL;
+            ++num_folded_tacs;
+        }
+
+        if (BasicBlock::BY_JZERO == b->end_kind &&
+            LatticeValue::CONST == p.values[b->var->id].kind) {
+            b->next[0] = b->next[1] =
+                b->next[0 == p.values[b->var->id].c ? 0 : 1];
+            b->end_kind = BasicBlock::BY_JUMP;
+            b->var = NULL;
+            ++num_folded_branches;
+        }
+    }
+
+    invalidateControlFlow();
+    num_removed_tacs += removeDeadTacs();
+}
+
+/* Prints the statistics of the constant propagation (of all the functions).
+ *
+ * PARAMETERS:
+ *   os    - the output stream
+ */
+void FlowGraph::dumpConstantStats(std::ostream &os) {
+    os << "* SCCP:" << std::endl;
+    os << "    " << std::left << std::setw(16) << "folded TACs"
+       << num_folded_tacs << std::endl;
+    os << "    " << std::left << std::setw(16) << "folded branches"
+       << num_folded_branches << std::endl;
+    os << "    " << std::left << std::setw(16) << "removed TACs"
+       << num_removed_tacs << std::endl;
+    os << "    " << std::left << std::setw(16) << "removed blocks"
+       << num_removed_blocks << std::endl;
+}
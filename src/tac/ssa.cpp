@@ -0,0 +1,535 @@
+/*****************************************************
+ *  Static Single Assignment (SSA) Form.
+ *
+ *  (see "Efficiently Computing Static Single Assignment Form and the
+ *  Control Dependence Graph", Cytron et al., TOPLAS 1991.) A variable
+ *  assigned more than once gets a new version at every definition, and a
+ *  PHI at every block of its iterated dominance frontier where it is alive
+ *  (pruned SSA). The dominators come from tac/loops.cpp.
+ *
+ *  Out of SSA, every PHI becomes a copy at the end of every predecessor
+ *  (the critical edges are split first). The copies of an edge make up a
+ *  parallel copy, which is sequentialized as in "Revisiting Out-of-SSA
+ *  Translation for Correctness, Code Quality, and Efficiency" (Boissinot et
+ *  al., CGO 2009). Then the versions of a variable are renamed back into it,
+ *  unless two of them are alive at the same time, so that most copies are
+ *  gone again.
+ */
+
+#include "3rdparty/vector.hpp"
+#include "config.hpp"
+#include "tac/flow_graph.hpp"
+#include "tac/tac.hpp"
+
+using namespace mind;
+using namespace mind::tac;
+using namespace mind::util;
+
+// gets the successors of a basic block (each of them once)
+static int getSuccessors(BasicBlock *b, int succ[2]) {
+    switch (b->end_kind) {
+    case BasicBlock::BY_JUMP:
+        succ[0] = b->next[0];
+        return 1;
+
+    case BasicBlock::BY_JZERO:
+        succ[0] = b->next[0];
+        succ[1] = b->next[1];
+        return (b->next[0] == b->next[1]) ? 1 : 2;
+
+    default:
+        return 0;
+    }
+}
+
+/* Creates a new version of a variable.
+ *
+ * PARAMETERS:
+ *   v     - the variable
+ * RETURNS:
+ *   a new temporary variable of this function
+ */
+Temp FlowGraph::newVersion(Temp v) {
+    Temp t = new TempObject();
+    t->id = (int)_temps.size();
+    t->size = v->size;
+    t->offset = 0;
+    t->is_offset_fixed = false;
+    t->reg = 0;
+    t->is_const = false;
+    t->value = 0;
+
+    _temps.push_back(t);
+    _origin.push_back(_origin[v->id]);
+    return t;
+}
+
+/* Adds an empty block to this graph.
+ *
+ * PARAMETERS:
+ *   to    - the block it jumps to
+ * RETURNS:
+ *   the new block
+ */
+BasicBlock *FlowGraph::newBlock(int to) {
+    BasicBlock *b = new BasicBlock();
+    b->bb_num = _n++;
+    b->end_kind = BasicBlock::BY_JUMP;
+    b->next[0] = b->next[1] = to;
+
+    _bbs.push_back(b);
+    invalidateControlFlow();
+    return b;
+}
+
+/* Translates this graph into SSA form.
+ *
+ * NOTE:
+ *   the variables defined only once (and neither needing a PHI nor alive
+ *   at the entry) keep their names, and the original name of a variable
+ *   renamed stands for its value at the entry (the value of a parameter,
+ *   say).
+ */
+void FlowGraph::buildSSA(void) {
+    int n = (int)numTemps();
+    int succ[2];
+
+    _origin.resize(n);
+    for (int k = 0; k < n; ++k)
+        _origin[k] = k;
+
+    // Step 1. makes sure that the entry block has no predecessor (so that it
+    //         needs no PHI), by moving it behind a new empty one
+    for (int i = 0; i < _n; ++i) {
+        int ns = getSuccessors(_bbs[i], succ);
+        if ((ns > 0 && 0 == succ[0]) || (ns > 1 && 0 == succ[1])) {
+            BasicBlock *entry = _bbs[0];
+            BasicBlock *b = newBlock(_n);
+            _bbs[0] = b;
+            _bbs[b->bb_num] = entry;
+            entry->bb_num = b->bb_num;
+            b->bb_num = 0;
+            for (Tac *t = entry->tac_chain; t != NULL; t = t->next)
+                t->bb_num = entry->bb_num;
+            for (int j = 1; j < _n; ++j)
+                for (int k = 0; k < 2; ++k)
+                    if (0 == _bbs[j]->next[k])
+                        _bbs[j]->next[k] = entry->bb_num;
+            break;
+        }
+    }
+
+    // Step 2. computes the dominance frontiers (and empties the unreachable
+    //         blocks, whose definitions would not be renamed)
+    Vector<int> order;
+    Vector<Vector<int> > df;
+
+    getPostorder(order);
+    for (int i = 0; i < _n; ++i)
+        if (getIdom(i) < 0)
+            _bbs[i]->tac_chain = NULL;
+    df.resize(_n);
+    for (size_t k = 0; k < order.size(); ++k) {
+        int b = order[k];
+        Vector<int> &preds = getPredecessors(b);
+        if (preds.size() < 2)
+            continue;
+        for (size_t p = 0; p < preds.size(); ++p)
+            for (int r = preds[p]; r != getIdom(b); r = getIdom(r))
+                df[r].push_back(b);
+    }
+
+    // Step 3. places the PHIs (where the variables are alive)
+    Vector<Vector<int> > def_blocks; // the blocks defining every variable
+    Vector<int> num_defs, renamed;
+    Vector<int> has_phi, queued; // (the last variable, per block)
+    Vector<int> worklist;
+    BitSet global(n); // the variables alive across some block boundary
+
+    analyzeLiveness();
+    def_blocks.resize(n);
+    num_defs.resize(n, 0);
+    renamed.resize(n, 0);
+    for (size_t k = 0; k < order.size(); ++k) {
+        BasicBlock *b = _bbs[order[k]];
+        global.unite(b->LiveIn);
+        for (Tac *t = b->tac_chain; t != NULL; t = t->next) {
+            Temp d = t->getDef();
+            if (NULL == d)
+                continue;
+            if (def_blocks[d->id].empty() ||
+                def_blocks[d->id].back() != b->bb_num)
+                def_blocks[d->id].push_back(b->bb_num);
+            ++num_defs[d->id];
+        }
+    }
+
+    has_phi.resize(_n, -1);
+    queued.resize(_n, -1);
+    for (BitSet::iterator it = global.begin(); it != global.end(); ++it) {
+        int v = *it;
+        worklist = def_blocks[v];
+        for (size_t k = 0; k < worklist.size(); ++k)
+            queued[worklist[k]] = v;
+
+        while (!worklist.empty()) {
+            int x = worklist.back();
+            worklist.pop_back();
+            for (size_t k = 0; k < df[x].size(); ++k) {
+                BasicBlock *y = _bbs[df[x][k]];
+                if (has_phi[y->bb_num] == v || !y->LiveIn->contains(v))
+                    continue;
+
+                Tac *phi = Tac::Phi(_temps[v]);
+                phi->bb_num = y->bb_num;
+                phi->next = y->tac_chain;
+                if (NULL != y->tac_chain)
+                    y->tac_chain->prev = phi;
+                y->tac_chain = phi;
+                has_phi[y->bb_num] = v;
+                renamed[v] = 1;
+
+                if (queued[y->bb_num] != v) {
+                    queued[y->bb_num] = v;
+                    worklist.push_back(y->bb_num);
+                }
+            }
+        }
+    }
+
+    // (a variable alive at the entry, as a parameter assigned, has a value
+    // before its definition as well)
+    for (int k = 0; k < n; ++k)
+        if (num_defs[k] > 1 ||
+            (num_defs[k] > 0 && _bbs[0]->LiveIn->contains(k)))
+            renamed[k] = 1;
+
+    // Step 4. renames the variables, in preorder of the dominator tree
+    //         (iteratively, where ~b stands for leaving block b)
+    Vector<Vector<Temp> > stack; // the current version of every variable
+    Vector<int> pushed;          // the variables whose versions are pushed
+    Vector<int> pushed_at;       // the size of "pushed" entering every block
+    Temp *v[2];
+
+    stack.resize(n);
+    pushed_at.resize(_n, 0);
+
+    worklist.clear();
+    worklist.push_back(0);
+    while (!worklist.empty()) {
+        int x = worklist.back();
+        worklist.pop_back();
+
+        if (x < 0) {
+            for (x = ~x; (int)pushed.size() > pushed_at[x]; pushed.pop_back())
+                stack[pushed.back()].pop_back();
+            continue;
+        }
+
+        BasicBlock *b = _bbs[x];
+        pushed_at[x] = pushed.size();
+        worklist.push_back(~x);
+        Vector<int> &children = getDomChildren(x);
+        for (size_t k = children.size(); k > 0; --k)
+            worklist.push_back(children[k - 1]);
+
+        for (Tac *t = b->tac_chain; t != NULL; t = t->next) {
+            int k = t->getUses(v);
+            for (int i = 0; i < k; ++i) {
+                int o = (*v[i])->id;
+                if (renamed[o] && !stack[o].empty())
+                    *v[i] = stack[o].back();
+            }
+
+            Temp d = t->getDef();
+            if (NULL != d && renamed[d->id]) {
+                t->op0.var = newVersion(d);
+                stack[d->id].push_back(t->op0.var);
+                pushed.push_back(d->id);
+            }
+        }
+        if (BasicBlock::BY_JUMP != b->end_kind && renamed[b->var->id] &&
+            !stack[b->var->id].empty())
+            b->var = stack[b->var->id].back();
+
+        int ns = getSuccessors(b, succ);
+        for (int s = 0; s < ns; ++s)
+            for (Tac *t = _bbs[succ[s]]->tac_chain; t != NULL; t = t->next) {
+                if (Tac::PHI != t->op_code)
+                    continue;
+                int o = _origin[t->op0.var->id];
+                PhiArg a = new PhiArgObject();
+                a->var = stack[o].empty() ? _temps[o] : stack[o].back();
+                a->pred = x;
+                a->next = t->args;
+                t->args = a;
+            }
+    }
+
+    // (the liveness is no longer valid)
+    for (int i = 0; i < _n; ++i)
+        _bbs[i]->Def = _bbs[i]->LiveUse = _bbs[i]->LiveIn = _bbs[i]->LiveOut =
+            NULL;
+}
+
+// appends a copy "dst <- src" to a basic block
+static void appendCopy(BasicBlock *b, Tac *&tail, Temp dst, Temp src) {
+    Tac *t = Tac::Assign(dst, src);
+    t->bb_num = b->bb_num;
+    t->prev = tail;
+    if (NULL == tail)
+        b->tac_chain = t;
+    else
+        tail->next = t;
+    tail = t;
+}
+
+/* Sequentializes a parallel copy (appended to a basic block).
+ *
+ * PARAMETERS:
+ *   b     - the basic block
+ *   dst   - the destinations (all different)
+ *   src   - the sources (none equal to its destination)
+ *   spare - a variable for breaking the cycles
+ *   loc   - (scratch) where the value of every source is now (by id)
+ *   pred  - (scratch) the source of every destination (by id)
+ * NOTE:
+ *   a copy is emitted as soon as its destination is no longer needed as a
+ *   source, and every cycle left (e.g. a swap) is broken with "spare".
+ */
+static void sequentialize(BasicBlock *b, Vector<Temp> &dst, Vector<Temp> &src,
+                          Temp spare, Vector<Temp> &loc, Vector<Temp> &pred) {
+    Vector<Temp> ready, todo;
+    Tac *tail = b->tac_chain;
+
+    while (NULL != tail && NULL != tail->next)
+        tail = tail->next;
+
+    for (size_t k = 0; k < dst.size(); ++k) {
+        loc[dst[k]->id] = loc[src[k]->id] = NULL;
+        pred[dst[k]->id] = pred[src[k]->id] = NULL;
+    }
+    for (size_t k = 0; k < dst.size(); ++k) {
+        loc[src[k]->id] = src[k];
+        pred[dst[k]->id] = src[k];
+        todo.push_back(dst[k]);
+    }
+    for (size_t k = 0; k < dst.size(); ++k)
+        if (NULL == loc[dst[k]->id])
+            ready.push_back(dst[k]);
+
+    while (!todo.empty()) {
+        while (!ready.empty()) {
+            Temp d = ready.back();
+            ready.pop_back();
+            Temp a = pred[d->id];
+            Temp c = loc[a->id];
+            appendCopy(b, tail, d, c);
+            loc[a->id] = d;
+            if (a == c && NULL != pred[a->id])
+                ready.push_back(a);
+        }
+
+        Temp d = todo.back();
+        todo.pop_back();
+        if (d != loc[pred[d->id]->id]) {
+            appendCopy(b, tail, spare, d);
+            loc[d->id] = spare;
+            ready.push_back(d);
+        }
+    }
+}
+
+/* Translates this graph out of SSA form.
+ *
+ * NOTE:
+ *   the blocks unreachable (e.g. after propagateConstants) are left alone,
+ *   and should be removed by simplify.
+ */
+void FlowGraph::destroySSA(void) {
+    Vector<int> order, reachable;
+    Vector<Vector<Tac *> > phis; // the PHIs of every block
+    int succ[2];
+
+    getPostorder(order);
+    reachable.resize(_n, 0);
+    for (size_t k = 0; k < order.size(); ++k)
+        reachable[order[k]] = 1;
+
+    phis.resize(_n);
+    for (int i = 0; i < _n; ++i)
+        for (Tac *t = _bbs[i]->tac_chain; t != NULL; t = t->next)
+            if (Tac::PHI == t->op_code)
+                phis[i].push_back(t);
+
+    // Step 1. puts the copies of every edge into its source (or a new block
+    //         in the middle, if the source has another successor)
+    Vector<Temp> dst, src, loc, pred;
+    Temp spare = NULL;
+    int n = _n;
+
+    for (int i = 0; i < n; ++i) {
+        BasicBlock *b = _bbs[i];
+        if (!reachable[i])
+            continue;
+        if (BasicBlock::BY_JZERO == b->end_kind && b->next[0] == b->next[1]) {
+            b->end_kind = BasicBlock::BY_JUMP;
+            b->var = NULL;
+        }
+
+        int ns = getSuccessors(b, succ);
+        for (int s = 0; s < ns; ++s) {
+            dst.clear();
+            src.clear();
+            for (size_t k = 0; k < phis[succ[s]].size(); ++k) {
+                Tac *t = phis[succ[s]][k];
+                PhiArg a = t->args;
+                while (NULL != a && a->pred != i)
+                    a = a->next;
+                mind_assert(NULL != a); // every reachable edge has one
+                if (a->var != t->op0.var) {
+                    dst.push_back(t->op0.var);
+                    src.push_back(a->var);
+                }
+            }
+            if (dst.empty())
+                continue;
+
+            if (NULL == spare) {
+                spare = newVersion(dst[0]);
+                _origin[spare->id] = spare->id; // (a variable of its own)
+            }
+            loc.resize(numTemps(), NULL);
+            pred.resize(numTemps(), NULL);
+
+            BasicBlock *where = b;
+            if (ns > 1) {
+                where = newBlock(succ[s]);
+                b->next[s] = where->bb_num;
+            }
+            sequentialize(where, dst, src, spare, loc, pred);
+        }
+    }
+
+    // Step 2. removes the PHIs
+    for (int i = 0; i < n; ++i)
+        for (size_t k = 0; k < phis[i].size(); ++k) {
+            Tac *t = phis[i][k];
+            if (NULL != t->prev)
+                t->prev->next = t->next;
+            else
+                _bbs[i]->tac_chain = t->next;
+            if (NULL != t->next)
+                t->next->prev = t->prev;
+        }
+
+    coalesceVersions();
+}
+
+/* Renames the versions of every variable back into it (if no two of them
+ * are alive at the same time), and removes the copies made useless.
+ *
+ * NOTE:
+ *   two versions interfere if one of them is alive where the other one is
+ *   defined, except after a copy from one to the other (then they are
+ *   equal).
+ */
+void FlowGraph::coalesceVersions(void) {
+    Vector<int> order;
+    Vector<int> size;  // how many versions every variable has
+    Vector<int> count; // how many versions of every variable are alive
+    Vector<int> bad;   // whether some versions of a variable interfere
+    Temp *v[2];
+    int n = (int)numTemps();
+
+    analyzeLiveness();
+    getPostorder(order);
+    size.resize(n, 0);
+    count.resize(n, 0);
+    bad.resize(n, 0);
+    for (int k = 0; k < n; ++k)
+        if (NULL != _temps[k])
+            ++size[_origin[k]];
+
+    BitSet live(n);
+    for (size_t p = 0; p < order.size(); ++p) {
+        BasicBlock *b = _bbs[order[p]];
+        Tac *last = b->tac_chain;
+
+        live.copyFrom(b->LiveOut);
+        if (BasicBlock::BY_JUMP != b->end_kind)
+            live.add(b->var->id);
+        for (BitSet::iterator it = live.begin(); it != live.end(); ++it)
+            ++count[_origin[*it]];
+
+        while (NULL != last && NULL != last->next)
+            last = last->next;
+        for (Tac *t = last; t != NULL; t = t->prev) {
+            Temp d = t->getDef();
+            int k = t->getUses(v);
+
+            if (NULL != d) {
+                int c = _origin[d->id];
+                bool alive = live.contains(d->id);
+                if (size[c] > 1) {
+                    int others = count[c] - (alive ? 1 : 0);
+                    Temp s = t->op1.var;
+                    if (Tac::ASSIGN == t->op_code && s != d &&
+                        _origin[s->id] == c && live.contains(s->id))
+                        --others;
+                    if (others > 0)
+                        bad[c] = 1;
+                }
+                if (alive) {
+                    live.remove(d->id);
+                    --count[c];
+                }
+            }
+
+            for (int i = 0; i < k; ++i)
+                if (!live.contains((*v[i])->id)) {
+                    live.add((*v[i])->id);
+                    ++count[_origin[(*v[i])->id]];
+                }
+        }
+
+        for (BitSet::iterator it = live.begin(); it != live.end(); ++it)
+            --count[_origin[*it]];
+    }
+
+    // renames the versions, and removes the copies "v <- v"
+    for (int i = 0; i < _n; ++i) {
+        BasicBlock *b = _bbs[i];
+        for (Tac *t = b->tac_chain; t != NULL; t = t->next) {
+            int k = t->getUses(v);
+            for (int j = 0; j < k; ++j)
+                if (!bad[_origin[(*v[j])->id]])
+                    *v[j] = _temps[_origin[(*v[j])->id]];
+            Temp d = t->getDef();
+            if (NULL != d && !bad[_origin[d->id]])
+                t->op0.var = _temps[_origin[d->id]];
+
+            if (Tac::ASSIGN == t->op_code && t->op0.var == t->op1.var) {
+                if (NULL != t->prev)
+                    t->prev->next = t->next;
+                else
+                    b->tac_chain = t->next;
+                if (NULL != t->next)
+                    t->next->prev = t->prev;
+            }
+        }
+        if (BasicBlock::BY_JUMP != b->end_kind && !bad[_origin[b->var->id]])
+            b->var = _temps[_origin[b->var->id]];
+    }
+
+    // (the versions renamed are no longer used)
+    for (int k = 0; k < n; ++k)
+        if (_origin[k] != k && !bad[_origin[k]])
+            _temps[k] = NULL;
+    while (!_temps.empty() && NULL == _temps.back())
+        _temps.pop_back();
+
+    for (int i = 0; i < _n; ++i)
+        _bbs[i]->Def = _bbs[i]->LiveUse = _bbs[i]->LiveIn = _bbs[i]->LiveOut =
+            NULL;
+}
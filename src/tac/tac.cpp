@@ -29,10 +29,12 @@ static Tac *allocateNewTac(Tac::Kind code) {
     Tac *t = new Tac;
     t->op_code = code;
     t->op0.ival = t->op1.ival = t->op2.ival = 0;
+    t->op0.var = t->op1.var = t->op2.var = NULL;
     t->bb_num = 0;
     t->mark = 0;
     t->prev = t->next = NULL;
-    t->LiveOut = NULL;
+    t->dead = 0;
+    t->args = NULL;
 
     return t;
 }
@@ -370,6 +372,102 @@ Tac *Tac::LOr(Temp dest, Temp op1, Temp op2) {
     return t;
 }
 
+/* Creates a Min tac.
+ *
+ * NOTE:
+ *   the smaller of two values (see tac/ifconv.cpp)
+ * PARAMETERS:
+ *   dest - result
+ *   op1  - operand 1
+ *   op2  - operand 2
+ * RETURNS:
+ *   a Min tac
+ */
+Tac *Tac::Min(Temp dest, Temp op1, Temp op2) {
+    REQUIRE_I4(dest);
+    REQUIRE_I4(op1);
+    REQUIRE_I4(op2);
+
+    Tac *t = allocateNewTac(Tac::MIN);
+    t->op0.var = dest;
+    t->op1.var = op1;
+    t->op2.var = op2;
+
+    return t;
+}
+
+/* Creates a Max tac.
+ *
+ * NOTE:
+ *   the greater of two values (see tac/ifconv.cpp)
+ * PARAMETERS:
+ *   dest - result
+ *   op1  - operand 1
+ *   op2  - operand 2
+ * RETURNS:
+ *   a Max tac
+ */
+Tac *Tac::Max(Temp dest, Temp op1, Temp op2) {
+    REQUIRE_I4(dest);
+    REQUIRE_I4(op1);
+    REQUIRE_I4(op2);
+
+    Tac *t = allocateNewTac(Tac::MAX);
+    t->op0.var = dest;
+    t->op1.var = op1;
+    t->op2.var = op2;
+
+    return t;
+}
+
+/* Creates a KeepNz tac.
+ *
+ * NOTE:
+ *   the value if the condition is not zero, or else 0 (see tac/ifconv.cpp)
+ * PARAMETERS:
+ *   dest - result
+ *   src  - the value
+ *   cond - the condition
+ * RETURNS:
+ *   a KeepNz tac
+ */
+Tac *Tac::KeepNz(Temp dest, Temp src, Temp cond) {
+    REQUIRE_I4(dest);
+    REQUIRE_I4(src);
+    REQUIRE_I4(cond);
+
+    Tac *t = allocateNewTac(Tac::KEEP_NZ);
+    t->op0.var = dest;
+    t->op1.var = src;
+    t->op2.var = cond;
+
+    return t;
+}
+
+/* Creates a KeepZ tac.
+ *
+ * NOTE:
+ *   the value if the condition is zero, or else 0 (see tac/ifconv.cpp)
+ * PARAMETERS:
+ *   dest - result
+ *   src  - the value
+ *   cond - the condition
+ * RETURNS:
+ *   a KeepZ tac
+ */
+Tac *Tac::KeepZ(Temp dest, Temp src, Temp cond) {
+    REQUIRE_I4(dest);
+    REQUIRE_I4(src);
+    REQUIRE_I4(cond);
+
+    Tac *t = allocateNewTac(Tac::KEEP_Z);
+    t->op0.var = dest;
+    t->op1.var = src;
+    t->op2.var = cond;
+
+    return t;
+}
+
 /* Creates an Assign tac.
  *
  * NOTE:
@@ -578,6 +676,25 @@ Tac *Tac::Param(Temp dest) {
     return t;
 }
 
+/* Creates a Phi tac.
+ *
+ * NOTE:
+ *   selects the argument coming from the predecessor just left (in SSA
+ *   form, see tac/ssa.cpp). the arguments are added afterwards.
+ * PARAMETERS:
+ *   dest - result
+ * RETURNS:
+ *   a Phi tac
+ */
+Tac *Tac::Phi(Temp dest) {
+    REQUIRE_I4(dest);
+
+    Tac *t = allocateNewTac(Tac::PHI);
+    t->op0.var = dest;
+
+    return t;
+}
+
 /* Creates a Return tac.
  *
  * NOTE:
@@ -664,6 +781,79 @@ std::ostream &mind::operator<<(std::ostream &os, Functy f) {
     return os;
 }
 
+/* Gets the variable defined by the Tac node.
+ *
+ * RETURNS:
+ *   the variable defined (NULL if none)
+ */
+Temp Tac::getDef(void) {
+    switch (op_code) {
+    case MEMO:
+    case MARK:
+    case JUMP:
+    case JZERO:
+    case PUSH:
+    case RETURN:
+    case PARAM:
+        return NULL;
+
+    default:
+        return op0.var; // (NULL for a "pop()" without result)
+    }
+}
+
+/* Gets the variables read by the Tac node.
+ *
+ * PARAMETERS:
+ *   v     - (output) the operands read
+ * RETURNS:
+ *   how many operands are read
+ * NOTE:
+ *   the arguments of a PHI are not included (see Tac::args).
+ */
+int Tac::getUses(Temp *v[2]) {
+    switch (op_code) {
+    case ASSIGN:
+    case NEG:
+    case LNOT:
+    case BNOT:
+    case LOAD:
+    case JZERO:
+        v[0] = &op1.var;
+        return 1;
+
+    case ADD:
+    case SUB:
+    case MUL:
+    case DIV:
+    case MOD:
+    case EQU:
+    case NEQ:
+    case LES:
+    case LEQ:
+    case GTR:
+    case GEQ:
+    case LAND:
+    case LOR:
+    case MIN:
+    case MAX:
+    case KEEP_NZ:
+    case KEEP_Z:
+        v[0] = &op1.var;
+        v[1] = &op2.var;
+        return 2;
+
+    case PUSH:
+    case PARAM:
+    case RETURN:
+        v[0] = &op0.var;
+        return 1;
+
+    default:
+        return 0;
+    }
+}
+
 /* Dumps the Tac node to an output stream.
  *
  * PARAMETERS:
@@ -748,6 +938,26 @@ void Tac::dump(std::ostream &os) {
            << ")";
         break;
 
+    case MIN:
+        os << "    " << op0.var << " <- min(" << op1.var << ", " << op2.var
+           << ")";
+        break;
+
+    case MAX:
+        os << "    " << op0.var << " <- max(" << op1.var << ", " << op2.var
+           << ")";
+        break;
+
+    case KEEP_NZ:
+        os << "    " << op0.var << " <- (" << op1.var << " if " << op2.var
+           << " != 0)";
+        break;
+
+    case KEEP_Z:
+        os << "    " << op0.var << " <- (" << op1.var << " if " << op2.var
+           << " == 0)";
+        break;
+
     case LNOT:
         os << "    " << op0.var << " <- (! " << op1.var << ")";
         break;
@@ -803,6 +1013,16 @@ void Tac::dump(std::ostream &os) {
         os << "    PARAM " << op0.var;
         break;
 
+    case PHI:
+        os << "    " << op0.var << " <- PHI(";
+        for (PhiArg a = args; NULL != a; a = a->next) {
+            if (a != args)
+                os << ", ";
+            os << a->var << " @B" << a->pred;
+        }
+        os << ")";
+        break;
+
     default:
         mind_assert(false); // unreachable
         break;
@@ -834,10 +1054,7 @@ std::ostream &mind::operator<<(std::ostream &os, Tac *t) {
     t->dump(oss);
     os << std::left << std::setw(32) << oss.str();
 
-    // in dataflow analysis, we will print all the LiveOut sets
-    if (Option::getLevel() == Option::DATAFLOW)
-        os << "| " << t->LiveOut;
-
+    // in dataflow analysis, the LiveOut sets are printed by BasicBlock::dump
     os << std::endl;
     return os;
 }
@@ -6,6 +6,7 @@
 #ifndef __MIND_TAC__
 #define __MIND_TAC__
 
+#include "3rdparty/bitset.hpp"
 #include "3rdparty/set.hpp"
 #include "define.hpp"
 
@@ -29,10 +30,16 @@ namespace tac {
  *
  */
 typedef struct TempObject {
-    int id;               // id of a Temp (Temp1, ... , TempN)
+    int id;               // id of a Temp (Temp0, ... , TempN, numbered inside
+                          // every function so that sets of Temps are dense)
     int size;             // size of a Temp (e.g. size = 4 for int32)
     bool is_offset_fixed; // whether the Temp has been allocated on the stack
     int offset;           // the offset on the stack (relative to fp, see the example)
+    int reg;              // the register assigned by the global register allocator
+                          // (0 if it lives in the stack-frame, see asm/riscv_reg_alloc.cpp)
+    bool is_const;        // whether the Temp only ever holds the constant "value"
+                          // (so that it can be an immediate, see asm/riscv_imm.cpp)
+    int value;            // the value of a constant Temp
 } * Temp;
 
 /** Representation of a Label.
@@ -57,6 +64,16 @@ typedef struct FunctyObject {
     Tac *code;           // tac chain of the function
 } * Functy;
 
+/** Representation of an argument of a PHI tac (see tac/ssa.cpp).
+ *
+ *  NOTE: the arguments of a PHI form a list, in no particular order.
+ */
+typedef struct PhiArgObject {
+    Temp var;             // the variable coming from the predecessor
+    int pred;             // the block number of the predecessor
+    PhiArgObject *next;   // the next argument
+} * PhiArg;
+
 typedef struct GlobalObject {
     std::string name;   
     int value;
@@ -89,6 +106,10 @@ struct Tac {
         NEG,
         LAND,
         LOR,
+        MIN,
+        MAX,
+        KEEP_NZ,
+        KEEP_Z,
         LNOT,
         BNOT,
         MARK,
@@ -103,6 +124,7 @@ struct Tac {
         MEMO,
         CALL,
         PARAM,
+        PHI,
     } Kind;
 
     // Operand type
@@ -125,8 +147,10 @@ struct Tac {
     Tac *next; // the next tac
 
     int bb_num; // basic block number, for dataflow analysis
-    util::Set<Temp> *LiveOut; // for dataflow analysis: LiveOut set of this TAC
+    int dead;   // for dataflow analysis: bit k is set if the variable of
+                // op_k is not alive after this TAC (see tac::LiveCursor)
     int mark;   // auxiliary: do anything you want
+    PhiArg args; // the arguments (for PHI only, in SSA form)
 
     // static creation methods for TACs. (see: TransHelper)
     static Tac *Add(Temp dest, Temp op1, Temp op2);
@@ -142,6 +166,10 @@ struct Tac {
     static Tac *Geq(Temp dest, Temp op1, Temp op2);
     static Tac *LAnd(Temp dest, Temp op1, Temp op2);
     static Tac *LOr(Temp dest, Temp op1, Temp op2);
+    static Tac *Min(Temp dest, Temp op1, Temp op2);
+    static Tac *Max(Temp dest, Temp op1, Temp op2);
+    static Tac *KeepNz(Temp dest, Temp src, Temp cond);
+    static Tac *KeepZ(Temp dest, Temp src, Temp cond);
     static Tac *Assign(Temp dest, Temp src);
     static Tac *Neg(Temp dest, Temp src);
     static Tac *LNot(Temp dest, Temp src);
@@ -158,7 +186,13 @@ struct Tac {
     static Tac *Memo(const char *);
     static Tac *Call(Temp dest, Label label);
     static Tac *Param(Temp dest);
+    static Tac *Phi(Temp dest);
 
+    // gets the variable defined by this tac (NULL if none)
+    Temp getDef(void);
+    // gets the variables read by this tac (the operands themselves, so that
+    // they can be renamed), except the arguments of a PHI
+    int getUses(Temp *v[2]);
     // dumps a single tac node to some output stream
     void dump(std::ostream &);
 };
@@ -77,6 +77,9 @@ Temp TransHelper::getNewTempI4(void) {
     v->size = 4;
     v->offset = 0;
     v->is_offset_fixed = false;
+    v->reg = 0;
+    v->is_const = false;
+    v->value = 0;
 
     return v;
 }
@@ -188,6 +191,7 @@ void TransHelper::endFunc(void) {
     tacs = tacs_tail = NULL;
     current->attachFuncty(ptail->as.functy);
     current = NULL;
+    var_count = 0; // temporary variables are numbered inside every function
 }
 
 void TransHelper::genGlobalVarible(std::string name, int value) {
@@ -134,8 +134,7 @@ void Translation::visit(ast::ExprStmt *s) { s->e->accept(this); }
 void Translation::visit(ast::IfStmt *s) {
     Label L1 = tr->getNewLabel(); // entry of the false branch
     Label L2 = tr->getNewLabel(); // exit
-    s->condition->accept(this);
-    tr->genJumpOnZero(L1, s->condition->ATTR(val));
+    translateCondition(s->condition, L1, false);
 
     s->true_brch->accept(this);
     tr->genJump(L2); // done
@@ -157,8 +156,7 @@ void Translation::visit(ast::WhileStmt *s) {
     current_continue_label = L1;
 
     tr->genMarkLabel(L1);
-    s->condition->accept(this);
-    tr->genJumpOnZero(L2, s->condition->ATTR(val));
+    translateCondition(s->condition, L2, false);
 
     s->loop_body->accept(this);
     tr->genJump(L1);
@@ -185,8 +183,7 @@ void Translation::visit(ast::ForStmt *s) {
 
     
     if(s->first_condition != NULL){
-        s->first_condition->accept(this);
-        tr->genJumpOnZero(L2, s->first_condition->ATTR(val));
+        translateCondition(s->first_condition, L2, false);
     }
     
     tr->genMarkLabel(L1);
@@ -198,8 +195,7 @@ void Translation::visit(ast::ForStmt *s) {
         s->update->accept(this);
 
     if(s->condition != NULL){
-        s->condition->accept(this);
-        tr->genJumpOnZero(L2, s->condition->ATTR(val));
+        translateCondition(s->condition, L2, false);
     }
  
     tr->genJump(L1);
@@ -249,17 +245,132 @@ void Translation::visit(ast::NeqExpr *e) {
 
 /* Translating an ast::AndExpr node.
  */
-void Translation::visit(ast::AndExpr *e) {
-    e->e1->accept(this);
-    e->e2->accept(this);
-    e->ATTR(val) = tr->genLAnd(e->e1->ATTR(val), e->e2->ATTR(val));
-}
+void Translation::visit(ast::AndExpr *e) { translateLogical(e); }
+
 /* Translating an ast::OrExpr node.
  */
-void Translation::visit(ast::OrExpr *e) {
-    e->e1->accept(this);
-    e->e2->accept(this);
-    e->ATTR(val) = tr->genLOr(e->e1->ATTR(val), e->e2->ATTR(val));
+void Translation::visit(ast::OrExpr *e) { translateLogical(e); }
+
+/* Translates "&&" or "||" into a 0/1 value (e2 is evaluated only if needed).
+ *
+ * PARAMETERS:
+ *   e     - the AndExpr or OrExpr node
+ */
+void Translation::translateLogical(ast::Expr *e) {
+    Label L1 = tr->getNewLabel(); // the result is false
+    Label L2 = tr->getNewLabel(); // exit
+    Temp temp = tr->getNewTempI4();
+
+    translateCondition(e, L1, false);
+    tr->genAssign(temp, tr->genLoadImm4(1));
+    tr->genJump(L2);
+
+    tr->genMarkLabel(L1);
+    tr->genAssign(temp, tr->genLoadImm4(0));
+
+    tr->genMarkLabel(L2);
+    e->ATTR(val) = temp;
+}
+
+/* Translates a condition into a chain of jumps, without materializing the
+ * value of "&&", "||" and "!" (short-circuit evaluation).
+ *
+ * PARAMETERS:
+ *   e      - the condition
+ *   target - where to jump
+ *   when   - whether to jump if e holds (otherwise, if it doesn't)
+ * NOTE:
+ *   the code falls through in the other case. a jump if the condition
+ *   holds is a JZERO on its negation: the comparisons are negated in
+ *   place, and "JZERO !x" is fused into "bnez x" by the code generator.
+ */
+void Translation::translateCondition(ast::Expr *e, Label target, bool when) {
+    ast::Expr *e1, *e2;
+    Temp c;
+
+    switch (e->getKind()) {
+    case ast::ASTNode::AND_EXPR:
+    case ast::ASTNode::OR_EXPR: {
+        bool is_and = (ast::ASTNode::AND_EXPR == e->getKind());
+        if (is_and) {
+            e1 = ((ast::AndExpr *)e)->e1;
+            e2 = ((ast::AndExpr *)e)->e2;
+        } else {
+            e1 = ((ast::OrExpr *)e)->e1;
+            e2 = ((ast::OrExpr *)e)->e2;
+        }
+
+        if (is_and != when) {
+            // "a && b" is false (or "a || b" is true) if either part is
+            translateCondition(e1, target, when);
+            translateCondition(e2, target, when);
+        } else {
+            // otherwise, e2 decides unless e1 does
+            Label skip = tr->getNewLabel();
+            translateCondition(e1, skip, !when);
+            translateCondition(e2, target, when);
+            tr->genMarkLabel(skip);
+        }
+        return;
+    }
+
+    case ast::ASTNode::NOT_EXPR:
+        translateCondition(((ast::NotExpr *)e)->e, target, !when);
+        return;
+
+    case ast::ASTNode::EQU_EXPR:
+        if (!when)
+            break;
+        e1 = ((ast::EquExpr *)e)->e1;
+        e2 = ((ast::EquExpr *)e)->e2;
+        e1->accept(this);
+        e2->accept(this);
+        c = tr->genNeq(e1->ATTR(val), e2->ATTR(val));
+        tr->genJumpOnZero(target, c);
+        return;
+
+    case ast::ASTNode::NEQ_EXPR:
+        if (!when)
+            break;
+        e1 = ((ast::NeqExpr *)e)->e1;
+        e2 = ((ast::NeqExpr *)e)->e2;
+        e1->accept(this);
+        e2->accept(this);
+        c = tr->genEqu(e1->ATTR(val), e2->ATTR(val));
+        tr->genJumpOnZero(target, c);
+        return;
+
+    case ast::ASTNode::GRT_EXPR: // !(a > b) => b >= a
+        if (!when)
+            break;
+        e1 = ((ast::GrtExpr *)e)->e1;
+        e2 = ((ast::GrtExpr *)e)->e2;
+        e1->accept(this);
+        e2->accept(this);
+        c = tr->genGeq(e2->ATTR(val), e1->ATTR(val));
+        tr->genJumpOnZero(target, c);
+        return;
+
+    case ast::ASTNode::GEQ_EXPR: // !(a >= b) => b > a
+        if (!when)
+            break;
+        e1 = ((ast::GeqExpr *)e)->e1;
+        e2 = ((ast::GeqExpr *)e)->e2;
+        e1->accept(this);
+        e2->accept(this);
+        c = tr->genGtr(e2->ATTR(val), e1->ATTR(val));
+        tr->genJumpOnZero(target, c);
+        return;
+
+    default:
+        break;
+    }
+
+    e->accept(this);
+    c = e->ATTR(val);
+    if (when)
+        c = tr->genLNot(c);
+    tr->genJumpOnZero(target, c);
 }
 
 /* Translating an ast::GeqExpr node.
@@ -327,9 +438,8 @@ void Translation::visit(ast::ModExpr *e){
 void Translation::visit(ast::IfExpr *e){
     Label L1 = tr->getNewLabel(); // entry of the false branch
     Label L2 = tr->getNewLabel(); // exit
-    e->condition->accept(this);
     Temp temp = tr->getNewTempI4();
-    tr->genJumpOnZero(L1, e->condition->ATTR(val));
+    translateCondition(e->condition, L1, false);
 
     e->true_brch->accept(this);
     tr->genAssign(temp, e->true_brch->ATTR(val));
@@ -58,6 +58,11 @@ class Translation : public ast::Visitor {
   private:
     tac::TransHelper *tr;
     tac::Label current_break_label, current_continue_label;
+
+    // translates a condition into jumps (short-circuit evaluation)
+    void translateCondition(ast::Expr *, tac::Label, bool);
+    // translates "&&" or "||" into a 0/1 value
+    void translateLogical(ast::Expr *);
 };
 } // namespace mind
 
@@ -0,0 +1,40 @@
+// A branch folded by the if-conversion must not leave its condition behind:
+// the empty "if (i) {}" is folded on any machine with min/max or with the
+// conditional zero instructions, and "if (x)" turns into selects on x.
+//
+// flags: -O -march=rv32im_zbb
+// flags: -O -march=rv32im_zicond
+// flags: -O -march=rv32imc_zba_zbb_zicond
+// expect: 110
+int sum(int n) {
+    int s = 0;
+    int i = 0;
+    while (i < n) {
+        i = i + 1;
+        if (i) {
+        }
+        s = s + i;
+    }
+    return s;
+}
+
+int choose(int n) {
+    int s = 0;
+    int x = 0;
+    int i = 0;
+    while (i < n) {
+        x = i % 3;
+        int y = 0;
+        if (x)
+            y = i;
+        else
+            y = 7;
+        s = s + y;
+        i = i + 1;
+    }
+    return s + x;
+}
+
+int main() {
+    return sum(10) + choose(10);
+}
@@ -0,0 +1,24 @@
+// The exit test "i > 14" is reached only when i % 8 == 0, so i steps past
+// 14 untested, and "i * 134217728 > 14 * 134217728" would overflow: the
+// test must not be rewritten on the derived induction variable.
+//
+// flags:
+// flags: -O
+// flags: -O -march=rv32imc_zba_zbb_zicond
+// expect: 58
+int main() {
+    int c = 0;
+    int i = 0;
+    while (1) {
+        if (i < 15)
+            c = c + i * 134217728 % 7;
+        if (i % 8 == 0) {
+            if (i > 14)
+                break;
+        }
+        i = i + 1;
+        if (i > 100)
+            return 77;
+    }
+    return i + c;
+}
@@ -0,0 +1,50 @@
+// Multiplications, divisions and modulos by constants without M, done by
+// shifts and additions instead of the software routines: every quotient
+// must leave a remainder of the sign of the dividend and below the divisor,
+// and every product must match the same one by powers of 2.
+//
+// flags: -march=rv32i
+// flags: -O -march=rv32i
+// flags: -O -march=rv32ic_zba_zbb
+// flags: -O
+// expect: 100
+int ok(int x, int d, int q, int r) {
+    int m = d;
+    if (m < 0)
+        m = -m;
+    if (x - q * d != r)
+        return 0;
+    if (x >= 0)
+        return r >= 0 && r < m;
+    return r <= 0 && r > -m;
+}
+
+int main() {
+    int bad = 0;
+    for (int i = 0; i < 63; i = i + 1) {
+        int x = i * 35791394 - 1073741823;
+        if (i == 60)
+            x = 2147483647;
+        if (i == 61)
+            x = -2147483647 - 1;
+        if (i == 62)
+            x = -1;
+        if (!ok(x, 7, x / 7, x % 7)) bad = bad + 1;
+        if (!ok(x, -7, x / -7, x % -7)) bad = bad + 1;
+        if (!ok(x, 10, x / 10, x % 10)) bad = bad + 1;
+        if (!ok(x, -3, x / -3, x % -3)) bad = bad + 1;
+        if (!ok(x, 6, x / 6, x % 6)) bad = bad + 1;
+        if (!ok(x, 641, x / 641, x % 641)) bad = bad + 1;
+        if (!ok(x, 1000000007, x / 1000000007, x % 1000000007)) bad = bad + 1;
+        if (!ok(x, 1431655765, x / 1431655765, x % 1431655765)) bad = bad + 1;
+        if (!ok(x, -2147483647, x / -2147483647, x % -2147483647)) bad = bad + 1;
+
+        int y = x / 65536;
+        if (y * 45 != y * 32 + y * 8 + y * 4 + y) bad = bad + 1;
+        if (y * -7 != y - y * 8) bad = bad + 1;
+        if (y * 1000 != y * 1024 - y * 16 - y * 8) bad = bad + 1;
+        if (y * -2049 != 0 - y * 2048 - y) bad = bad + 1;
+        if (y * 273 != y * 256 + y * 16 + y) bad = bad + 1;
+    }
+    return 100 + bad;
+}
@@ -0,0 +1,31 @@
+// Globals (addressed by relocated auipc/addi pairs), constants out of the
+// 12-bit immediates, calls and, without M, the software routines: every
+// form of the output (.s, -c and -filetype=dis) must run the same.
+//
+// flags:
+// flags: -O
+// flags: -O -march=rv32imc_zba_zbb_zicond
+// flags: -O -march=rv32i
+// expect: 73
+int g = 305419896;
+int h = 70000;
+
+int mix(int a, int b) {
+    return (a * 31 + b) % 65521 - (a / 7) + (b % 1000003);
+}
+
+int main() {
+    int s = 0;
+    int big = 123456789;
+    for (int i = 0; i < 40; i = i + 1) {
+        if (i % 3 == 0) {
+            s = s + mix(i, big);
+        } else if (i > 20) {
+            s = s - g / (i + 1);
+        } else {
+            s = s + i * -2049 + 4096;
+        }
+        big = big - 65536;
+    }
+    return (s + h + g % 251) % 256;
+}
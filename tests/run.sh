@@ -0,0 +1,66 @@
+#!/bin/bash
+# Regression tests of the optimizer and of the RISC-V back end.
+#
+# Every test is a C file whose first lines give the options of mind and the
+# exit code expected, e.g.
+#
+#   // flags: -O -march=rv32im_zbb
+#   // expect: 58
+#
+# A test with several "flags" lines is compiled and run once for each. The
+# test programs are assembled and linked by riscv64-unknown-elf-gcc and run
+# by qemu-riscv32, as minidecaf-tests does.
+#
+# Every test is built three ways: as assembly (the default output), as an
+# ELF object (-c, linked as it is) and as the disassembly of that object
+# (-filetype=dis, assembled again). All of them must return the exit code
+# expected, so the encoder, the ELF writer and the disassembler are checked
+# against the assembly path. FILETYPES="asm" keeps the assembly only.
+#
+# Usage: bash tests/run.sh [test.c ...]   (from the project root, after make)
+
+MIND=${MIND:-./src/mind}
+CC=${CC:-riscv64-unknown-elf-gcc}
+QEMU=${QEMU:-qemu-riscv32}
+FILETYPES=${FILETYPES:-"asm obj dis"}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+tests=("$@")
+[ ${#tests[@]} -eq 0 ] && tests=(tests/*.c)
+
+failed=0
+for t in "${tests[@]}"; do
+  expect=$(sed -n 's|^// expect: *||p' "$t")
+  while read -r flags; do
+    march=$(echo "$flags" | sed -n 's/.*-march=\([a-z0-9_]*\).*/\1/p')
+    for ft in $FILETYPES; do
+      case $ft in
+        asm) opt=""; out="$TMP/out.s" ;;
+        obj) opt="-c"; out="$TMP/out.o" ;;
+        dis) opt="-filetype=dis"; out="$TMP/out.dis.s" ;;
+      esac
+      run="$t [$(echo $flags $opt)]"
+      if ! $MIND -l 5 $flags $opt -o "$out" "$t" > "$TMP/log" 2>&1; then
+        echo "FAIL $run: mind failed"
+        failed=$((failed + 1))
+        continue
+      fi
+      if ! $CC -march=${march:-rv32im} -mabi=ilp32 "$out" -o "$TMP/out" > "$TMP/log" 2>&1; then
+        echo "FAIL $run: cannot assemble or link"
+        failed=$((failed + 1))
+        continue
+      fi
+      timeout 10 $QEMU -cpu max "$TMP/out"
+      got=$?
+      if [ "$got" != "$expect" ]; then
+        echo "FAIL $run: expected $expect, got $got"
+        failed=$((failed + 1))
+      else
+        echo "OK   $run"
+      fi
+    done
+  done < <(sed -n 's|^// flags: *||p' "$t")
+done
+
+[ $failed -eq 0 ] || { echo "$failed failed"; exit 1; }
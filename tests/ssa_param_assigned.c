@@ -0,0 +1,18 @@
+// A parameter assigned in the body holds the argument before that, so it
+// must be renamed in SSA form even if it is assigned only once.
+//
+// flags:
+// flags: -O
+// flags: -O -march=rv32imc_zba_zbb_zicond
+// expect: 118
+int f(int p, int d) {
+    int old = p;
+    p = 5;
+    if (d > 0)
+        return old + f(p + d, d - 1);
+    return old + p;
+}
+
+int main() {
+    return f(100, 2);
+}
@@ -0,0 +1,44 @@
+// A block ending in a tail call without arguments emits no instruction of
+// its own (the jump is added with the epilogue), so its instruction chain
+// must still be terminated. f2 is too big to be inlined.
+//
+// flags:
+// flags: -O
+// flags: -O -march=rv32imc_zba_zbb_zicond
+// expect: 4
+int g1 = 4;
+
+int f2() {
+    int x = g1;
+    x = x * 2 % 1009 + g1 % 3;
+    x = x * 3 % 1009 + g1 % 4;
+    x = x * 4 % 1009 + g1 % 5;
+    x = x * 5 % 1009 + g1 % 6;
+    x = x * 6 % 1009 + g1 % 7;
+    x = x * 2 % 1009 + g1 % 8;
+    x = x * 3 % 1009 + g1 % 9;
+    x = x * 4 % 1009 + g1 % 10;
+    x = x * 5 % 1009 + g1 % 11;
+    x = x * 6 % 1009 + g1 % 12;
+    x = x * 2 % 1009 + g1 % 13;
+    x = x * 3 % 1009 + g1 % 14;
+    x = x * 4 % 1009 + g1 % 15;
+    x = x * 5 % 1009 + g1 % 16;
+    x = x * 6 % 1009 + g1 % 17;
+    x = x * 2 % 1009 + g1 % 18;
+    x = x * 3 % 1009 + g1 % 19;
+    x = x * 4 % 1009 + g1 % 20;
+    return x % 4 + g1;
+}
+
+int main() {
+    int acc = 0;
+    for (int i = 0; i < 30; i = i + 1) {
+        acc = acc + i;
+        if (f2() == g1 + i - 5) {
+            if (~acc)
+                return f2();
+        }
+    }
+    return acc;
+}